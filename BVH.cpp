@@ -0,0 +1,364 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cassert>
+
+//past this depth, build() splits at the median (which bounds the depth, and so the traversal stacks):
+static constexpr uint32_t MaxSahDepth = 48;
+static constexpr uint32_t StackSize = MaxSahDepth + 64;
+
+static float area(glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+//a node's term in the SAH cost (its area, times its item count for leaves):
+static float weighted(BVH::Node const &node) {
+	return area(node.min, node.max) * (node.count ? float(node.count) : 1.0f);
+}
+
+//SAH cost from the weighted area sum:
+static float normalized(double weighted_area, BVH::Node const &root, size_t node_count) {
+	float root_area = area(root.min, root.max);
+	return (root_area > 0.0f ? float(weighted_area / root_area) : float(node_count));
+}
+
+static glm::vec3 box_min(Frustum::Boxes const &boxes, uint32_t i) {
+	return glm::vec3(boxes.center_x[i] - boxes.extent_x[i], boxes.center_y[i] - boxes.extent_y[i], boxes.center_z[i] - boxes.extent_z[i]);
+}
+
+static glm::vec3 box_max(Frustum::Boxes const &boxes, uint32_t i) {
+	return glm::vec3(boxes.center_x[i] + boxes.extent_x[i], boxes.center_y[i] + boxes.extent_y[i], boxes.center_z[i] + boxes.extent_z[i]);
+}
+
+void BVH::build(Frustum::Boxes const &items) {
+	uint32_t count = uint32_t(items.size());
+	nodes.clear();
+	parents.clear();
+	order.resize(count);
+	positions.resize(count);
+	leaves.resize(count);
+	boxes.clear();
+	dirty.clear();
+	dirty_nodes.clear();
+	built_cost = current_cost = 0.0f;
+	weighted_area = 0.0;
+	if (count == 0) return;
+
+	//items are partitioned as these (rather than as indices) so that each pass over a node's items reads them in order:
+	struct Ref {
+		glm::vec3 min, max, center;
+		uint32_t item;
+	};
+	std::vector< Ref > refs(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		refs[i] = Ref{box_min(items, i), box_max(items, i), glm::vec3(items.center_x[i], items.center_y[i], items.center_z[i]), i};
+	}
+	nodes.reserve(2 * count);
+	parents.reserve(2 * count);
+
+	//make a node for refs[begin] up to refs[end], returning its index:
+	std::function< uint32_t(uint32_t, uint32_t, uint32_t, uint32_t) > make_node;
+	make_node = [&](uint32_t begin, uint32_t end, uint32_t parent, uint32_t depth) -> uint32_t {
+		uint32_t index = uint32_t(nodes.size());
+		nodes.emplace_back();
+		parents.emplace_back(parent);
+
+		glm::vec3 min = glm::vec3(std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		glm::vec3 center_min = min, center_max = max;
+		for (uint32_t i = begin; i < end; ++i) {
+			min = glm::min(min, refs[i].min);
+			max = glm::max(max, refs[i].max);
+			center_min = glm::min(center_min, refs[i].center);
+			center_max = glm::max(center_max, refs[i].center);
+		}
+		nodes[index].min = min;
+		nodes[index].max = max;
+
+		if (end - begin <= LeafSize) {
+			nodes[index].first = begin;
+			nodes[index].count = end - begin;
+			for (uint32_t i = begin; i < end; ++i) leaves[refs[i].item] = index;
+			return index;
+		}
+
+		//pick the split between bins (by center) that minimizes area-weighted item counts on each side:
+		uint32_t mid = begin;
+		if (depth < MaxSahDepth) {
+			struct Bin {
+				glm::vec3 min = glm::vec3(std::numeric_limits< float >::infinity());
+				glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+				uint32_t count = 0;
+			} bins[3][Bins];
+			glm::vec3 scale = glm::vec3(0.0f); //(zero along axes where all centers are in one plane)
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				if (center_max[axis] > center_min[axis]) scale[axis] = float(Bins) / (center_max[axis] - center_min[axis]);
+			}
+			auto bin_of = [&](Ref const &ref, uint32_t axis) {
+				return std::min(Bins - 1, uint32_t((ref.center[axis] - center_min[axis]) * scale[axis]));
+			};
+			//(one pass over the items fills the bins along all three axes)
+			for (uint32_t i = begin; i < end; ++i) {
+				for (uint32_t axis = 0; axis < 3; ++axis) {
+					Bin &bin = bins[axis][bin_of(refs[i], axis)];
+					bin.min = glm::min(bin.min, refs[i].min);
+					bin.max = glm::max(bin.max, refs[i].max);
+					bin.count += 1;
+				}
+			}
+			float best_cost = std::numeric_limits< float >::infinity();
+			uint32_t best_axis = -1U, best_bin = 0;
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				if (scale[axis] == 0.0f) continue;
+				//right side of each split, then sweep the left side across:
+				float right_cost[Bins];
+				Bin right;
+				for (uint32_t b = Bins - 1; b > 0; --b) {
+					right.min = glm::min(right.min, bins[axis][b].min);
+					right.max = glm::max(right.max, bins[axis][b].max);
+					right.count += bins[axis][b].count;
+					right_cost[b] = (right.count ? area(right.min, right.max) * float(right.count) : 0.0f);
+				}
+				Bin left;
+				for (uint32_t b = 1; b < Bins; ++b) {
+					left.min = glm::min(left.min, bins[axis][b-1].min);
+					left.max = glm::max(left.max, bins[axis][b-1].max);
+					left.count += bins[axis][b-1].count;
+					if (left.count == 0 || left.count == end - begin) continue;
+					float cost = area(left.min, left.max) * float(left.count) + right_cost[b];
+					if (cost < best_cost) {
+						best_cost = cost;
+						best_axis = axis;
+						best_bin = b;
+					}
+				}
+			}
+			if (best_axis != -1U) {
+				mid = uint32_t(std::partition(refs.begin() + begin, refs.begin() + end, [&](Ref const &ref) {
+					return bin_of(ref, best_axis) < best_bin;
+				}) - refs.begin());
+			}
+		}
+		if (mid == begin || mid == end) {
+			//no useful split (or too deep): halve along the longest axis of the centers:
+			glm::vec3 size = center_max - center_min;
+			uint32_t axis = (size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2));
+			mid = (begin + end) / 2;
+			std::nth_element(refs.begin() + begin, refs.begin() + mid, refs.begin() + end, [&](Ref const &a, Ref const &b) {
+				return a.center[axis] < b.center[axis];
+			});
+		}
+
+		make_node(begin, mid, index, depth + 1);
+		uint32_t second = make_node(mid, end, index, depth + 1);
+		nodes[index].first = second;
+		nodes[index].count = 0;
+		return index;
+	};
+	make_node(0, count, -1U, 0);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t item = order[i] = refs[i].item;
+		positions[item] = i;
+		boxes.push(
+			glm::vec3(items.center_x[item], items.center_y[item], items.center_z[item]),
+			glm::vec3(items.extent_x[item], items.extent_y[item], items.extent_z[item])
+		);
+	}
+	dirty.assign(nodes.size(), 0);
+	for (Node const &node : nodes) {
+		weighted_area += weighted(node);
+	}
+	built_cost = current_cost = normalized(weighted_area, nodes[0], nodes.size());
+}
+
+void BVH::rebuild() {
+	Frustum::Boxes items;
+	for (uint32_t item = 0; item < positions.size(); ++item) {
+		uint32_t i = positions[item];
+		items.push(
+			glm::vec3(boxes.center_x[i], boxes.center_y[i], boxes.center_z[i]),
+			glm::vec3(boxes.extent_x[i], boxes.extent_y[i], boxes.extent_z[i])
+		);
+	}
+	build(items);
+}
+
+void BVH::update(uint32_t item, glm::vec3 const &center, glm::vec3 const &extent) {
+	assert(item < positions.size());
+	uint32_t i = positions[item];
+	boxes.center_x[i] = center.x;
+	boxes.center_y[i] = center.y;
+	boxes.center_z[i] = center.z;
+	boxes.extent_x[i] = extent.x;
+	boxes.extent_y[i] = extent.y;
+	boxes.extent_z[i] = extent.z;
+	uint32_t leaf = leaves[item];
+	if (!dirty[leaf]) {
+		dirty[leaf] = 1;
+		dirty_nodes.emplace_back(leaf);
+	}
+}
+
+uint32_t BVH::refit() {
+	if (dirty_nodes.empty()) return 0;
+
+	//everything above a moved leaf needs refitting too:
+	for (uint32_t i = 0, leaf_count = uint32_t(dirty_nodes.size()); i < leaf_count; ++i) {
+		for (uint32_t n = parents[dirty_nodes[i]]; n != -1U && !dirty[n]; n = parents[n]) {
+			dirty[n] = 1;
+			dirty_nodes.emplace_back(n);
+		}
+	}
+
+	//children come after their parents, so going from the last node back refits children first:
+	std::sort(dirty_nodes.begin(), dirty_nodes.end(), std::greater< uint32_t >());
+	//(the cost changes only by the refitted nodes' terms, so it is updated from those rather than recomputed)
+	for (uint32_t n : dirty_nodes) {
+		Node &node = nodes[n];
+		weighted_area -= weighted(node);
+		if (node.count) {
+			node.min = box_min(boxes, node.first);
+			node.max = box_max(boxes, node.first);
+			for (uint32_t i = node.first + 1; i < node.first + node.count; ++i) {
+				node.min = glm::min(node.min, box_min(boxes, i));
+				node.max = glm::max(node.max, box_max(boxes, i));
+			}
+		} else {
+			node.min = glm::min(nodes[n + 1].min, nodes[node.first].min);
+			node.max = glm::max(nodes[n + 1].max, nodes[node.first].max);
+		}
+		weighted_area += weighted(node);
+		dirty[n] = 0;
+	}
+
+	uint32_t refitted = uint32_t(dirty_nodes.size());
+	dirty_nodes.clear();
+	current_cost = normalized(weighted_area, nodes[0], nodes.size());
+	return refitted;
+}
+
+float BVH::cost() const {
+	if (nodes.empty()) return 0.0f;
+	double total = 0.0;
+	for (Node const &node : nodes) {
+		total += weighted(node);
+	}
+	return normalized(total, nodes[0], nodes.size());
+}
+
+void BVH::cull(Frustum const &frustum, std::vector< uint32_t > *items) const {
+	assert(items);
+	if (nodes.empty()) return;
+
+	uint32_t stack[StackSize];
+	uint32_t top = 0;
+	stack[top++] = 0;
+	while (top) {
+		uint32_t n = stack[--top];
+		Node const &node = nodes[n];
+		Frustum::Side side = frustum.classify((node.min + node.max) * 0.5f, (node.max - node.min) * 0.5f);
+		if (side == Frustum::Outside) continue;
+
+		if (side == Frustum::Inside) {
+			//every item under this node, without further tests (they are contiguous in 'order'):
+			uint32_t first = n, last = n;
+			while (nodes[first].count == 0) first = first + 1;
+			while (nodes[last].count == 0) last = nodes[last].first;
+			items->insert(items->end(), order.begin() + nodes[first].first, order.begin() + nodes[last].first + nodes[last].count);
+		} else if (node.count) {
+			uint8_t visible[LeafSize];
+			frustum.cull(boxes, node.first, node.first + node.count, visible);
+			for (uint32_t i = 0; i < node.count; ++i) {
+				if (visible[i]) items->emplace_back(order[node.first + i]);
+			}
+		} else {
+			assert(top + 2 <= StackSize);
+			stack[top++] = node.first;
+			stack[top++] = n + 1;
+		}
+	}
+}
+
+bool BVH::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Hit *hit,
+	std::function< bool(uint32_t) > const &accept) const {
+	if (nodes.empty()) return false;
+
+	float best = max_t;
+	bool found = false;
+
+	//entry t of the ray into a box, or infinity if it misses (or only enters past 'best'):
+	// (an axis with a NaN slab -- origin on the face of a box, direction zero along it -- is ignored)
+	glm::vec3 inv_direction = glm::vec3(1.0f) / direction;
+	auto enter = [&](glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 t0 = (min - origin) * inv_direction;
+		glm::vec3 t1 = (max - origin) * inv_direction;
+		glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+		float t_in = std::max(std::max(std::max(0.0f, near.x), near.y), near.z);
+		float t_out = std::min(std::min(std::min(best, far.x), far.y), far.z);
+		return (t_in <= t_out ? t_in : std::numeric_limits< float >::infinity());
+	};
+
+	struct Entry {
+		uint32_t node;
+		float t;
+	} stack[StackSize];
+	uint32_t top = 0;
+	float t_root = enter(nodes[0].min, nodes[0].max);
+	if (t_root != std::numeric_limits< float >::infinity()) stack[top++] = Entry{0, t_root};
+
+	while (top) {
+		Entry entry = stack[--top];
+		if (entry.t > best) continue; //(something nearer was hit since this was pushed)
+		Node const &node = nodes[entry.node];
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				float t = enter(box_min(boxes, i), box_max(boxes, i));
+				if (t <= best && (!accept || accept(order[i]))) {
+					best = t;
+					found = true;
+					if (hit) *hit = Hit{order[i], t};
+				}
+			}
+		} else {
+			//visit the nearer child first (so it goes on the stack last):
+			Entry a{entry.node + 1, enter(nodes[entry.node + 1].min, nodes[entry.node + 1].max)};
+			Entry b{node.first, enter(nodes[node.first].min, nodes[node.first].max)};
+			if (b.t < a.t) std::swap(a, b);
+			assert(top + 2 <= StackSize);
+			if (b.t != std::numeric_limits< float >::infinity()) stack[top++] = b;
+			if (a.t != std::numeric_limits< float >::infinity()) stack[top++] = a;
+		}
+	}
+	return found;
+}
+
+void BVH::overlap(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *items) const {
+	assert(items);
+	if (nodes.empty()) return;
+
+	auto overlaps = [&](glm::vec3 const &box_min, glm::vec3 const &box_max) {
+		return box_min.x <= max.x && box_min.y <= max.y && box_min.z <= max.z
+		    && min.x <= box_max.x && min.y <= box_max.y && min.z <= box_max.z;
+	};
+
+	uint32_t stack[StackSize];
+	uint32_t top = 0;
+	stack[top++] = 0;
+	while (top) {
+		uint32_t n = stack[--top];
+		Node const &node = nodes[n];
+		if (!overlaps(node.min, node.max)) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (overlaps(box_min(boxes, i), box_max(boxes, i))) items->emplace_back(order[i]);
+			}
+		} else {
+			assert(top + 2 <= StackSize);
+			stack[top++] = node.first;
+			stack[top++] = n + 1;
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ * BVH is a bounding volume hierarchy over a set of world-space axis-aligned boxes ("items",
+ *  numbered 0 up to the number of boxes), for the queries that would otherwise test every box:
+ *  - cull() finds the items whose boxes touch a view frustum, rejecting (or accepting) whole
+ *    subtrees with one test;
+ *  - raycast() finds the nearest item box along a ray (e.g., for placing portals or checking
+ *    line of sight);
+ *  - overlap() finds the items whose boxes overlap a query box.
+ *
+ * build() splits items with the surface area heuristic, binning box centers along each axis,
+ *  down to leaves of at most LeafSize items.
+ * When items move, update() their boxes and then refit(), which recomputes only the nodes on the
+ *  paths from the moved items' leaves to the root. Refitting keeps the tree correct but lets it
+ *  get looser; needs_rebuild() says when its SAH cost has grown enough that build() is worth it.
+ *
+ * Nodes are stored depth-first, so a node's first child directly follows it and every child comes
+ *  after its parent; leaves' items are stored in the same order, so the four-at-a-time
+ *  Frustum::cull() can test a leaf's boxes together.
+ */
+
+#include "Frustum.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+struct BVH {
+	static constexpr uint32_t LeafSize = 4; //(one Frustum::cull() batch)
+	static constexpr uint32_t Bins = 16; //candidate split planes per axis are between bins
+	static constexpr float RebuildCost = 1.5f; //needs_rebuild() once cost() passes this times its cost when built
+
+	struct Node {
+		glm::vec3 min;
+		uint32_t first; //leaf: first item position in 'order'; inner: index of the second child (the first is this index + 1)
+		glm::vec3 max;
+		uint32_t count; //leaf: number of items (at least one); inner: 0
+	};
+	std::vector< Node > nodes; //(empty when there are no items)
+	std::vector< uint32_t > parents; //(parallel to nodes) -1U for the root
+
+	std::vector< uint32_t > order; //items, leaf by leaf
+	std::vector< uint32_t > positions; //(per item) its position in 'order'
+	std::vector< uint32_t > leaves; //(per item) the leaf node it is in
+	Frustum::Boxes boxes; //item boxes, in 'order' order
+
+	//make a new tree over 'items' (item i gets the box items[i]):
+	void build(Frustum::Boxes const &items);
+	//...over the same items, with their current boxes:
+	void rebuild();
+
+	//give an item a new box, then (after a batch of these) refit the tree to the new boxes:
+	void update(uint32_t item, glm::vec3 const &center, glm::vec3 const &extent);
+	uint32_t refit(); //returns the number of nodes recomputed
+
+	//SAH cost of the tree (expected nodes visited plus items tested by a random ray, roughly):
+	float cost() const;
+	bool needs_rebuild() const { return current_cost > RebuildCost * built_cost; }
+	float built_cost = 0.0f;
+	float current_cost = 0.0f; //(as of the last build() or refit())
+	double weighted_area = 0.0; //the sum cost() divides by the root's area; refit() updates it from the nodes it changes
+
+	//append the items whose boxes touch 'frustum' to 'items':
+	void cull(Frustum const &frustum, std::vector< uint32_t > *items) const;
+
+	//nearest item box hit by the ray origin + t * direction for 0 <= t <= max_t (boxes containing
+	// the origin are hit at t = 0); items for which 'accept' returns false are ignored:
+	struct Hit {
+		uint32_t item = -1U;
+		float t = 0.0f;
+	};
+	bool raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Hit *hit,
+		std::function< bool(uint32_t) > const &accept = nullptr) const;
+
+	//append the items whose boxes overlap the box from 'min' to 'max' to 'items':
+	void overlap(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *items) const;
+
+	//(scratch for refit)
+	std::vector< uint8_t > dirty; //(parallel to nodes)
+	std::vector< uint32_t > dirty_nodes;
+};
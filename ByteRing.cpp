@@ -0,0 +1,90 @@
+#include "ByteRing.hpp"
+
+#include <algorithm>
+
+void ByteRing::reserve(size_t size) {
+	if (size <= storage.size()) return;
+
+	size_t new_capacity = std::max< size_t >(storage.size(), 256);
+	while (new_capacity < size) new_capacity *= 2;
+
+	//copy contents into new storage, un-wrapped:
+	std::vector< char > new_storage(new_capacity);
+	copy_out(0, new_storage.data(), count);
+	storage.swap(new_storage);
+	head = 0;
+}
+
+void ByteRing::append(void const *data_, size_t size) {
+	char const *data = reinterpret_cast< char const * >(data_);
+	reserve(count + size);
+
+	size_t mask = storage.size() - 1;
+	size_t tail = (head + count) & mask;
+	size_t first = std::min(size, storage.size() - tail);
+	std::memcpy(storage.data() + tail, data, first);
+	std::memcpy(storage.data(), data + first, size - first);
+	count += size;
+}
+
+uint32_t ByteRing::free_spans(size_t min_free, Span spans[2]) {
+	reserve(count + min_free);
+
+	size_t mask = storage.size() - 1;
+	size_t tail = (head + count) & mask;
+	size_t free = storage.size() - count;
+
+	spans[0].data = storage.data() + tail;
+	spans[0].size = std::min(free, storage.size() - tail);
+	if (spans[0].size == free) return 1;
+	spans[1].data = storage.data();
+	spans[1].size = free - spans[0].size;
+	return 2;
+}
+
+void ByteRing::commit(size_t written) {
+	assert(count + written <= storage.size());
+	count += written;
+}
+
+void ByteRing::copy_out(size_t offset, void *to_, size_t size) const {
+	assert(offset + size <= count);
+	if (size == 0) return;
+	char *to = reinterpret_cast< char * >(to_);
+
+	size_t mask = storage.size() - 1;
+	size_t begin = (head + offset) & mask;
+	size_t first = std::min(size, storage.size() - begin);
+	std::memcpy(to, storage.data() + begin, first);
+	std::memcpy(to + first, storage.data(), size - first);
+}
+
+char const *ByteRing::contiguous(size_t size) {
+	assert(size <= count);
+	if (head + size > storage.size()) {
+		//requested range wraps: rotate storage so contents start at index zero.
+		std::rotate(storage.begin(), storage.begin() + head, storage.end());
+		head = 0;
+	}
+	return storage.data() + head;
+}
+
+uint32_t ByteRing::data_spans(ConstSpan spans[2]) const {
+	if (count == 0) return 0;
+	spans[0].data = storage.data() + head;
+	spans[0].size = std::min(count, storage.size() - head);
+	if (spans[0].size == count) return 1;
+	spans[1].data = storage.data();
+	spans[1].size = count - spans[0].size;
+	return 2;
+}
+
+void ByteRing::consume(size_t size) {
+	assert(size <= count);
+	count -= size;
+	if (count == 0) {
+		head = 0; //keeps future appends un-wrapped as long as possible
+	} else {
+		head = (head + size) & (storage.size() - 1);
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+ * ByteRing is a growable ring buffer of bytes.
+ * It is used for Connection's send and receive buffers so that consuming
+ *  data from the front is O(1) rather than a memmove of the whole backlog.
+ *
+ * Appending works like a std::vector (amortized growth).
+ * Contents may wrap around the end of storage, so they are exposed either:
+ *  - as (up to) two spans, for gather/scatter socket calls, or
+ *  - through contiguous(), which returns a pointer to the first 'count' bytes,
+ *    un-wrapping the storage in the (rare) case that they straddle the end.
+ */
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+struct ByteRing {
+	struct Span {
+		char *data = nullptr;
+		size_t size = 0;
+	};
+	struct ConstSpan {
+		char const *data = nullptr;
+		size_t size = 0;
+	};
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t capacity() const { return storage.size(); }
+
+	void clear() { head = 0; count = 0; }
+
+	//--- appending ---
+	void append(void const *data, size_t size);
+	void push_back(char c) { append(&c, 1); }
+
+	//append via scatter: make sure there is room for at least 'min_free' more bytes,
+	// fill 'spans' with the free space, and call commit() with the number of bytes actually written:
+	// (returns the number of spans used -- one or two)
+	uint32_t free_spans(size_t min_free, Span spans[2]);
+	void commit(size_t written);
+
+	//--- reading ---
+	char operator[](size_t i) const { assert(i < count); return storage[(head + i) & (storage.size() - 1)]; }
+
+	//copy 'size' bytes starting at 'offset' from the front:
+	void copy_out(size_t offset, void *to, size_t size) const;
+
+	//read view: pointer to the first 'size' bytes, valid until the ring is next modified:
+	char const *contiguous(size_t size);
+
+	//gather: fill 'spans' with the current contents; returns the number of spans used (zero, one, or two):
+	uint32_t data_spans(ConstSpan spans[2]) const;
+
+	//--- consuming ---
+	//drop 'size' bytes from the front (O(1)):
+	void consume(size_t size);
+
+	//internals:
+	std::vector< char > storage; //size is always zero or a power of two
+	size_t head = 0; //index of first byte in storage
+	size_t count = 0; //number of bytes stored
+
+	void reserve(size_t size);
+};
@@ -1,24 +1,17 @@
 #include "CharacterController.hpp"
 
+#include <chrono>
+
 CharacterController::CharacterController(Scene::Transform* character_, Scene::Camera* camera_) : 
 	character(character_), camera(camera_), 
-	velocity(glm::vec3(0.0f)), current_angle(0.0f), target_angle(0.0f)
+	collision_map(data_path("map/collision.map")),
+	ground(data_path("map/heightmap.map"))
 { 
-	// load heightmap and collisionmap
-	std::ifstream collision_in(data_path("map/collision.txt"));
-	int count = 0;
-	std::string irrelevant;
-	while(collision_in >> irrelevant) {
-		assert(count < 2048 * 2048);
-		collision_map[count] = (float)::atof(irrelevant.c_str());
-		count++;
-	}
-	assert(count == 2048*2048);
-
 	character->position = glm::vec3(0, 0, 0);
 }
 
 void CharacterController::UpdateCharacter(glm::vec2 movement, float elapsed) {
+	glm::vec2 direction = glm::vec2(0.0f);
 	if (movement != glm::vec2(0.0f)) {
 		//normalize movement
 		glm::vec2 move = glm::normalize(movement);
@@ -28,80 +21,56 @@ void CharacterController::UpdateCharacter(glm::vec2 movement, float elapsed) {
 		glm::vec3 right = frame[0];
 		glm::vec3 forward = -frame[2];
 		forward = glm::normalize(glm::vec3(forward.x, forward.y, 0.0f));
-		glm::vec3 direction = move.x * right + move.y * forward;
+		glm::vec3 world = move.x * right + move.y * forward;
 
 		//clear z component
-		direction.z = 0.0f;
-
-		//update velocity
-		velocity += direction * acceleration * elapsed;
-		if (glm::length(velocity) > walking_speed_max) {
-			velocity = walking_speed_max * glm::normalize(velocity);
-		}
-		
-		//update target angle
-		target_angle = glm::degrees(glm::atan(velocity.y, velocity.x)) - 90.0f;
+		direction = glm::vec2(world.x, world.y);
 	}
-	//decrease velocity using damping
-	else {
-		if (velocity != glm::vec3(0.0f)) {
-			glm::vec3 DampedVelocity = velocity - glm::normalize(velocity) * damp * elapsed;
-
-			// make sure damping does not change the direction
-			if ((velocity.x > 0 && DampedVelocity.x < 0) || (velocity.x < 0 && DampedVelocity.x > 0))
-				DampedVelocity.x = 0.0f;
-			if ((velocity.y > 0 && DampedVelocity.y < 0) || (velocity.y < 0 && DampedVelocity.y > 0))
-				DampedVelocity.y = 0.0f;
 
-			velocity = DampedVelocity;
-		}
-	}
+	//the transform may have been moved since last frame (e.g. by teleporting or overlap fixing):
+	predictor.state.position += character->position - placed_position;
 
-	//update current angle
-	target_angle = std::fmod(target_angle + 360.0f, 360.0f);
-	if (target_angle > current_angle) {
-		if (target_angle - current_angle < 180.0f) {
-			current_angle = std::min(current_angle + angle_speed * elapsed, target_angle);
-		}
-		else {
-			current_angle = std::max(current_angle - angle_speed * elapsed, target_angle - 360.0f);
-		}
-	}
-	else {
-		if (current_angle - target_angle < 180.0f) {
-			current_angle = std::max(current_angle - angle_speed * elapsed, target_angle);
-		}
-		else {
-			current_angle = std::min(current_angle + angle_speed * elapsed, target_angle + 360.0f);
-		}
+	//step at the same fixed rate as the server simulates:
+	uint32_t time_ms = uint32_t(std::chrono::duration_cast< std::chrono::milliseconds >(std::chrono::steady_clock::now().time_since_epoch()).count());
+	step_remainder += elapsed;
+	while (step_remainder >= MovementStep) {
+		step_remainder -= MovementStep;
+		predictor.step(direction, next_flags, time_ms, &collision_map);
+		next_flags = 0;
 	}
-	current_angle = std::fmod(current_angle + 360.0f, 360.0f);
-	
 
-	//update position
-	glm::vec3 old_position = character->position;
-	character->position += velocity * elapsed;
-
-	// map -20 to 20 to 0 to 2048
-	// why is it -20 to 20? Not quite sure, it may be something to do with the scaling in blender
-	// but -20 to 20 seems to work fine
-	unsigned coord_x = unsigned(((character->position.x + 20.0f)/40.0f) * 2048.0f);
-	unsigned coord_y = unsigned(((character->position.y + 20.0f)/40.0f) * 2048.0f);
-	float coll = 1.0f;
-	if(coord_x * 2048 + (2048-coord_y) >=0 && coord_x * 2048 + (2048-coord_y) < collision_map.size())
-		coll = collision_map[coord_x * 2048 + (2048-coord_y)];
-	
-	//std::cerr << character->position.x << " " << character->position.y << " " << coll << std::endl;
-	
-	if (coll < 0.95f) {
-		character->position = old_position;
-	}
-	//update player orientation
-	character->rotation = glm::angleAxis(glm::radians(current_angle), glm::vec3(0.0f, 0.0f, 1.0f));
+	predictor.update_correction(elapsed);
+	Place();
 
 	// start char at different position to not get stuck in map
 /*	if (!done) {
 		character->position = glm::vec3(1, 0, 0);
 		done = true;
 	}*/
-} 
\ No newline at end of file
+}
+
+void CharacterController::Teleport(uint8_t flag) {
+	next_flags |= flag;
+}
+
+void CharacterController::PlacePortal(uint8_t flag) {
+	next_flags |= flag;
+}
+
+void CharacterController::Reconcile(uint32_t last_input, Movement_State const &server_state) {
+	//(keep anything that moved the transform since the last update, as UpdateCharacter would)
+	predictor.state.position += character->position - placed_position;
+	float error = predictor.reconcile(last_input, server_state, &collision_map);
+	if (error > Movement_Predictor::SnapDistance) {
+		std::cout << "Prediction was off by " << error << ", snapping to server position." << std::endl;
+	}
+	Place();
+}
+
+void CharacterController::Place() {
+	placed_position = predictor.displayed_position();
+	// stand on the terrain (height isn't simulated; it's wherever the ground is under us)
+	placed_position.z = ground.height(glm::vec2(placed_position.x, placed_position.y));
+	character->position = placed_position;
+	character->rotation = predictor.state.rotation();
+}
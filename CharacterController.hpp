@@ -1,14 +1,14 @@
 #pragma once
 
 #include "Scene.hpp"
+#include "Movement.hpp"
+#include "HeightMap.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/glm.hpp>
 #include <iostream>
 #include <cmath>
 #include <math.h>
-#include <array>
-#include <fstream>
 #include "data_path.hpp"
 
 // // to make it easier to print vec3s
@@ -20,22 +20,35 @@
 class CharacterController {
 public:
 	CharacterController(Scene::Transform* character_, Scene::Camera* camera_);
+	// walk in fixed MovementStep steps (same rules as the server); each step's input is kept in predictor.pending
 	void UpdateCharacter(glm::vec2 movement, float elapsed);
-	
+	// the next input steps through a portal (flag is Movement_Input::TeleportToPortal1 or 2)
+	void Teleport(uint8_t flag);
+	// the next input places a portal where we stand (flag is Movement_Input::PlacePortal1 or 2)
+	void PlacePortal(uint8_t flag);
+	// the server simulated our inputs up to 'last_input' and ended up in 'server_state': correct our prediction
+	void Reconcile(uint32_t last_input, Movement_State const &server_state);
 
 	Scene::Transform* character;
 	Scene::Camera* camera;
+	// walls we walk into (PlayMode's CollisionSystem keeps players out of them too)
+	CollisionMap collision_map;
+	// terrain we walk on
+	HeightMap ground;
+
+	// prediction of our own movement (its pending inputs are what we send to the server)
+	Movement_Predictor predictor;
+	// inputs up to here have been sent at least once
+	uint32_t sent_sequence = 0;
 
 private:
-	glm::vec3 velocity;
-	float acceleration = 10.0f;
-	float damp = 20.0f;
-	float walking_speed_max = 2.0f;
+	// write the predicted pose to the character's transform
+	void Place();
 
-	float current_angle;
-	float target_angle;
-	float angle_speed = 720.0f;
+	float step_remainder = 0.0f;
+	uint8_t next_flags = 0;
+	// position last written to the character, to notice when something else moved it
+	glm::vec3 placed_position = glm::vec3(0.0f);
 	[[maybe_unused]]
 	bool done = false;
-	std::array<float, 2048*2048> collision_map;
-};
\ No newline at end of file
+};
@@ -0,0 +1,252 @@
+#include "CollisionMap.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <cassert>
+
+CollisionMap::CollisionMap(std::string const &filename) : mapping(filename, "collision map") {
+	size_t header_size = 0;
+	char const *header = mapping.find_chunk("cmh1", &header_size);
+	if (!header || header_size != 16) throw std::runtime_error("Collision map '" + filename + "' has no header chunk (re-run tocollision.py?).");
+	uint32_t tile_size, distance_scale;
+	std::memcpy(&size, header, 4);
+	std::memcpy(&extent, header + 4, 4);
+	std::memcpy(&tile_size, header + 8, 4);
+	std::memcpy(&distance_scale, header + 12, 4);
+	if (tile_size != TileSize || size % TileSize != 0) throw std::runtime_error("Collision map '" + filename + "' has " + std::to_string(tile_size) + "-cell tiles over " + std::to_string(size) + " cells, expected " + std::to_string(TileSize) + "-cell tiles.");
+	tiles_per_row = size / TileSize;
+
+	size_t tiles_size = 0;
+	char const *tiles_data = mapping.find_chunk("cmt0", &tiles_size);
+	if (!tiles_data || tiles_size != size_t(tiles_per_row) * tiles_per_row * sizeof(uint64_t)) throw std::runtime_error("Collision map '" + filename + "' doesn't have " + std::to_string(size) + "x" + std::to_string(size) + " cells.");
+	//(the tiles start 8-byte aligned, since the header chunk is 24 bytes and the tile chunk's header 8)
+	if (reinterpret_cast< uintptr_t >(tiles_data) % alignof(uint64_t) != 0) throw std::runtime_error("Collision map '" + filename + "' has misaligned tiles.");
+	tiles = reinterpret_cast< uint64_t const * >(tiles_data);
+
+	size_t distances_size = 0;
+	char const *distances_data = mapping.find_chunk("cmd0", &distances_size);
+	if (!distances_data || distance_scale != uint32_t(DistanceScale)) throw std::runtime_error("Collision map '" + filename + "' has no distance field at " + std::to_string(uint32_t(DistanceScale)) + " units per cell (re-run tocollision.py?).");
+	if (distances_size != size_t(size) * size * sizeof(int16_t)) throw std::runtime_error("Collision map '" + filename + "' doesn't have a distance for each of its " + std::to_string(size) + "x" + std::to_string(size) + " cells.");
+	//(the distances follow the tiles and another 8-byte chunk header, so they are aligned too)
+	if (reinterpret_cast< uintptr_t >(distances_data) % alignof(int16_t) != 0) throw std::runtime_error("Collision map '" + filename + "' has misaligned distances.");
+	distances = reinterpret_cast< int16_t const * >(distances_data);
+}
+
+//run body(begin, end) on [0, count), split into contiguous ranges over the hardware threads:
+template< typename Body >
+static void parallel_for(uint32_t count, Body const &body) {
+	uint32_t threads = std::max(1U, std::min(std::thread::hardware_concurrency(), 16U));
+	threads = std::min(threads, count);
+	if (threads <= 1) {
+		body(0, count);
+		return;
+	}
+	std::vector< std::thread > workers;
+	workers.reserve(threads - 1);
+	for (uint32_t t = 1; t < threads; ++t) {
+		workers.emplace_back([&body, count, threads, t]() {
+			body(count * t / threads, count * (t + 1) / threads);
+		});
+	}
+	body(0, count / threads);
+	for (auto &worker : workers) worker.join();
+}
+
+//lower envelope of parabolas (Felzenszwalb & Huttenlocher's 1D squared distance transform):
+// d[q] = min over p of (q - p)^2 + f[p]; infinite entries of 'f' are not features.
+// 'v' and 'z' are scratch space for n and n+1 entries.
+static void squared_distance_1d(float const *f, float *d, uint32_t n, float *v, float *z) {
+	constexpr float Inf = std::numeric_limits< float >::infinity();
+	int32_t k = -1;
+	for (uint32_t q = 0; q < n; ++q) {
+		if (f[q] == Inf) continue;
+		float fq = f[q] + float(q) * float(q);
+		//pop parabolas that the new one hides completely:
+		// (intersection s = numerator / denominator, compared without dividing since denominator > 0)
+		float numerator = 0.0f, denominator = 1.0f;
+		while (k >= 0) {
+			float p = v[k];
+			numerator = fq - (f[uint32_t(p)] + p * p);
+			denominator = 2.0f * (float(q) - p);
+			if (numerator > z[k] * denominator) break;
+			k -= 1;
+		}
+		k += 1;
+		v[k] = float(q);
+		z[k] = (k == 0 ? -Inf : numerator / denominator);
+		z[k + 1] = Inf;
+	}
+	if (k < 0) {
+		std::fill(d, d + n, Inf);
+		return;
+	}
+	k = 0;
+	for (uint32_t q = 0; q < n; ++q) {
+		while (z[k + 1] < float(q)) k += 1;
+		float delta = float(q) - v[k];
+		d[q] = delta * delta + f[uint32_t(v[k])];
+	}
+}
+
+void CollisionMap::build_distance_field(std::vector< int16_t > *out) const {
+	assert(out);
+	constexpr float Inf = std::numeric_limits< float >::infinity();
+	uint32_t const n = size;
+
+	//squared distance along each row to the nearest wall cell ([0]) and to the nearest open cell ([1]):
+	std::vector< float > rows[2];
+	rows[0].resize(size_t(n) * n);
+	rows[1].resize(size_t(n) * n);
+	parallel_for(n, [&](uint32_t begin, uint32_t end) {
+		std::vector< uint8_t > walls(n);
+		for (uint32_t y = begin; y < end; ++y) {
+			for (uint32_t x = 0; x < n; ++x) walls[x] = blocked_cell(glm::ivec2(x, y));
+			float *to_wall = rows[0].data() + size_t(y) * n;
+			float *to_open = rows[1].data() + size_t(y) * n;
+			//forward and then backward scan for the nearest of each on either side:
+			float wall_run = Inf, open_run = Inf;
+			for (uint32_t x = 0; x < n; ++x) {
+				wall_run = (walls[x] ? 0.0f : wall_run + 1.0f);
+				open_run = (walls[x] ? open_run + 1.0f : 0.0f);
+				to_wall[x] = wall_run;
+				to_open[x] = open_run;
+			}
+			wall_run = open_run = Inf;
+			for (uint32_t x = n; x > 0; --x) {
+				wall_run = (walls[x - 1] ? 0.0f : wall_run + 1.0f);
+				open_run = (walls[x - 1] ? open_run + 1.0f : 0.0f);
+				float w = std::min(to_wall[x - 1], wall_run);
+				float o = std::min(to_open[x - 1], open_run);
+				to_wall[x - 1] = w * w;
+				to_open[x - 1] = o * o;
+			}
+		}
+	});
+
+	//then the parabola envelope down each column, a cache line's worth of columns at a time:
+	constexpr uint32_t Columns = 16;
+	std::vector< int16_t > &field = *out;
+	field.resize(size_t(n) * n);
+	uint32_t const groups = (n + Columns - 1) / Columns;
+	parallel_for(groups, [&](uint32_t begin, uint32_t end) {
+		std::vector< float > column(size_t(Columns) * n), squared[2];
+		squared[0].resize(size_t(Columns) * n);
+		squared[1].resize(size_t(Columns) * n);
+		std::vector< float > v(n);
+		std::vector< float > z(n + 1);
+		for (uint32_t group = begin; group < end; ++group) {
+			uint32_t x0 = group * Columns;
+			uint32_t width = std::min(Columns, n - x0);
+			for (uint32_t which = 0; which < 2; ++which) {
+				for (uint32_t y = 0; y < n; ++y) {
+					float const *row = rows[which].data() + size_t(y) * n + x0;
+					for (uint32_t c = 0; c < width; ++c) column[size_t(c) * n + y] = row[c];
+				}
+				for (uint32_t c = 0; c < width; ++c) {
+					squared_distance_1d(column.data() + size_t(c) * n, squared[which].data() + size_t(c) * n, n, v.data(), z.data());
+				}
+			}
+			//cell centers are half a cell from the edge of the nearest wall (or opening):
+			constexpr float Limit = float(std::numeric_limits< int16_t >::max()) / DistanceScale;
+			for (uint32_t y = 0; y < n; ++y) {
+				for (uint32_t c = 0; c < width; ++c) {
+					float to_wall = squared[0][size_t(c) * n + y];
+					float to_open = squared[1][size_t(c) * n + y];
+					float d = (to_wall == 0.0f ? 0.5f - std::sqrt(to_open) : std::sqrt(to_wall) - 0.5f);
+					d = std::max(-Limit, std::min(Limit, d));
+					field[size_t(y) * n + x0 + c] = int16_t(std::lround(d * DistanceScale));
+				}
+			}
+		}
+	});
+}
+
+float CollisionMap::distance(glm::vec2 const &position, glm::vec2 *normal) const {
+	//bilinear between cell centers, clamped to the map:
+	float scale = float(size) / (2.0f * extent);
+	float max = float(size - 1);
+	float ax = std::max(0.0f, std::min(max, (position.x + extent) * scale - 0.5f));
+	float ay = std::max(0.0f, std::min(max, (position.y + extent) * scale - 0.5f));
+	uint32_t x = std::min(uint32_t(ax), size - 2);
+	uint32_t y = std::min(uint32_t(ay), size - 2);
+	float fx = ax - float(x);
+	float fy = ay - float(y);
+
+	int16_t const *at = distances + size_t(y) * size + x;
+	float d00 = at[0], d10 = at[1], d01 = at[size], d11 = at[size + 1];
+	float d0 = d00 + (d10 - d00) * fx;
+	float d1 = d01 + (d11 - d01) * fx;
+
+	if (normal) {
+		glm::vec2 gradient = glm::vec2(d10 - d00 + (d11 - d01 - d10 + d00) * fy, d1 - d0);
+		float length = glm::length(gradient);
+		*normal = (length > 0.0f ? gradient / length : glm::vec2(0.0f));
+	}
+	return (d0 + (d1 - d0) * fy) / (DistanceScale * scale);
+}
+
+glm::ivec2 CollisionMap::cell(glm::vec2 const &position) const {
+	float scale = float(size) / (2.0f * extent);
+	return glm::ivec2(int32_t(std::floor((position.x + extent) * scale)), int32_t(std::floor((position.y + extent) * scale)));
+}
+
+bool CollisionMap::sweep(glm::vec2 const &from, glm::vec2 const &to, Hit *hit) const {
+	//work in cell units:
+	float scale = float(size) / (2.0f * extent);
+	glm::vec2 a = (from + glm::vec2(extent)) * scale;
+	glm::vec2 b = (to + glm::vec2(extent)) * scale;
+	glm::vec2 d = b - a;
+
+	glm::ivec2 at = glm::ivec2(int32_t(std::floor(a.x)), int32_t(std::floor(a.y)));
+	glm::ivec2 end = glm::ivec2(int32_t(std::floor(b.x)), int32_t(std::floor(b.y)));
+	glm::ivec2 step = glm::ivec2((d.x > 0.0f) - (d.x < 0.0f), (d.y > 0.0f) - (d.y < 0.0f));
+
+	//parametric distance to the next cell boundary on each axis, and between boundaries:
+	constexpr float Never = std::numeric_limits< float >::infinity();
+	float next_x = (step.x > 0 ? (float(at.x + 1) - a.x) / d.x : (step.x < 0 ? (a.x - float(at.x)) / -d.x : Never));
+	float next_y = (step.y > 0 ? (float(at.y + 1) - a.y) / d.y : (step.y < 0 ? (a.y - float(at.y)) / -d.y : Never));
+	float delta_x = (step.x != 0 ? 1.0f / std::abs(d.x) : Never);
+	float delta_y = (step.y != 0 ? 1.0f / std::abs(d.y) : Never);
+
+	auto report = [&](glm::ivec2 const &cell, glm::vec2 const &normal, float t) {
+		hit->cell = cell;
+		hit->normal = normal;
+		hit->t = std::min(t, 1.0f);
+		return true;
+	};
+
+	//(each step moves at least one cell along one axis, so this bounds the walk even if rounding misbehaves)
+	int32_t steps = std::abs(end.x - at.x) + std::abs(end.y - at.y);
+	while (steps > 0) {
+		if (next_x < next_y) {
+			at.x += step.x;
+			if (blocked_cell(at)) return report(at, glm::vec2(-float(step.x), 0.0f), next_x);
+			next_x += delta_x;
+			steps -= 1;
+		} else if (next_y < next_x) {
+			at.y += step.y;
+			if (blocked_cell(at)) return report(at, glm::vec2(0.0f, -float(step.y)), next_y);
+			next_y += delta_y;
+			steps -= 1;
+		} else {
+			//exactly through a corner: the segment touches both cells beside it too
+			glm::ivec2 side_x = glm::ivec2(at.x + step.x, at.y);
+			glm::ivec2 side_y = glm::ivec2(at.x, at.y + step.y);
+			bool blocked_x = blocked_cell(side_x);
+			bool blocked_y = blocked_cell(side_y);
+			if (blocked_x && blocked_y) return report(side_x, glm::normalize(glm::vec2(-float(step.x), -float(step.y))), next_x);
+			if (blocked_x) return report(side_x, glm::vec2(-float(step.x), 0.0f), next_x);
+			if (blocked_y) return report(side_y, glm::vec2(0.0f, -float(step.y)), next_y);
+			at += step;
+			if (blocked_cell(at)) return report(at, glm::normalize(glm::vec2(-float(step.x), -float(step.y))), next_x);
+			next_x += delta_x;
+			next_y += delta_y;
+			steps -= 2;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * CollisionMap is the walkable-area grid that player movement is blocked by.
+ * It has size x size cells covering [-extent, extent] on x and y, one bit each (set for walls).
+ *
+ * Cells are stored in TileSize x TileSize tiles, each one uint64 (bit y*TileSize + x),
+ *  so nearby cells -- everything a movement sweep touches -- share a cache line.
+ *
+ * The map is built offline by dist/map/tocollision.py and memory-mapped read-only here,
+ *  so loading it costs no parsing and its pages are shared by every process using it.
+ *
+ * The map also carries a signed distance field (baked by the same script, an exact Euclidean
+ *  distance transform), so clearance for a round body and the direction out of the nearest
+ *  wall each cost one bilinear sample. build_distance_field() computes the same field from
+ *  the cells, in parallel over rows and then columns, for checking a baked one.
+ *
+ * It has no GL or Scene dependencies, so the server loads the same map as the client.
+ */
+
+#include "MappedFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct CollisionMap {
+	static constexpr uint32_t TileSize = 8;
+
+	//map a file written by tocollision.py:
+	// (throws std::runtime_error if the file is missing or malformed)
+	explicit CollisionMap(std::string const &filename);
+
+	//is 'position' inside a wall? (positions off the map are never blocked)
+	bool blocked(glm::vec2 const &position) const { return blocked_cell(cell(position)); }
+
+	//cell containing 'position' (may be off the map):
+	glm::ivec2 cell(glm::vec2 const &position) const;
+	bool blocked_cell(glm::ivec2 const &cell) const {
+		if (cell.x < 0 || cell.y < 0 || uint32_t(cell.x) >= size || uint32_t(cell.y) >= size) return false;
+		uint64_t tile = tiles[(uint32_t(cell.y) / TileSize) * tiles_per_row + uint32_t(cell.x) / TileSize];
+		return (tile >> ((uint32_t(cell.y) % TileSize) * TileSize + uint32_t(cell.x) % TileSize)) & 1;
+	}
+
+	//first wall cell along the segment from 'from' to 'to':
+	struct Hit {
+		glm::ivec2 cell;
+		glm::vec2 normal; //of the wall face the segment entered through
+		float t; //fraction of the way from 'from' to 'to'
+	};
+	//walks every cell the segment touches (a "supercover" DDA), except the one it starts in;
+	// returns false if none of them are walls:
+	bool sweep(glm::vec2 const &from, glm::vec2 const &to, Hit *hit) const;
+
+	//signed distance from 'position' to the nearest wall edge, in world units
+	// (positive in the open, negative inside walls; positions off the map see the nearest edge cell):
+	float distance(glm::vec2 const &position) const { return distance(position, nullptr); }
+	//...and also the direction of steepest increase -- away from the nearest wall -- in 'normal' (unit length, or zero on a plateau):
+	float distance(glm::vec2 const &position, glm::vec2 *normal) const;
+	//can a circle of 'radius' stand at 'position' without overlapping a wall?
+	bool clear(glm::vec2 const &position, float radius) const { return distance(position) >= radius; }
+
+	uint32_t size = 0;
+	float extent = 0.0f;
+	uint32_t tiles_per_row = 0;
+	uint64_t const *tiles = nullptr;
+
+	//signed distance at each cell center (row-major), in 1/DistanceScale cells, clamped to what fits in int16:
+	static constexpr float DistanceScale = 16.0f;
+	int16_t const *distances = nullptr;
+	//compute the field from the cells (as tocollision.py does) into 'out':
+	void build_distance_field(std::vector< int16_t > *out) const;
+
+	//the file 'tiles' and 'distances' point into:
+	MappedFile mapping;
+};
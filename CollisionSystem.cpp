@@ -1,66 +1,73 @@
 #include "CollisionSystem.hpp"
 
-void CollisionSystem::Collidable::FixOverLap() {
-	for (int i = 0; i < system->elements.size(); i++) {
-		Collidable* other = system->elements[i];
-		if (this == system->elements[i] || !other->parent->draw)
-			continue;
+#include <algorithm>
 
-		glm::vec3 diff_vec = parent->position - other->parent->position;
-		float distance = length(diff_vec) - radius - other->radius;
+void CollisionSystem::AddElement(Collidable* element) {
+	element->index = uint32_t(elements.size());
+	elements.push_back(element);
+	hash.update(element->index, element->parent->position);
+}
 
-		if (distance < 0) {
-			//reset ball position
-			glm::vec3 diff_pos = (-distance) * glm::normalize(diff_vec);
-			parent->position += diff_pos;
-		}
-		
+void CollisionSystem::Update() {
+	for (auto element : elements) {
+		hash.update(element->index, element->parent->position);
 	}
 }
 
+void CollisionSystem::Collidable::FixOverLap() {
+	// everyone else is where the server put them, so only this collidable gets pushed (out of them, and out of the walls)
+	CollisionWorld &world = system->world;
+	world.clear();
+	uint32_t self = 0;
+	for (auto other : system->elements) {
+		if (other != this && !other->parent->draw)
+			continue;
+		uint32_t i = world.add(glm::vec2(other->parent->position.x, other->parent->position.y), other->radius, other == this ? 1.0f : 0.0f);
+		if (other == this) self = i;
+	}
+	world.resolve(CollisionWorld::DefaultIterations, system->map);
 
-int CollisionSystem::CheckOverLap(int CollidableID, float attackDegree, float attackRadius) {
-	float minDistance = attackRadius;
-	int target = 0;
+	parent->position.x = world.x[self];
+	parent->position.y = world.y[self];
+	system->hash.update(index, parent->position);
+}
+
+
+void CollisionSystem::QueryCone(int CollidableID, float attackDegree, float attackRadius) {
 	Collidable* current = elements[CollidableID - 1];
 	glm::mat4x3 frame = current->parent->make_local_to_parent();
 	glm::vec3 forward = glm::normalize(frame[1]);
 
 	//std::cout << forward.x << " " << forward.y << " " << forward.z << std::endl;
-	
-	for (int i = 0; i < elements.size(); i++) {
+
+	// candidates from the broadphase, tested against the cone worked out once, nearest first (ties by index)
+	hits.clear();
+	hash.query_cone(AttackCone(current->parent->position, forward, attackDegree, attackRadius), &hits);
+}
+
+int CollisionSystem::CheckOverLap(int CollidableID, float attackDegree, float attackRadius) {
+	QueryCone(CollidableID, attackDegree, attackRadius);
+	Collidable* current = elements[CollidableID - 1];
+	for (auto const &hit : hits) {
 		//get the other collider
-		Collidable* other = elements[i];
+		Collidable* other = elements[hit.id];
 
 		//skip self and inactive colliders
 		if (current == other || !other->parent->draw)
 			continue;
 
-		//calculate distance
-		glm::vec3 diff_vec = other->parent->position - current->parent->position;
-		float distance = length(diff_vec);
-
-		//skip out of range colliders
-		if (distance > attackRadius)
-			continue;
-
-		//calculate angle
-		diff_vec = glm::normalize(diff_vec);
-		float angle = glm::degrees(glm::acos(glm::dot(diff_vec, forward)));
+		return hit.id + 1;
+	}
+	return 0;
+}
 
-		//skip out of degree colliders
-		if (angle > attackDegree * 0.5f)
+void CollisionSystem::CheckOverLapAll(int CollidableID, float attackDegree, float attackRadius, std::vector<int>* targets) {
+	QueryCone(CollidableID, attackDegree, attackRadius);
+	Collidable* current = elements[CollidableID - 1];
+	for (auto const &hit : hits) {
+		Collidable* other = elements[hit.id];
+		if (current == other || !other->parent->draw)
 			continue;
-
-		if (distance < minDistance) {
-			minDistance = distance;
-			target = i + 1;
-		}
-
-		//std::cout << diff_vec.x << " " << diff_vec.y << " " << diff_vec.z << std::endl;
-		//std::cout << "" << angle << std::endl;		
-
+		targets->push_back(hit.id + 1);
 	}
-
-	return target;
-}
\ No newline at end of file
+}
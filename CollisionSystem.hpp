@@ -1,6 +1,10 @@
 #pragma once
 
 #include "Scene.hpp"
+#include "Combat.hpp"
+#include "CollisionMap.hpp"
+#include "SpatialHash.hpp"
+#include "CollisionWorld.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/glm.hpp>
@@ -16,13 +20,32 @@ public:
 		CollisionSystem* system;
 		Scene::Transform* parent;
 		float radius;
+		uint32_t index = 0; // in system->elements (and its id in system->hash)
 	};
 
-	CollisionSystem() {}
-	void AddElement(Collidable* element) { elements.push_back(element); }
+	// cells of the broadphase for attack queries
+	static constexpr float CellSize = 1.0f;
+
+	//(if 'map' is given, collidables are also kept out of its walls)
+	CollisionSystem(CollisionMap const *map_ = nullptr) : map(map_), hash(CellSize) {}
+	void AddElement(Collidable* element);
+	// refresh the broadphase from the collidables' transforms (once a frame, before the queries below)
+	void Update();
 	void FixOverLap(int CollidableID) { elements[CollidableID - 1]->FixOverLap(); }
+	// the nearest other collidable in the attack cone (0 for nobody)
 	int CheckOverLap(int CollidableID, float attackDegree, float attackRadius);
+	// all of them, nearest first (appended to targets)
+	void CheckOverLapAll(int CollidableID, float attackDegree, float attackRadius, std::vector<int>* targets);
 
 	std::vector<Collidable*> elements;
+	CollisionMap const *map;
+	// where the collidables are, for finding the ones near a query without checking them all
+	SpatialHash hash;
+	// scratch space for query results
+	std::vector<ConeHit> hits;
+	// fill hits with everything in the attack cone of CollidableID (including itself), nearest first
+	void QueryCone(int CollidableID, float attackDegree, float attackRadius);
+	// the collidables as a flat array of circles, for resolving overlaps (rebuilt by each FixOverLap)
+	CollisionWorld world;
 	  
 };
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "CollisionWorld.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+//how far from a wall a push that would cross it stops:
+static constexpr float WallSkin = 1e-3f;
+
+void CollisionWorld::clear() {
+	x.clear();
+	y.clear();
+	radius.clear();
+	weight.clear();
+}
+
+uint32_t CollisionWorld::add(glm::vec2 const &position, float radius_, float weight_) {
+	x.emplace_back(position.x);
+	y.emplace_back(position.y);
+	radius.emplace_back(radius_);
+	weight.emplace_back(weight_);
+	return uint32_t(x.size() - 1);
+}
+
+uint32_t CollisionWorld::resolve(uint32_t iterations, CollisionMap const *map) {
+	uint32_t const count = size();
+	float max_radius = 0.0f;
+	for (float r : radius) max_radius = std::max(max_radius, r);
+
+	order.resize(count);
+	std::iota(order.begin(), order.end(), 0);
+	sorted_x.resize(count);
+	sorted_y.resize(count);
+	sorted_radius.resize(count);
+	sorted_weight.resize(count);
+	moved_x.resize(count);
+	moved_y.resize(count);
+
+	uint32_t first_overlaps = 0;
+	iterations_used = 0;
+	for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+		//sort by x (bodies barely move between iterations, so after the first sort this is nearly free):
+		if (iteration == 0) {
+			std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return x[a] < x[b]; });
+		} else {
+			for (uint32_t k = 1; k < count; ++k) {
+				uint32_t i = order[k];
+				uint32_t at = k;
+				while (at > 0 && x[order[at - 1]] > x[i]) {
+					order[at] = order[at - 1];
+					at -= 1;
+				}
+				order[at] = i;
+			}
+		}
+		for (uint32_t k = 0; k < count; ++k) {
+			uint32_t i = order[k];
+			sorted_x[k] = x[i];
+			sorted_y[k] = y[i];
+			sorted_radius[k] = radius[i];
+			sorted_weight[k] = weight[i];
+		}
+		moved_x = sorted_x;
+		moved_y = sorted_y;
+
+		//find overlapping pairs and push them apart right away, so later pairs see the result:
+		// (pushes go to moved_x/y, so the scan's window and early exit still run on sorted_x as sorted;
+		//  pairs pushed into overlap after the window passed them are found next iteration)
+		uint32_t overlaps = 0;
+		for (uint32_t a = 0; a < count; ++a) {
+			float ar = sorted_radius[a], aw = sorted_weight[a];
+			float window = sorted_x[a] + ar + max_radius;
+			for (uint32_t b = a + 1; b < count && sorted_x[b] < window; ++b) {
+				float dx = moved_x[b] - moved_x[a];
+				float dy = moved_y[b] - moved_y[a];
+				float reach = ar + sorted_radius[b];
+				float d2 = dx * dx + dy * dy;
+				if (d2 >= (reach - Slop) * (reach - Slop)) continue;
+				float total = aw + sorted_weight[b];
+				if (total <= 0.0f) continue;
+				overlaps += 1;
+
+				//separate along the line between them (or, if exactly on top of each other, any fixed direction):
+				float d = std::sqrt(d2);
+				float share = (reach - d) / total;
+				if (d > 0.0f) {
+					dx /= d;
+					dy /= d;
+				} else {
+					dx = 1.0f;
+					dy = 0.0f;
+				}
+				moved_x[a] -= dx * share * aw;
+				moved_y[a] -= dy * share * aw;
+				moved_x[b] += dx * share * sorted_weight[b];
+				moved_y[b] += dy * share * sorted_weight[b];
+			}
+		}
+		if (iteration == 0) first_overlaps = overlaps;
+		if (overlaps == 0) break;
+		iterations_used += 1;
+
+		//write back the moves, stopping them at walls, and then back out of any wall they're touching:
+		for (uint32_t k = 0; k < count; ++k) {
+			if (sorted_weight[k] <= 0.0f) continue;
+			uint32_t i = order[k];
+			glm::vec2 from = glm::vec2(x[i], y[i]);
+			glm::vec2 motion = glm::vec2(moved_x[k], moved_y[k]) - from;
+			if (map) {
+				CollisionMap::Hit hit;
+				if (motion != glm::vec2(0.0f) && map->sweep(from, from + motion, &hit)) {
+					float approach = -glm::dot(motion, hit.normal);
+					motion *= (approach > 0.0f ? std::max(0.0f, hit.t - WallSkin / approach) : 0.0f);
+				}
+				glm::vec2 normal;
+				float clearance = map->distance(from + motion, &normal);
+				if (clearance < radius[i] && normal != glm::vec2(0.0f)) {
+					glm::vec2 pushed = from + motion + normal * (radius[i] - clearance);
+					if (map->distance(pushed) > clearance && !map->sweep(from + motion, pushed, &hit)) {
+						motion = pushed - from;
+					}
+				}
+			}
+			x[i] += motion.x;
+			y[i] += motion.y;
+		}
+	}
+	return first_overlaps;
+}
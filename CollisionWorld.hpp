@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * CollisionWorld pushes apart overlapping round bodies on the XY plane.
+ *
+ * Bodies live in parallel arrays (x, y, radius, weight) rather than behind pointers, and
+ *  every overlapping pair is resolved together:
+ *  - bodies are sorted by x, so each one only looks at the run of following bodies close
+ *    enough on x to touch it (sort and sweep), a contiguous scan over plain floats;
+ *  - pairs are rejected on squared distance, so only real overlaps pay for a sqrt;
+ *  - each pair's push is split by the bodies' weights and applied at once, so pairs
+ *    later in the pass start from the result (converging faster than accumulating them);
+ *    the scan itself runs on the positions as sorted at the start of the pass, since pushes
+ *    would put them out of order.
+ *  Iterations repeat until no pair overlaps by more than Slop (or up to a cap), which
+ *  settles crowds where one push causes another.
+ *
+ * It has no GL or Scene dependencies: the server resolves every player with it each tick,
+ *  and the client's CollisionSystem resolves the local player against everyone else.
+ */
+
+#include "CollisionMap.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct CollisionWorld {
+	static constexpr uint32_t DefaultIterations = 16; //(a cap: most crowds settle in a few)
+	static constexpr float Slop = 1e-4f; //pairs overlapping by less than this count as touching
+
+	void clear();
+	//add a body and return its index; 'weight' is the share of each push it takes relative
+	// to the body it overlaps (zero makes it immovable, e.g. players the client doesn't control):
+	uint32_t add(glm::vec2 const &position, float radius, float weight = 1.0f);
+	uint32_t size() const { return uint32_t(x.size()); }
+	glm::vec2 position(uint32_t i) const { return glm::vec2(x[i], y[i]); }
+
+	//push overlapping bodies apart, keeping movable bodies out of the walls of 'map' (if given),
+	// for up to 'iterations' passes or until nothing overlaps:
+	// returns the number of overlapping pairs found in the first iteration.
+	uint32_t resolve(uint32_t iterations = DefaultIterations, CollisionMap const *map = nullptr);
+	uint32_t iterations_used = 0; //passes that pushed something (in the last resolve)
+
+	//bodies:
+	std::vector< float > x, y, radius, weight;
+
+	//scratch space, in order of increasing x:
+	std::vector< uint32_t > order;
+	std::vector< float > sorted_x, sorted_y, sorted_radius, sorted_weight;
+	std::vector< float > moved_x, moved_y; //(positions as pushed during a pass, parallel to the sorted arrays)
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ * Combat rules shared by the client (CollisionSystem) and the server (PoseHistory),
+ *  so that the server can check a client's hits with exactly the test the client ran.
+ *
+ * AttackCone works out everything the cone test needs once per attack (cosine of the
+ *  half angle, squared radius), so testing each candidate is a few multiplies and
+ *  compares: no sqrt, normalize or acos.
+ */
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//attacks hit the nearest player within AttackRadius and AttackDegree/2 of the attacker's facing:
+constexpr float AttackDegree = 90.0f;
+constexpr float AttackRadius = 2.0f;
+
+//the attack cone of an attacker at 'position' facing 'forward' (unit length):
+struct AttackCone {
+	AttackCone(glm::vec3 const &position_, glm::vec3 const &forward_, float attack_degree, float attack_radius)
+		: position(position_), forward(forward_), radius(attack_radius),
+		radius2(attack_radius * attack_radius),
+		cos_half(std::cos(glm::radians(attack_degree * 0.5f))) {
+		cos_half2 = cos_half * cos_half;
+	}
+
+	//is 'target' inside? (sets 'distance2' to its squared distance)
+	bool contains(glm::vec3 const &target, float *distance2) const {
+		glm::vec3 diff = target - position;
+		float d2 = glm::dot(diff, diff);
+		*distance2 = d2;
+
+		//skip out of range
+		if (d2 > radius2) return false;
+
+		//skip out of degree: the angle is within the half angle when dot(diff, forward) >= cos_half * |diff|,
+		// which is compared squared (after checking signs) to leave out the sqrt:
+		float along = glm::dot(diff, forward);
+		if (cos_half >= 0.0f) return along >= 0.0f && along * along >= cos_half2 * d2;
+		else return along >= 0.0f || along * along <= cos_half2 * d2;
+	}
+
+	glm::vec3 position;
+	glm::vec3 forward;
+	float radius;
+	float radius2;
+	float cos_half;
+	float cos_half2;
+};
+
+//something inside an attack cone:
+struct ConeHit {
+	uint32_t id;
+	float distance2; //squared distance from the attacker
+};
+
+//put hits nearest first (ties by id, so the order doesn't depend on how they were found):
+inline void sort_hits(std::vector< ConeHit >::iterator begin, std::vector< ConeHit >::iterator end) {
+	std::sort(begin, end, [](ConeHit const &a, ConeHit const &b) {
+		if (a.distance2 != b.distance2) return a.distance2 < b.distance2;
+		return a.id < b.id;
+	});
+}
+
+//is 'target' inside the attack cone of an attacker at 'position' facing 'forward' (unit length)?
+// (sets 'distance' to how far away the target is; use AttackCone directly when testing many targets)
+inline bool in_attack_cone(glm::vec3 const &position, glm::vec3 const &forward, glm::vec3 const &target, float attack_degree, float attack_radius, float *distance) {
+	float distance2;
+	bool inside = AttackCone(position, forward, attack_degree, attack_radius).contains(target, &distance2);
+	*distance = std::sqrt(distance2);
+	return inside;
+}
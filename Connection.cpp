@@ -22,8 +22,14 @@ typedef int ssize_t;
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/ip.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <fcntl.h>
+
+#if defined(__linux__) && !defined(CONNECTION_USE_SELECT)
+#include <sys/epoll.h>
+#endif
 
 #define closesocket close
 
@@ -47,11 +53,226 @@ typedef int ssize_t;
 
 void Connection::close() {
 	if (socket != InvalidSocket) {
-		::closesocket(socket);
+		if (datagram) {
+			send_datagram_disconnect(*this);
+			//server-side UDP connections share the server's socket, so leave it open:
+			if (datagram->owns_socket) ::closesocket(socket);
+		} else {
+			::closesocket(socket);
+		}
 		socket = InvalidSocket;
 	}
 }
 
+void Connection::send_shared(std::shared_ptr< std::vector< char > const > const &data) {
+	if (!data || data->empty()) return;
+	SharedSend block;
+	block.ring_before = send_buffer.size();
+	for (auto const &queued : send_shared_queue) {
+		block.ring_before -= queued.ring_before;
+	}
+	block.data = data;
+	send_shared_queue.emplace_back(std::move(block));
+}
+
+void Connection::copy_pending(size_t offset, void *to_, size_t size) const {
+	assert(offset + size <= send_pending_bytes());
+	char *to = reinterpret_cast< char * >(to_);
+	//walk send_buffer and the shared blocks in send order, skipping the first 'offset' bytes:
+	size_t ring_at = 0; //offset into send_buffer
+	auto take = [&](char const *data, size_t length) {
+		if (offset >= length) {
+			offset -= length;
+			return;
+		}
+		size_t amount = std::min(size, length - offset);
+		memcpy(to, data + offset, amount);
+		to += amount;
+		size -= amount;
+		offset = 0;
+	};
+	auto take_ring = [&](size_t length) {
+		if (offset >= length) {
+			offset -= length;
+		} else {
+			size_t amount = std::min(size, length - offset);
+			send_buffer.copy_out(ring_at + offset, to, amount);
+			to += amount;
+			size -= amount;
+			offset = 0;
+		}
+		ring_at += length;
+	};
+	for (auto const &queued : send_shared_queue) {
+		if (size == 0) return;
+		take_ring(queued.ring_before);
+		if (size == 0) return;
+		take(queued.data->data() + queued.sent, queued.data->size() - queued.sent);
+	}
+	if (size == 0) return;
+	take_ring(send_buffer.size() - ring_at);
+	assert(size == 0);
+}
+
+void Connection::consume_sent(size_t size) {
+	while (size > 0 && !send_shared_queue.empty()) {
+		auto &front = send_shared_queue.front();
+		size_t from_ring = std::min(size, front.ring_before);
+		send_buffer.consume(from_ring);
+		front.ring_before -= from_ring;
+		size -= from_ring;
+
+		size_t from_block = std::min(size, front.data->size() - front.sent);
+		front.sent += from_block;
+		size -= from_block;
+		if (front.ring_before == 0 && front.sent == front.data->size()) {
+			send_shared_queue.pop_front();
+		}
+	}
+	send_buffer.consume(size);
+}
+
+size_t Connection::send_pending_bytes() const {
+	size_t total = send_buffer.size();
+	for (auto const &queued : send_shared_queue) {
+		total += queued.data->size() - queued.sent;
+	}
+	return total;
+}
+
+//---------------------------------
+//Per-connection read/write helpers used by both polling paths:
+
+//read data currently available on a connection's socket:
+// (edge-triggered callers pass drain = true to keep reading until the socket would block)
+static void recv_connection(char const *where, Connection &c, std::function< void(Connection *, Connection::Event event) > const &on_event, bool drain) {
+	const uint32_t BufferSize = 20000;
+
+	while (c.socket != InvalidSocket) { //read until no more data left to read
+		//receive directly into the free space at the end of recv_buffer:
+		ByteRing::Span spans[2];
+		uint32_t span_count = c.recv_buffer.free_spans(BufferSize, spans);
+		size_t space = spans[0].size + (span_count > 1 ? spans[1].size : 0);
+
+		#ifdef _WIN32
+		(void)span_count;
+		space = spans[0].size;
+		ssize_t ret = recv(c.socket, spans[0].data, int(spans[0].size), MSG_DONTWAIT);
+		#else
+		struct iovec iov[2];
+		for (uint32_t i = 0; i < span_count; ++i) {
+			iov[i].iov_base = spans[i].data;
+			iov[i].iov_len = spans[i].size;
+		}
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = span_count;
+		ssize_t ret = recvmsg(c.socket, &msg, MSG_DONTWAIT);
+		#endif
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~ but no data
+			break;
+		} else if (ret <= 0 || ret > (ssize_t)space) {
+			//~problem~ so remove connection
+			if (ret == 0) {
+				std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
+			} else if (ret < 0) {
+				std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
+			} else {
+				std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
+			}
+			c.close();
+			c.close_reported = true;
+			if (on_event) on_event(&c, Connection::OnClose);
+			break;
+		} else { //ret > 0
+			c.recv_buffer.commit(size_t(ret));
+			if (on_event) on_event(&c, Connection::OnRecv);
+			if (!drain && size_t(ret) < space) break; //ran out of data before buffer: no more data left to read
+		}
+	}
+}
+
+//gather the front of a connection's outgoing data (send_buffer interleaved with shared blocks) into spans:
+// (returns the number of spans used)
+static uint32_t gather_send_spans(Connection const &c, ByteRing::ConstSpan *spans, uint32_t max_spans) {
+	ByteRing::ConstSpan ring[2];
+	uint32_t ring_count = c.send_buffer.data_spans(ring);
+	uint32_t ring_index = 0;
+	size_t ring_offset = 0; //offset into ring[ring_index]
+
+	uint32_t count = 0;
+	auto add_ring = [&](size_t size) {
+		while (size > 0 && count < max_spans && ring_index < ring_count) {
+			size_t amount = std::min(size, ring[ring_index].size - ring_offset);
+			spans[count].data = ring[ring_index].data + ring_offset;
+			spans[count].size = amount;
+			++count;
+			size -= amount;
+			ring_offset += amount;
+			if (ring_offset == ring[ring_index].size) {
+				++ring_index;
+				ring_offset = 0;
+			}
+		}
+	};
+
+	for (auto const &queued : c.send_shared_queue) {
+		add_ring(queued.ring_before);
+		if (count == max_spans) return count;
+		spans[count].data = queued.data->data() + queued.sent;
+		spans[count].size = queued.data->size() - queued.sent;
+		++count;
+		if (count == max_spans) return count;
+	}
+	add_ring(c.send_buffer.size());
+	return count;
+}
+
+
+//send as much of a connection's outgoing data as the socket will currently take:
+static void send_connection(char const *where, Connection &c, std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	while (c.socket != InvalidSocket && c.send_pending()) {
+		//gather send_buffer and any shared blocks into one call:
+		constexpr uint32_t MaxSpans = 16;
+		ByteRing::ConstSpan spans[MaxSpans];
+		uint32_t span_count = gather_send_spans(c, spans, MaxSpans);
+		size_t pending = c.send_pending_bytes();
+
+		#ifdef _WIN32
+		(void)span_count;
+		ssize_t ret = send(c.socket, spans[0].data, int(spans[0].size), MSG_DONTWAIT);
+		#else
+		struct iovec iov[MaxSpans];
+		for (uint32_t i = 0; i < span_count; ++i) {
+			iov[i].iov_base = const_cast< char * >(spans[i].data);
+			iov[i].iov_len = spans[i].size;
+		}
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = span_count;
+		ssize_t ret = sendmsg(c.socket, &msg, MSG_DONTWAIT);
+		#endif
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~, but don't keep trying
+			break;
+		} else if (ret <= 0 || ret > (ssize_t)pending) {
+			if (ret < 0) {
+				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
+			} else { assert(ret == 0 || ret > (ssize_t)pending);
+				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << pending << "], disconnecting." << std::endl;
+			}
+			c.close();
+			c.close_reported = true;
+			if (on_event) on_event(&c, Connection::OnClose);
+		} else { //ret seems reasonable
+			c.consume_sent(size_t(ret));
+		}
+	}
+}
+
 //---------------------------------
 //Polling helper used by both server and client:
 void poll_connections(
@@ -74,11 +295,11 @@ void poll_connections(
 	}
 
 	//add each connection's socket to read (and possibly write) sets:
-	for (auto c : connections) {
+	for (auto const &c : connections) {
 		if (c.socket != InvalidSocket) {
 			max = std::max(max, int(c.socket));
 			FD_SET(c.socket, &read_fds);
-			if (!c.send_buffer.empty()) {
+			if (c.send_pending()) {
 				FD_SET(c.socket, &write_fds);
 			}
 		}
@@ -119,72 +340,123 @@ void poll_connections(
 		}
 	}
 
-	const uint32_t BufferSize = 20000;
-	static thread_local char *buffer = new char[BufferSize];
-
 	//process requests:
 	for (auto &c : connections) {
 		//only read from valid sockets marked readable:
 		if (c.socket == InvalidSocket || !FD_ISSET(c.socket, &read_fds)) continue;
-
-		while (true) { //read until more data left to read
-			ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
-			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				//~no problem~ but no data
-				break;
-			} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
-				//~problem~ so remove connection
-				if (ret == 0) {
-					std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
-				} else if (ret < 0) {
-					std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
-				} else {
-					std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
-				}
-				c.close();
-				if (on_event) on_event(&c, Connection::OnClose);
-				break;
-			} else { //ret > 0
-				c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
-				if (on_event) on_event(&c, Connection::OnRecv);
-				if (ret < BufferSize) break; //ran out of data before buffer: no more data left to read
-			}
-		}
+		recv_connection(where, c, on_event, false);
 	}
 
 	//process responses:
 	for (auto &c : connections) {
 		//don't bother with connections unless they are valid, have something to send, and are marked writable:
-		if (c.socket == InvalidSocket || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
+		if (c.socket == InvalidSocket || !c.send_pending() || !FD_ISSET(c.socket, &write_fds)) continue;
+		send_connection(where, c, on_event);
+	}
+
 		
-		#ifdef _WIN32
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
-		#else
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
-		#endif 
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~, but don't keep trying
-			break;
-		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
-			if (ret < 0) {
-				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
-			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
-				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+}
+
+#if defined(__linux__) && !defined(CONNECTION_USE_SELECT)
+//---------------------------------
+//epoll-based polling used by the server on linux:
+// - sockets are registered once (on accept) rather than re-added every call,
+// - reads are edge-triggered, so each readable socket is drained until EAGAIN,
+// - EPOLLOUT interest is only registered while a connection has queued data.
+
+static void watch_writable(int epoll_fd, Connection &c, bool writable) {
+	if (c.watch_writable == writable || c.socket == InvalidSocket) return;
+	struct epoll_event evt;
+	evt.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (writable ? uint32_t(EPOLLOUT) : 0U);
+	evt.data.ptr = &c;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.socket, &evt) != 0) {
+		std::cerr << "[Server::poll] epoll_ctl(MOD) failed: " << strerror(errno) << std::endl;
+		return;
+	}
+	c.watch_writable = writable;
+}
+
+static void poll_connections_epoll(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	int epoll_fd,
+	Socket listen_socket) {
+
+	//update EPOLLOUT interest:
+	// - data queued since last poll is sent right away, and EPOLLOUT is only requested if some is left over
+	// - connections that have flushed everything stop asking for EPOLLOUT
+	for (auto &c : connections) {
+		if (c.socket == InvalidSocket) continue;
+		if (!c.send_pending()) {
+			if (c.watch_writable) watch_writable(epoll_fd, c, false);
+		} else if (!c.watch_writable) {
+			send_connection(where, c, on_event);
+			if (c.send_pending()) watch_writable(epoll_fd, c, true);
+		}
+	}
+
+	constexpr int MaxEvents = 64;
+	struct epoll_event events[MaxEvents];
+
+	//NOTE: rounding the timeout up so that a small positive timeout still waits:
+	int timeout_ms = (timeout <= 0.0 ? 0 : int(std::ceil(timeout * 1000.0)));
+	int count = epoll_wait(epoll_fd, events, MaxEvents, timeout_ms);
+	if (count < 0) {
+		if (errno != EINTR) {
+			std::cerr << "[" << where << "] epoll_wait returned an error (" << strerror(errno) << ")." << std::endl;
+		}
+		return;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		struct epoll_event const &evt = events[i];
+
+		//new connection(s) -- accept until the backlog is empty, since the listen socket is edge-triggered too:
+		if (evt.data.ptr == nullptr) {
+			while (true) {
+				Socket got = accept4(listen_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (got == InvalidSocket) break; //(EAGAIN, or an error we can't do anything about)
+
+				connections.emplace_back();
+				Connection &c = connections.back();
+				c.socket = got;
+
+				struct epoll_event add;
+				add.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+				add.data.ptr = &c;
+				if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, got, &add) != 0) {
+					std::cerr << "[" << where << "] epoll_ctl(ADD) failed: " << strerror(errno) << "; dropping client." << std::endl;
+					c.close();
+					c.close_reported = true; //(never opened, as far as the application knows)
+					continue;
+				}
+
+				std::cerr << "[" << where << "] client connected on " << c.socket << "." << std::endl; //INFO
+				if (on_event) on_event(&c, Connection::OnOpen);
 			}
-			c.close();
-			if (on_event) on_event(&c, Connection::OnClose);
-		} else { //ret seems reasonable
-			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
+			continue;
+		}
+
+		Connection &c = *reinterpret_cast< Connection * >(evt.data.ptr);
+		if (c.socket == InvalidSocket) continue; //closed earlier this poll (e.g., from a callback)
+
+		if (evt.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			recv_connection(where, c, on_event, true);
+		}
+		if (evt.events & EPOLLOUT) {
+			send_connection(where, c, on_event);
 		}
 	}
 
-		
 }
+#endif
 
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+Server::Server(std::string const &port, Transport transport_) : transport(transport_) {
 
 	#ifdef _WIN32
 	{ //init winsock:
@@ -199,7 +471,7 @@ Server::Server(std::string const &port) {
 		struct addrinfo hints;
 		memset(&hints, 0, sizeof(hints));
 		hints.ai_family = AF_INET;
-		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_socktype = (transport == Transport::UDP ? SOCK_DGRAM : SOCK_STREAM);
 		hints.ai_flags = AI_PASSIVE;
 
 		struct addrinfo *res = nullptr;
@@ -250,6 +522,7 @@ Server::Server(std::string const &port) {
 			int ret = bind(s, info->ai_addr, int(info->ai_addrlen));
 			if (ret < 0) {
 				std::cout << "(failed to bind: " << strerror(errno) << ")" << std::endl;
+				closesocket(s);
 				continue;
 			}
 			std::cout << "success!" << std::endl;
@@ -265,6 +538,12 @@ Server::Server(std::string const &port) {
 		throw std::runtime_error("Failed to bind to port " + port);
 	}
 
+	if (transport == Transport::UDP) {
+		//no listening or accepting: peers are recognized by address as their datagrams arrive
+		endpoint = make_datagram_endpoint(listen_socket);
+		return;
+	}
+
 	{ //listen on socket
 		int ret = ::listen(listen_socket, 5);
 		if (ret < 0) {
@@ -272,22 +551,76 @@ Server::Server(std::string const &port) {
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
 		}
 	}
+
+	#if defined(__linux__) && !defined(CONNECTION_USE_SELECT)
+	{ //register listen socket with a (persistent) epoll instance:
+		//listen socket is non-blocking so poll() can accept() until the backlog is empty:
+		int flags = fcntl(listen_socket, F_GETFL, 0);
+		if (flags < 0 || fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+			closesocket(listen_socket);
+			throw std::system_error(errno, std::system_category(), "failed to make listen socket non-blocking");
+		}
+
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0) {
+			closesocket(listen_socket);
+			throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+		}
+
+		struct epoll_event evt;
+		evt.events = EPOLLIN | EPOLLET;
+		evt.data.ptr = nullptr; //nullptr marks the listen socket
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_socket, &evt) != 0) {
+			closesocket(listen_socket);
+			::close(epoll_fd);
+			throw std::system_error(errno, std::system_category(), "failed to register listen socket with epoll");
+		}
+	}
+	#endif
+}
+
+Server::~Server() {
+	//(UDP connections share listen_socket, so close them first -- close() sends their disconnects on it)
+	for (auto &c : connections) {
+		c.close();
+	}
+	#if defined(__linux__) && !defined(CONNECTION_USE_SELECT)
+	if (epoll_fd >= 0) {
+		::close(epoll_fd);
+		epoll_fd = -1;
+	}
+	#endif
+	if (listen_socket != InvalidSocket) {
+		closesocket(listen_socket);
+		listen_socket = InvalidSocket;
+	}
 }
 
 void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	if (transport == Transport::UDP) {
+		poll_datagrams("Server::poll", *endpoint, simulation, connections, true, on_event, timeout);
+	} else {
+		#if defined(__linux__) && !defined(CONNECTION_USE_SELECT)
+		poll_connections_epoll("Server::poll", connections, on_event, timeout, epoll_fd, listen_socket);
+		#else
+		poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+		#endif
+	}
 
 	//reap closed clients:
 	for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
 		auto old = connection;
 		++connection;
 		if (old->socket == InvalidSocket) {
+			//(closed by the application: it still needs to forget about this connection)
+			if (!old->close_reported && on_event) on_event(&*old, Connection::OnClose);
+			if (endpoint) forget_datagram_peer(*endpoint, *old);
 			connections.erase(old);
 		}
 	}
 }
 
-Client::Client(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
+Client::Client(std::string const &host, std::string const &port, Transport transport_) : connections(1), connection(connections.front()), transport(transport_) {
 	#ifdef _WIN32
 	{ //init winsock:
 		WSADATA info;
@@ -301,8 +634,8 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 		struct addrinfo hints;
 		memset(&hints, 0, sizeof(hints));
 		hints.ai_family = AF_UNSPEC;
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_protocol = IPPROTO_TCP;
+		hints.ai_socktype = (transport == Transport::UDP ? SOCK_DGRAM : SOCK_STREAM);
+		hints.ai_protocol = (transport == Transport::UDP ? IPPROTO_UDP : IPPROTO_TCP);
 
 		struct addrinfo *res = nullptr;
 		int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
@@ -335,6 +668,13 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 				std::cout << "(failed to create socket: " << strerror(errno) << ")" << std::endl;
 				continue;
 			}
+			if (transport == Transport::UDP) {
+				//nothing to connect; the server learns about us from our first datagram:
+				std::cout << "ok (udp)" << std::endl;
+				endpoint = make_datagram_endpoint(s);
+				open_datagram_channel(*endpoint, connection, s, info->ai_addr, uint32_t(info->ai_addrlen), true);
+				break;
+			}
 			int ret = connect(s, info->ai_addr, int(info->ai_addrlen));
 			if (ret < 0) {
 				std::cout << "(failed to connect: " << strerror(errno) << ")" << std::endl;
@@ -356,6 +696,10 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 
 
 void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Client::poll", connections, on_event, timeout, InvalidSocket);
+	if (transport == Transport::UDP) {
+		poll_datagrams("Client::poll", *endpoint, simulation, connections, false, on_event, timeout);
+	} else {
+		poll_connections("Client::poll", connections, on_event, timeout, InvalidSocket);
+	}
 }
 
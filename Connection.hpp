@@ -1,7 +1,7 @@
 #pragma once
 
 /* 
- * Connection is a simple wrapper around a TCP socket connection.
+ * Connection is a simple wrapper around a TCP socket connection (or, with Transport::UDP, a UDP peer).
  * You don't create 'Connection' objects yourself, rather, you
  * create a Client or Server object which will manage connection(s)
  * for you.
@@ -14,8 +14,9 @@ int main(int argc, char **argv) {
 		server.poll([](Connection *connection, Connection::Event evt){
 			if (evt == Connection::OnRecv) {
 				//extract and erase data from the connection's recv_buffer:
-				std::vector< uint8_t > data = connection->recv_buffer;
-				connection->recv_buffer.clear();
+				std::vector< char > data(connection->recv_buffer.size());
+				connection->recv_buffer.copy_out(0, data.data(), data.size());
+				connection->recv_buffer.consume(data.size());
 				//send to other connections:
 
 			}
@@ -60,12 +61,81 @@ int main(int argc, char **argv) {
 #endif
 //--------- ---------------------------------- ---------
 
+#include "ByteRing.hpp"
+
 #include <vector>
 #include <list>
+#include <deque>
+#include <array>
+#include <memory>
 #include <string>
 #include <functional>
 
-//Thin wrapper around a (polling-based) TCP socket connection:
+//Server and Client can run over either transport:
+enum class Transport {
+	TCP, //one reliable, ordered stream (a lost segment holds up everything behind it)
+	UDP, //datagrams carrying an unreliable newest-wins "state" message plus a reliable stream (see ConnectionUDP.cpp)
+};
+
+//(UDP only) per-connection sequencing, acks, and reliable stream bookkeeping:
+struct Datagram_Channel {
+	//peer address (a sockaddr_storage, kept opaque so this header doesn't need the OS socket headers):
+	std::array< char, 128 > address;
+	uint32_t address_length = 0;
+	bool owns_socket = false; //client channels own their socket; server channels share the server's
+
+	//packet sequence numbers and acks:
+	uint16_t local_sequence = 0; //sequence number of the next packet we send
+	uint16_t remote_sequence = 0; //newest sequence number received from the peer
+	uint32_t remote_ack_bits = 0; //bit i set: packet (remote_sequence - 1 - i) was received too
+	bool received_any = false;
+	bool ack_owed = false; //received something since our last packet
+
+	//our packets, by sequence % size, for round trip time and loss statistics:
+	struct Sent {
+		uint16_t sequence = 0;
+		bool in_use = false;
+		bool acked = false;
+		bool reliable = false; //carried reliable stream data
+		double time = 0.0;
+	};
+	std::array< Sent, 64 > sent;
+	uint16_t go_back_sequence = 0; //first packet sent after the last retransmit
+
+	//unreliable state (only the newest is ever sent):
+	std::vector< char > state;
+	std::shared_ptr< std::vector< char > const > state_shared; //goes out after 'state'
+	bool state_pending = false;
+	uint16_t recv_state_sequence = 0; //sequence number of the packet that carried recv_state
+	bool recv_state_any = false;
+
+	//reliable stream -- send_buffer and send_shared_queue hold everything from reliable_acked on:
+	uint32_t reliable_acked = 0; //peer has every byte before this offset
+	uint32_t reliable_next = 0; //offset of the next byte to (re)send
+	double reliable_progress_time = 0.0; //when reliable_acked last advanced (for retransmit timeouts)
+	uint32_t reliable_received = 0; //offset of the next byte we expect from the peer
+
+	double last_recv_time = 0.0;
+
+	//statistics:
+	double rtt = 0.1; //smoothed round trip time (seconds)
+	uint64_t packets_sent = 0;
+	uint64_t packets_received = 0;
+	uint64_t packets_acked = 0;
+	uint64_t packets_lost = 0; //never acked
+	uint64_t states_streamed = 0; //state messages too big for one datagram, sent on the reliable stream instead
+};
+
+//(UDP only) lossy link simulation for testing, applied to outgoing datagrams:
+struct Network_Simulation {
+	float loss = 0.0f; //probability each datagram is dropped
+	double latency = 0.0; //seconds each datagram is delayed
+	double jitter = 0.0; //up to this many more seconds of (uniformly random) delay; reorders datagrams
+};
+
+struct Datagram_Endpoint; //(UDP only) socket-level state, see ConnectionUDP.cpp
+
+//Thin wrapper around a (polling-based) TCP socket connection or UDP peer:
 struct Connection {
 	//Helper that will append any type to the send buffer:
 	template< typename T >
@@ -74,22 +144,59 @@ struct Connection {
 	}
 	//Helper that will append raw bytes to the send buffer:
 	void send_raw(void const *data, size_t size) {
-		send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data), reinterpret_cast< uint8_t const * >(data) + size);
+		send_buffer.append(data, size);
 	}
+	//Helper that will queue an immutable block of bytes to go out after everything sent so far:
+	// (the block is referenced rather than copied, so one buffer can be fanned out to many connections)
+	void send_shared(std::shared_ptr< std::vector< char > const > const &data);
+
+	//Helper that will send a "state" message, where only the newest one matters:
+	// over TCP this is just appended to the stream;
+	// over UDP it goes out once, unreliably, and replaces any state that hasn't been sent yet.
+	// ('shared' -- if given -- follows 'data' without being copied)
+	// returns false if (over UDP) the state was too big for one datagram and was appended to the reliable
+	// stream instead -- it still arrives, but late and in order, like TCP (counted in datagram->states_streamed)
+	bool send_state(void const *data, size_t size, std::shared_ptr< std::vector< char > const > const &shared = nullptr);
+
+	//is anything (buffered or shared) still waiting to go out?
+	bool send_pending() const { return !send_buffer.empty() || !send_shared_queue.empty(); }
+	size_t send_pending_bytes() const;
+	//copy pending bytes (in send order) starting 'offset' bytes from the front:
+	void copy_pending(size_t offset, void *to, size_t size) const;
+	//drop 'size' bytes from the front of the pending data (once they have been sent, or, for UDP, acknowledged):
+	void consume_sent(size_t size);
 
 	//Call 'close' to mark a connection for discard:
+	// (a Server connection is discarded at the end of the current or next Server::poll, after an OnClose)
 	void close();
 
 	//so you can if(connection) ... to check for validity:
 	explicit operator bool() { return socket != InvalidSocket; }
 
 	//To send data over a connection, append it to send_buffer:
-	std::vector< char > send_buffer;
+	ByteRing send_buffer;
 	//When the connection receives data, it is appended to recv_buffer:
-	std::vector< char > recv_buffer;
+	// (parse messages in place with recv_buffer.contiguous() and drop them with recv_buffer.consume())
+	ByteRing recv_buffer;
+	//(UDP only) the newest state message received; clear() it once it has been read:
+	std::vector< char > recv_state;
 
 	//internals:
 	Socket socket = InvalidSocket;
+	Transport transport = Transport::TCP;
+	std::unique_ptr< Datagram_Channel > datagram; //(UDP only)
+
+	//shared blocks, interleaved with send_buffer in the order they were queued:
+	struct SharedSend {
+		size_t ring_before = 0; //bytes of send_buffer that go out before this block (and after the previous one)
+		std::shared_ptr< std::vector< char > const > data;
+		size_t sent = 0; //bytes of data already sent
+	};
+	std::deque< SharedSend > send_shared_queue;
+	bool watch_writable = false; //(epoll only) is EPOLLOUT currently registered for this socket?
+	//has OnClose gone to the poll callback? (Server::poll sends it before reaping connections closed any other way,
+	// e.g. by the application from a callback, so the application always hears about a connection it is about to lose)
+	bool close_reported = false;
 
 	enum Event {
 		OnOpen,
@@ -99,7 +206,11 @@ struct Connection {
 };
 
 struct Server {
-	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	Server(std::string const &port, Transport transport = Transport::TCP); //pass the port number to listen on, as a string (servname, really)
+	~Server(); //closes any remaining connections, then the listen socket (and epoll instance)
+	//(owns its sockets, so no copies:)
+	Server(Server const &) = delete;
+	Server &operator=(Server const &) = delete;
 
 	//poll() updates the list of active connections and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -109,12 +220,22 @@ struct Server {
 	);
 
 	std::list< Connection > connections;
-	Socket listen_socket = InvalidSocket;
+	Socket listen_socket = InvalidSocket; //(with UDP, this is the one socket all connections share)
+
+	Transport transport = Transport::TCP;
+	Network_Simulation simulation; //(UDP only)
+	std::shared_ptr< Datagram_Endpoint > endpoint; //(UDP only)
+
+	//on linux, sockets stay registered with an epoll instance between calls to poll():
+	// (define CONNECTION_USE_SELECT to fall back to the portable select()-based path)
+	#if defined(__linux__) && !defined(CONNECTION_USE_SELECT)
+	int epoll_fd = -1;
+	#endif
 };
 
 
 struct Client {
-	Client(std::string const &host, std::string const &port);
+	Client(std::string const &host, std::string const &port, Transport transport = Transport::TCP);
 
 	//poll() checks the status of the active connection and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -125,4 +246,27 @@ struct Client {
 
 	std::list< Connection > connections; //will only ever contain exactly one connection
 	Connection &connection; //reference to the only connection in the connections list
+
+	Transport transport = Transport::TCP;
+	Network_Simulation simulation; //(UDP only)
+	std::shared_ptr< Datagram_Endpoint > endpoint; //(UDP only)
 };
+
+//--------- UDP transport internals (ConnectionUDP.cpp) ---------
+std::shared_ptr< Datagram_Endpoint > make_datagram_endpoint(Socket socket);
+//set up 'c' to talk to the peer at 'address' (and route that peer's datagrams on 'endpoint' to it):
+void open_datagram_channel(Datagram_Endpoint &endpoint, Connection &c, Socket socket, void const *address, uint32_t address_length, bool owns_socket);
+//stop routing datagrams to 'c' (before it is discarded):
+void forget_datagram_peer(Datagram_Endpoint &endpoint, Connection &c);
+//tell the peer (best effort) that 'c' is closing:
+void send_datagram_disconnect(Connection &c);
+//send/receive datagrams for 'connections'; new peers are added if 'accept_new' is set:
+void poll_datagrams(
+	char const *where,
+	Datagram_Endpoint &endpoint,
+	Network_Simulation const &simulation,
+	std::list< Connection > &connections,
+	bool accept_new,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout
+);
@@ -0,0 +1,534 @@
+//UDP transport for Server/Client (see Transport in Connection.hpp).
+//
+//Every datagram starts with a small header:
+//  - a sequence number, plus the newest sequence number received from the peer and
+//    a bitfield of the 32 before it ("acks"), used for round trip time and loss statistics;
+//  - the peer's reliable stream offset we have received up to (a cumulative ack).
+//It may then carry:
+//  - one state message (from Connection::send_state): sent once, never resent; the receiver
+//    keeps it only if it is newer than the last state it kept (newest wins);
+//  - a segment of the reliable stream (send_buffer, plus any shared blocks): resent, go-back-N
+//    style, from the last acknowledged offset if no progress is made within a few round trips.
+
+//--------- OS-specific socket-related headers ---------
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1 //so we can use strerror()
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#undef APIENTRY
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#undef max
+#undef min
+
+typedef int ssize_t;
+typedef int socklen_t;
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define closesocket close
+
+#endif
+
+#include "Connection.hpp"
+
+//------------------------------------------------------
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+//keep datagrams under a typical path MTU so they aren't fragmented:
+static constexpr size_t MaxDatagramSize = 1200;
+//identifies our datagrams (and the version of this header):
+static constexpr uint32_t DatagramProtocol = 0x50545401; //'P' 'T' 'T' 1
+
+//header layout (little-endian):
+// uint32 protocol, uint16 sequence, uint16 ack, uint32 ack_bits,
+// uint32 reliable_ack, uint32 reliable_offset, uint16 state_size, uint16 reliable_size, uint8 flags
+static constexpr size_t DatagramHeaderSize = 4 + 2 + 2 + 4 + 4 + 4 + 2 + 2 + 1;
+static constexpr size_t MaxDatagramState = MaxDatagramSize - DatagramHeaderSize;
+
+enum DatagramFlags : uint8_t {
+	HasAcks = (1 << 0), //ack / ack_bits / reliable_ack are valid
+	Disconnect = (1 << 1), //sender is closing the connection
+};
+
+//limit on reliable bytes sent but not yet acknowledged:
+static constexpr uint32_t MaxReliableInFlight = 32 * 1024;
+//limit on datagrams sent to one peer per poll:
+static constexpr uint32_t MaxDatagramsPerFlush = 16;
+//peers that go quiet for this long are disconnected:
+static constexpr double DatagramTimeout = 5.0;
+
+struct Datagram_Endpoint {
+	Socket socket = InvalidSocket;
+
+	//datagrams held back by Network_Simulation::latency / jitter:
+	struct Delayed {
+		double time = 0.0;
+		std::array< char, 128 > address;
+		uint32_t address_length = 0;
+		std::vector< char > data;
+	};
+	std::vector< Delayed > delayed;
+	std::mt19937 rng{0x5eed};
+
+	//connections by peer address (raw sockaddr bytes), so each datagram finds its connection in O(1):
+	std::unordered_map< std::string, Connection * > peers;
+	//peers the server refused (closed from OnOpen) -> when they last sent; their datagrams are dropped,
+	// rather than opening (and refusing) a new connection each, until they go quiet for DatagramTimeout:
+	std::unordered_map< std::string, double > refused;
+	std::string key; //scratch for lookups
+};
+
+static double now_seconds() {
+	return std::chrono::duration< double >(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//is sequence number 'a' newer than 'b' (allowing for wrap-around)?
+static bool sequence_newer(uint16_t a, uint16_t b) {
+	return a != b && uint16_t(a - b) < 0x8000;
+}
+
+std::shared_ptr< Datagram_Endpoint > make_datagram_endpoint(Socket socket) {
+	#ifdef _WIN32
+	unsigned long one = 1;
+	if (0 != ioctlsocket(socket, FIONBIO, &one)) {
+		throw std::runtime_error("failed to make udp socket non-blocking");
+	}
+	#else
+	int flags = fcntl(socket, F_GETFL, 0);
+	if (flags < 0 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+		throw std::system_error(errno, std::system_category(), "failed to make udp socket non-blocking");
+	}
+	#endif
+	auto endpoint = std::make_shared< Datagram_Endpoint >();
+	endpoint->socket = socket;
+	return endpoint;
+}
+
+void open_datagram_channel(Datagram_Endpoint &endpoint, Connection &c, Socket socket, void const *address, uint32_t address_length, bool owns_socket) {
+	endpoint.peers[std::string(reinterpret_cast< char const * >(address), address_length)] = &c;
+	c.socket = socket;
+	c.transport = Transport::UDP;
+	c.datagram = std::make_unique< Datagram_Channel >();
+	assert(address_length <= c.datagram->address.size());
+	memcpy(c.datagram->address.data(), address, address_length);
+	c.datagram->address_length = address_length;
+	c.datagram->owns_socket = owns_socket;
+	c.datagram->last_recv_time = now_seconds();
+	c.datagram->ack_owed = true; //so the first poll says hello
+}
+
+void forget_datagram_peer(Datagram_Endpoint &endpoint, Connection &c) {
+	if (!c.datagram) return;
+	auto f = endpoint.peers.find(std::string(c.datagram->address.data(), c.datagram->address_length));
+	if (f != endpoint.peers.end() && f->second == &c) endpoint.peers.erase(f);
+}
+
+//--------- header encoding ---------
+
+static void put_u16(char *&at, uint16_t v) {
+	*(at++) = char(v & 0xff);
+	*(at++) = char(v >> 8);
+}
+static void put_u32(char *&at, uint32_t v) {
+	put_u16(at, uint16_t(v & 0xffff));
+	put_u16(at, uint16_t(v >> 16));
+}
+static uint16_t get_u16(char const *&at) {
+	uint16_t lo = uint8_t(*(at++));
+	uint16_t hi = uint8_t(*(at++));
+	return uint16_t(lo | (hi << 8));
+}
+static uint32_t get_u32(char const *&at) {
+	uint32_t lo = get_u16(at);
+	uint32_t hi = get_u16(at);
+	return lo | (hi << 16);
+}
+
+struct Datagram_Header {
+	uint16_t sequence = 0;
+	uint16_t ack = 0;
+	uint32_t ack_bits = 0;
+	uint32_t reliable_ack = 0;
+	uint32_t reliable_offset = 0;
+	uint16_t state_size = 0;
+	uint16_t reliable_size = 0;
+	uint8_t flags = 0;
+};
+
+static void write_header(Datagram_Header const &h, char *at) {
+	put_u32(at, DatagramProtocol);
+	put_u16(at, h.sequence);
+	put_u16(at, h.ack);
+	put_u32(at, h.ack_bits);
+	put_u32(at, h.reliable_ack);
+	put_u32(at, h.reliable_offset);
+	put_u16(at, h.state_size);
+	put_u16(at, h.reliable_size);
+	*at = char(h.flags);
+}
+
+static bool read_header(char const *at, size_t size, Datagram_Header *h) {
+	if (size < DatagramHeaderSize) return false;
+	if (get_u32(at) != DatagramProtocol) return false;
+	h->sequence = get_u16(at);
+	h->ack = get_u16(at);
+	h->ack_bits = get_u32(at);
+	h->reliable_ack = get_u32(at);
+	h->reliable_offset = get_u32(at);
+	h->state_size = get_u16(at);
+	h->reliable_size = get_u16(at);
+	h->flags = uint8_t(*at);
+	return DatagramHeaderSize + size_t(h->state_size) + size_t(h->reliable_size) == size;
+}
+
+//--------- sending ---------
+
+static void send_now(Socket socket, char const *address, uint32_t address_length, char const *data, size_t size) {
+	//datagram sockets either take the whole datagram or drop it; either way there's nothing more to do:
+	sendto(socket, data, int(size), 0, reinterpret_cast< struct sockaddr const * >(address), socklen_t(address_length));
+}
+
+//send a datagram, subject to simulated loss and delay:
+static void send_datagram(Datagram_Endpoint &endpoint, Network_Simulation const &simulation, Datagram_Channel const &channel, std::vector< char > const &data, double now) {
+	std::uniform_real_distribution< double > unit(0.0, 1.0);
+	if (simulation.loss > 0.0f && unit(endpoint.rng) < simulation.loss) return;
+	double delay = simulation.latency + simulation.jitter * unit(endpoint.rng);
+	if (delay > 0.0) {
+		endpoint.delayed.emplace_back();
+		Datagram_Endpoint::Delayed &d = endpoint.delayed.back();
+		d.time = now + delay;
+		d.address = channel.address;
+		d.address_length = channel.address_length;
+		d.data = data;
+		return;
+	}
+	send_now(endpoint.socket, channel.address.data(), channel.address_length, data.data(), data.size());
+}
+
+static void send_delayed(Datagram_Endpoint &endpoint, double now) {
+	for (auto d = endpoint.delayed.begin(); d != endpoint.delayed.end(); /* later */) {
+		if (d->time <= now) {
+			send_now(endpoint.socket, d->address.data(), d->address_length, d->data.data(), d->data.size());
+			d = endpoint.delayed.erase(d);
+		} else {
+			++d;
+		}
+	}
+}
+
+static Datagram_Header next_header(Datagram_Channel &channel, double now) {
+	Datagram_Header h;
+	h.sequence = channel.local_sequence++;
+	if (channel.received_any) {
+		h.flags |= HasAcks;
+		h.ack = channel.remote_sequence;
+		h.ack_bits = channel.remote_ack_bits;
+		h.reliable_ack = channel.reliable_received;
+	}
+	channel.ack_owed = false;
+
+	//remember the packet (anything it displaces was never acked):
+	Datagram_Channel::Sent &sent = channel.sent[h.sequence % channel.sent.size()];
+	if (sent.in_use && !sent.acked) channel.packets_lost += 1;
+	sent.sequence = h.sequence;
+	sent.in_use = true;
+	sent.acked = false;
+	sent.reliable = false;
+	sent.time = now;
+	channel.packets_sent += 1;
+	return h;
+}
+
+//send whatever 'c' has queued (new state, reliable data, or just acks):
+static void flush_channel(Datagram_Endpoint &endpoint, Network_Simulation const &simulation, Connection &c, double now) {
+	Datagram_Channel &channel = *c.datagram;
+
+	uint32_t in_flight = channel.reliable_next - channel.reliable_acked;
+	if (in_flight > 0) {
+		//retransmit timeout: go back to the first unacknowledged byte
+		double timeout = std::max(0.05, 3.0 * channel.rtt);
+		if (now - channel.reliable_progress_time > timeout) {
+			channel.reliable_next = channel.reliable_acked;
+			channel.reliable_progress_time = now;
+			channel.go_back_sequence = channel.local_sequence;
+		}
+	}
+
+	std::vector< char > data;
+	for (uint32_t count = 0; count < MaxDatagramsPerFlush; ++count) {
+		in_flight = channel.reliable_next - channel.reliable_acked;
+		size_t unsent = c.send_pending_bytes() - in_flight;
+
+		size_t state_size = 0;
+		if (channel.state_pending) {
+			state_size = channel.state.size() + (channel.state_shared ? channel.state_shared->size() : 0);
+		}
+		size_t reliable_size = std::min({ unsent, size_t(MaxReliableInFlight - std::min(MaxReliableInFlight, in_flight)), MaxDatagramState - state_size });
+
+		if (state_size == 0 && reliable_size == 0 && !channel.ack_owed) break;
+
+		Datagram_Header h = next_header(channel, now);
+		h.state_size = uint16_t(state_size);
+		h.reliable_size = uint16_t(reliable_size);
+		h.reliable_offset = channel.reliable_next;
+
+		data.resize(DatagramHeaderSize + state_size + reliable_size);
+		write_header(h, data.data());
+		char *at = data.data() + DatagramHeaderSize;
+		if (state_size) {
+			memcpy(at, channel.state.data(), channel.state.size());
+			at += channel.state.size();
+			if (channel.state_shared) {
+				memcpy(at, channel.state_shared->data(), channel.state_shared->size());
+				at += channel.state_shared->size();
+			}
+			channel.state_pending = false;
+			channel.state.clear();
+			channel.state_shared.reset();
+		}
+		if (reliable_size) {
+			channel.sent[h.sequence % channel.sent.size()].reliable = true;
+			c.copy_pending(in_flight, at, reliable_size);
+			if (in_flight == 0) channel.reliable_progress_time = now;
+			channel.reliable_next += uint32_t(reliable_size);
+		}
+
+		send_datagram(endpoint, simulation, channel, data, now);
+	}
+}
+
+bool Connection::send_state(void const *data, size_t size, std::shared_ptr< std::vector< char > const > const &shared) {
+	size_t total = size + (shared ? shared->size() : 0);
+	if (!datagram || total > MaxDatagramState) {
+		//TCP (or too big for one datagram): state is just part of the stream
+		send_raw(data, size);
+		if (shared) send_shared(shared);
+		if (!datagram) return true;
+		datagram->states_streamed += 1;
+		return false;
+	}
+	datagram->state.assign(reinterpret_cast< char const * >(data), reinterpret_cast< char const * >(data) + size);
+	datagram->state_shared = shared;
+	datagram->state_pending = true;
+	return true;
+}
+
+void send_datagram_disconnect(Connection &c) {
+	assert(c.datagram);
+	Datagram_Header h = next_header(*c.datagram, now_seconds());
+	h.flags |= Disconnect;
+	char data[DatagramHeaderSize];
+	write_header(h, data);
+	send_now(c.socket, c.datagram->address.data(), c.datagram->address_length, data, sizeof(data));
+}
+
+//--------- receiving ---------
+
+static void receive_datagram(char const *where, Connection &c, Datagram_Header const &h, char const *payload, double now, std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	Datagram_Channel &channel = *c.datagram;
+	channel.last_recv_time = now;
+	channel.packets_received += 1;
+	channel.ack_owed = true;
+
+	if (h.flags & Disconnect) {
+		std::cerr << "[" << where << "] peer disconnected." << std::endl; //INFO
+		//(not c.close(), which would tell the peer we're disconnecting)
+		if (channel.owns_socket) closesocket(c.socket);
+		c.socket = InvalidSocket;
+		c.close_reported = true;
+		if (on_event) on_event(&c, Connection::OnClose);
+		return;
+	}
+
+	//record the sequence number for our acks:
+	if (!channel.received_any) {
+		channel.received_any = true;
+		channel.remote_sequence = h.sequence;
+		channel.remote_ack_bits = 0;
+	} else if (sequence_newer(h.sequence, channel.remote_sequence)) {
+		//slide the window forward; the old newest packet lands at bit (shift - 1):
+		uint16_t shift = uint16_t(h.sequence - channel.remote_sequence);
+		uint32_t bits = (shift >= 32 ? 0 : (channel.remote_ack_bits << shift));
+		if (shift <= 32) bits |= (1u << (shift - 1));
+		channel.remote_ack_bits = bits;
+		channel.remote_sequence = h.sequence;
+	} else {
+		uint16_t back = uint16_t(channel.remote_sequence - h.sequence);
+		if (back >= 1 && back <= 32) channel.remote_ack_bits |= (1u << (back - 1));
+	}
+
+	if (h.flags & HasAcks) {
+		//acks of our packets:
+		for (uint32_t i = 0; i <= 32; ++i) {
+			if (i > 0 && !(h.ack_bits & (1u << (i - 1)))) continue;
+			uint16_t sequence = uint16_t(h.ack - i);
+			Datagram_Channel::Sent &sent = channel.sent[sequence % channel.sent.size()];
+			if (!sent.in_use || sent.acked || sent.sequence != sequence) continue;
+			sent.acked = true;
+			channel.packets_acked += 1;
+			if (i == 0) {
+				channel.rtt += (std::max(0.0, now - sent.time) - channel.rtt) * 0.1;
+			}
+		}
+
+		//fast retransmit: a packet with reliable data that the peer skipped over (while acking
+		// two newer ones) was probably lost, so go back without waiting for the timeout:
+		for (auto &sent : channel.sent) {
+			if (!sent.in_use || sent.acked || !sent.reliable) continue;
+			uint16_t behind = uint16_t(h.ack - sent.sequence);
+			if (behind < 3 || behind > 32) continue;
+			if (sequence_newer(channel.go_back_sequence, sent.sequence)) continue; //(already resent)
+			channel.reliable_next = channel.reliable_acked;
+			channel.go_back_sequence = channel.local_sequence;
+			break;
+		}
+
+		//cumulative ack of our reliable stream:
+		uint32_t advance = h.reliable_ack - channel.reliable_acked;
+		if (advance > 0 && advance <= c.send_pending_bytes()) {
+			c.consume_sent(advance);
+			uint32_t in_flight = channel.reliable_next - channel.reliable_acked;
+			channel.reliable_acked = h.reliable_ack;
+			if (advance > in_flight) channel.reliable_next = channel.reliable_acked; //(acked beyond a go-back)
+			channel.reliable_progress_time = now;
+		}
+	}
+
+	bool got = false;
+
+	//newest state wins:
+	if (h.state_size > 0) {
+		if (!channel.recv_state_any || sequence_newer(h.sequence, channel.recv_state_sequence)) {
+			c.recv_state.assign(payload, payload + h.state_size);
+			channel.recv_state_sequence = h.sequence;
+			channel.recv_state_any = true;
+			got = true;
+		}
+	}
+
+	//reliable stream, in order (anything past a gap is dropped and will be resent):
+	if (h.reliable_size > 0) {
+		uint32_t skip = channel.reliable_received - h.reliable_offset;
+		if (skip < h.reliable_size) {
+			c.recv_buffer.append(payload + h.state_size + skip, h.reliable_size - skip);
+			channel.reliable_received += h.reliable_size - skip;
+			got = true;
+		}
+	}
+
+	if (got && on_event) on_event(&c, Connection::OnRecv);
+}
+
+void poll_datagrams(
+	char const *where,
+	Datagram_Endpoint &endpoint,
+	Network_Simulation const &simulation,
+	std::list< Connection > &connections,
+	bool accept_new,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout) {
+
+	double now = now_seconds();
+
+	//send anything queued since the last poll:
+	for (auto &c : connections) {
+		if (c.socket == InvalidSocket || !c.datagram) continue;
+		flush_channel(endpoint, simulation, c, now);
+	}
+	send_delayed(endpoint, now);
+
+	{ //wait (until timeout, or the next delayed datagram is due) for data:
+		if (!endpoint.delayed.empty()) {
+			for (auto const &d : endpoint.delayed) {
+				timeout = std::min(timeout, std::max(0.0, d.time - now));
+			}
+		}
+		fd_set read_fds;
+		FD_ZERO(&read_fds);
+		FD_SET(endpoint.socket, &read_fds);
+		struct timeval tv;
+		tv.tv_sec = std::lround(std::floor(timeout));
+		tv.tv_usec = std::lround((timeout - std::floor(timeout)) * 1e6);
+		int ret = select(int(endpoint.socket) + 1, &read_fds, NULL, NULL, &tv);
+		if (ret < 0) {
+			std::cerr << "[" << where << "] Select returned an error; will attempt to read anyway." << std::endl;
+		}
+	}
+
+	now = now_seconds();
+
+	//read every waiting datagram:
+	while (true) {
+		char data[2048];
+		std::array< char, 128 > address;
+		socklen_t address_length = socklen_t(address.size());
+		ssize_t ret = recvfrom(endpoint.socket, data, int(sizeof(data)), 0, reinterpret_cast< struct sockaddr * >(address.data()), &address_length);
+		if (ret < 0) break; //(EAGAIN / EWOULDBLOCK, or an ICMP error from an earlier send -- nothing to do either way)
+
+		Datagram_Header h;
+		if (!read_header(data, size_t(ret), &h)) continue; //not one of ours
+
+		endpoint.key.assign(address.data(), address_length);
+		auto r = endpoint.refused.find(endpoint.key);
+		if (r != endpoint.refused.end()) {
+			r->second = now;
+			continue;
+		}
+		auto f = endpoint.peers.find(endpoint.key);
+		Connection *from = (f != endpoint.peers.end() ? f->second : nullptr);
+		//(a peer closed earlier this poll -- e.g. for sending a bad message -- stays closed until it is reaped,
+		// rather than its next datagram opening a second connection alongside the closed one)
+		if (from && from->socket == InvalidSocket) continue;
+		if (!from) {
+			if (!accept_new || (h.flags & Disconnect)) continue;
+			connections.emplace_back();
+			from = &connections.back();
+			open_datagram_channel(endpoint, *from, endpoint.socket, address.data(), uint32_t(address_length), false);
+			std::cerr << "[" << where << "] client connected (udp)." << std::endl; //INFO
+			if (on_event) on_event(from, Connection::OnOpen);
+			if (from->socket == InvalidSocket) { //(closed by the callback)
+				endpoint.refused.emplace(endpoint.key, now);
+				continue;
+			}
+		}
+		receive_datagram(where, *from, h, data + DatagramHeaderSize, now, on_event);
+	}
+
+	//drop peers that have gone quiet, and answer what arrived:
+	for (auto &c : connections) {
+		if (c.socket == InvalidSocket || !c.datagram) continue;
+		if (now - c.datagram->last_recv_time > DatagramTimeout) {
+			std::cerr << "[" << where << "] peer timed out, disconnecting." << std::endl;
+			c.close();
+			c.close_reported = true;
+			if (on_event) on_event(&c, Connection::OnClose);
+			continue;
+		}
+		flush_channel(endpoint, simulation, c, now);
+	}
+	for (auto r = endpoint.refused.begin(); r != endpoint.refused.end(); ) {
+		if (now - r->second > DatagramTimeout) r = endpoint.refused.erase(r);
+		else ++r;
+	}
+	send_delayed(endpoint, now);
+}
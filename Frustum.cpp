@@ -0,0 +1,107 @@
+#include "Frustum.hpp"
+
+#include <cassert>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+Frustum::Frustum(glm::mat4 const &world_to_clip) {
+	//(glm is column-major: row r is (m[0][r], m[1][r], m[2][r], m[3][r]))
+	auto row = [&world_to_clip](int r) {
+		return glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+	};
+	glm::vec4 x = row(0), y = row(1), z = row(2), w = row(3);
+	planes[0] = w + x; //left
+	planes[1] = w - x; //right
+	planes[2] = w + y; //bottom
+	planes[3] = w - y; //top
+	planes[4] = w + z; //near
+	planes[5] = w - z; //far
+}
+
+bool Frustum::intersects(glm::vec3 const &center, glm::vec3 const &extent) const {
+	for (glm::vec4 const &plane : planes) {
+		glm::vec3 normal = glm::vec3(plane);
+		//distance of the box's most-inside corner (scaled by the normal's length):
+		if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent) < 0.0f) return false;
+	}
+	return true;
+}
+
+Frustum::Side Frustum::classify(glm::vec3 const &center, glm::vec3 const &extent) const {
+	Side side = Inside;
+	for (glm::vec4 const &plane : planes) {
+		glm::vec3 normal = glm::vec3(plane);
+		float distance = glm::dot(normal, center) + plane.w;
+		float radius = glm::dot(glm::abs(normal), extent);
+		if (distance + radius < 0.0f) return Outside;
+		if (distance - radius < 0.0f) side = Intersecting;
+	}
+	return side;
+}
+
+void Frustum::Boxes::clear() {
+	center_x.clear(); center_y.clear(); center_z.clear();
+	extent_x.clear(); extent_y.clear(); extent_z.clear();
+}
+
+void Frustum::Boxes::push(glm::vec3 const &center, glm::vec3 const &extent) {
+	center_x.emplace_back(center.x); center_y.emplace_back(center.y); center_z.emplace_back(center.z);
+	extent_x.emplace_back(extent.x); extent_y.emplace_back(extent.y); extent_z.emplace_back(extent.z);
+}
+
+void Frustum::Boxes::push(glm::mat4x3 const &object_to_world, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 center = 0.5f * (max + min);
+	glm::vec3 extent = 0.5f * (max - min);
+	//(each world axis gets the absolute sum of the box's axes' contributions)
+	push(
+		object_to_world * glm::vec4(center, 1.0f),
+		glm::abs(object_to_world[0]) * extent.x + glm::abs(object_to_world[1]) * extent.y + glm::abs(object_to_world[2]) * extent.z
+	);
+}
+
+size_t Frustum::cull(Boxes const &boxes, size_t begin, size_t end, uint8_t *visible) const {
+	assert(begin <= end && end <= boxes.size());
+	size_t inside = 0;
+	size_t i = begin;
+#ifdef FRUSTUM_SSE
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const sign = _mm_set1_ps(-0.0f);
+	for (; i + 4 <= end; i += 4) {
+		__m128 cx = _mm_loadu_ps(&boxes.center_x[i]);
+		__m128 cy = _mm_loadu_ps(&boxes.center_y[i]);
+		__m128 cz = _mm_loadu_ps(&boxes.center_z[i]);
+		__m128 ex = _mm_loadu_ps(&boxes.extent_x[i]);
+		__m128 ey = _mm_loadu_ps(&boxes.extent_y[i]);
+		__m128 ez = _mm_loadu_ps(&boxes.extent_z[i]);
+		__m128 outside = _mm_setzero_ps(); //(lanes set where some plane has the whole box behind it)
+		for (glm::vec4 const &plane : planes) {
+			__m128 a = _mm_set1_ps(plane.x), b = _mm_set1_ps(plane.y), c = _mm_set1_ps(plane.z);
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+				_mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(plane.w))
+			);
+			__m128 radius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, a), ex), _mm_mul_ps(_mm_andnot_ps(sign, b), ey)),
+				_mm_mul_ps(_mm_andnot_ps(sign, c), ez)
+			);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+		int mask = _mm_movemask_ps(outside);
+		for (uint32_t lane = 0; lane < 4; ++lane) {
+			visible[i - begin + lane] = !(mask & (1 << lane));
+			inside += visible[i - begin + lane];
+		}
+	}
+#endif
+	for (; i < end; ++i) {
+		visible[i - begin] = intersects(
+			glm::vec3(boxes.center_x[i], boxes.center_y[i], boxes.center_z[i]),
+			glm::vec3(boxes.extent_x[i], boxes.extent_y[i], boxes.extent_z[i])
+		);
+		inside += visible[i - begin];
+	}
+	return inside;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+ * Frustum holds the six clip planes of a world_to_clip matrix, for culling world-space
+ *  axis-aligned boxes before they are drawn.
+ *
+ * The planes come straight from the matrix rows (Gribb & Hartmann): a point is inside where
+ *  row3 +/- row0, row3 +/- row1, and row3 +/- row2 are all non-negative. They aren't normalized,
+ *  since the box test only needs their signs; this also copes with the infinite far plane of
+ *  Scene::Camera's projection (whose far "plane" is a positive constant, so never culls).
+ *
+ * A box is culled if it lies entirely behind any one plane. (Boxes near a corner of the frustum
+ *  can pass without being inside it -- the usual conservative answer.)
+ *
+ * cull() takes boxes as a structure of arrays and tests four at a time with SSE where available
+ *  (a plain loop elsewhere).
+ */
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct Frustum {
+	explicit Frustum(glm::mat4 const &world_to_clip);
+
+	glm::vec4 planes[6]; //(a, b, c, d): inside where a*x + b*y + c*z + d >= 0
+
+	//is any of the box with 'center' and half-size 'extent' inside?
+	bool intersects(glm::vec3 const &center, glm::vec3 const &extent) const;
+	//...or, telling apart boxes entirely inside (for accepting whole groups of boxes at once):
+	enum Side : uint8_t { Outside, Intersecting, Inside };
+	Side classify(glm::vec3 const &center, glm::vec3 const &extent) const;
+
+	//world-space boxes, as structure-of-arrays:
+	struct Boxes {
+		std::vector< float > center_x, center_y, center_z;
+		std::vector< float > extent_x, extent_y, extent_z;
+
+		size_t size() const { return center_x.size(); }
+		void clear();
+		void push(glm::vec3 const &center, glm::vec3 const &extent);
+		//the box around a box of 'min'..'max' after 'object_to_world':
+		void push(glm::mat4x3 const &object_to_world, glm::vec3 const &min, glm::vec3 const &max);
+	};
+
+	//set visible[i] to whether boxes[i] intersects the frustum; returns how many do:
+	size_t cull(Boxes const &boxes, uint8_t *visible) const { return cull(boxes, 0, boxes.size(), visible); }
+	//...the same for boxes[begin] up to boxes[end] (writing visible[0] up to visible[end - begin]):
+	size_t cull(Boxes const &boxes, size_t begin, size_t end, uint8_t *visible) const;
+};
@@ -0,0 +1,47 @@
+#include "HeightMap.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+HeightMap::HeightMap(std::string const &filename) : mapping(filename, "height map") {
+	size_t header_size = 0;
+	char const *header = mapping.find_chunk("hmh1", &header_size);
+	if (!header || header_size != 24) throw std::runtime_error("Height map '" + filename + "' has no header chunk (re-run toheight.py?).");
+	uint32_t tile_size;
+	std::memcpy(&size, header, 4);
+	std::memcpy(&extent, header + 4, 4);
+	std::memcpy(&tile_size, header + 8, 4);
+	std::memcpy(&low, header + 16, 4);
+	std::memcpy(&high, header + 20, 4);
+	if (tile_size != TileSize || size < 2 || size % TileSize != 0) throw std::runtime_error("Height map '" + filename + "' has " + std::to_string(tile_size) + "-sample tiles over " + std::to_string(size) + " samples, expected " + std::to_string(TileSize) + "-sample tiles.");
+	tiles_per_row = size / TileSize;
+
+	size_t samples_size = 0;
+	char const *samples_data = mapping.find_chunk("hmt0", &samples_size);
+	if (!samples_data || samples_size != size_t(size) * size * sizeof(uint16_t)) throw std::runtime_error("Height map '" + filename + "' doesn't have " + std::to_string(size) + "x" + std::to_string(size) + " samples.");
+	if (reinterpret_cast< uintptr_t >(samples_data) % alignof(uint16_t) != 0) throw std::runtime_error("Height map '" + filename + "' has misaligned samples.");
+	samples = reinterpret_cast< uint16_t const * >(samples_data);
+}
+
+float HeightMap::height(glm::vec2 const &position, glm::vec2 *slope) const {
+	//bilinear between sample centers, clamped to the map:
+	float scale = float(size) / (2.0f * extent);
+	float max = float(size - 1);
+	float ax = std::max(0.0f, std::min(max, (position.x + extent) * scale - 0.5f));
+	float ay = std::max(0.0f, std::min(max, (position.y + extent) * scale - 0.5f));
+	uint32_t x = std::min(uint32_t(ax), size - 2);
+	uint32_t y = std::min(uint32_t(ay), size - 2);
+	float fx = ax - float(x);
+	float fy = ay - float(y);
+
+	float h00 = sample(x, y), h10 = sample(x + 1, y), h01 = sample(x, y + 1), h11 = sample(x + 1, y + 1);
+	float h0 = h00 + (h10 - h00) * fx;
+	float h1 = h01 + (h11 - h01) * fx;
+
+	float units = (high - low) / 65535.0f; //height per sample step
+	if (slope) {
+		*slope = glm::vec2(h10 - h00 + (h11 - h01 - h10 + h00) * fy, h1 - h0) * (units * scale);
+	}
+	return low + (h0 + (h1 - h0) * fy) * units;
+}
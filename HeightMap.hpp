@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * HeightMap is the ground height over the map, for keeping players on the terrain.
+ * It has size x size samples covering [-extent, extent] on x and y (the same grid as
+ *  CollisionMap, one sample at the center of each cell), each a uint16 from low to high.
+ *
+ * Samples are stored in TileSize x TileSize tiles (128 bytes each), so the four samples
+ *  a bilinear lookup reads are almost always in the same one or two cache lines.
+ *
+ * The map is baked offline by dist/map/toheight.py from heightmap.png and memory-mapped
+ *  read-only here, like CollisionMap; it has no GL or Scene dependencies either.
+ * toheight.py takes low and high from the ground mesh's z range in field.pnct / field.scene,
+ *  so heights here match the terrain as drawn.
+ */
+
+#include "MappedFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <cstdint>
+
+struct HeightMap {
+	static constexpr uint32_t TileSize = 8;
+
+	//map a file written by toheight.py:
+	// (throws std::runtime_error if the file is missing or malformed)
+	explicit HeightMap(std::string const &filename);
+
+	//ground height under 'position' (bilinear between samples; positions off the map see the nearest edge):
+	float height(glm::vec2 const &position) const { return height(position, nullptr); }
+	//...and the slope there (change in height per unit of x and of y) in 'slope':
+	float height(glm::vec2 const &position, glm::vec2 *slope) const;
+	//upward surface normal for a slope:
+	static glm::vec3 normal(glm::vec2 const &slope) { return glm::normalize(glm::vec3(-slope.x, -slope.y, 1.0f)); }
+
+	uint16_t sample(uint32_t x, uint32_t y) const {
+		return samples[((y / TileSize) * tiles_per_row + x / TileSize) * (TileSize * TileSize) + (y % TileSize) * TileSize + x % TileSize];
+	}
+
+	uint32_t size = 0;
+	float extent = 0.0f;
+	float low = 0.0f; //height of sample value 0
+	float high = 0.0f; //height of sample value 0xffff
+	uint32_t tiles_per_row = 0;
+	uint16_t const *samples = nullptr;
+
+	//the file 'samples' points into:
+	MappedFile mapping;
+};
@@ -0,0 +1,88 @@
+#include "Interpolation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//how hard the clock is pulled toward 'delay' behind the newest snapshot (per second of error):
+static constexpr double ClockGain = 0.5;
+//the most the clock may speed up or slow down:
+static constexpr double MaxClockSkew = 0.1;
+//further off than this (e.g., after a stall), just jump:
+static constexpr double MaxClockError = 0.25;
+
+void Interpolation_Clock::on_snapshot(double snapshot_time) {
+	newest = std::max(newest, snapshot_time);
+	if (!started) {
+		time = newest - delay;
+		started = true;
+	}
+}
+
+void Interpolation_Clock::advance(double elapsed) {
+	if (!started) return;
+	double target = newest - delay;
+	double error = target - (time + elapsed);
+	if (std::abs(error) > MaxClockError) {
+		time = target;
+		return;
+	}
+	double skew = std::max(-MaxClockSkew, std::min(MaxClockSkew, error * ClockGain));
+	time += elapsed * (1.0 + skew);
+}
+
+void Pose_Buffer::push(double time, glm::vec3 const &position, glm::quat const &rotation) {
+	if (!poses.empty() && time <= poses.back().time) return;
+	poses.emplace_back(Pose{time, position, rotation});
+	while (poses.size() > Capacity) poses.pop_front();
+}
+
+Pose_Buffer::Result Pose_Buffer::sample(double time, glm::vec3 *position, glm::quat *rotation) const {
+	if (poses.empty()) return Empty;
+
+	//find the first pose at or after 'time':
+	auto after = std::lower_bound(poses.begin(), poses.end(), time, [](Pose const &pose, double t) {
+		return pose.time < t;
+	});
+
+	if (after == poses.begin()) {
+		//(older than anything we have; only happens right after the first pose arrives)
+		*position = after->position;
+		*rotation = after->rotation;
+		return Interpolated;
+	}
+
+	if (after != poses.end()) {
+		Pose const &a = *(after - 1);
+		Pose const &b = *after;
+		if (glm::distance(a.position, b.position) > SnapDistance) {
+			*position = b.position;
+			*rotation = b.rotation;
+			return Interpolated;
+		}
+		float amt = float((time - a.time) / (b.time - a.time));
+		*position = glm::mix(a.position, b.position, amt);
+		*rotation = glm::slerp(a.rotation, b.rotation, amt);
+		return Interpolated;
+	}
+
+	//past the newest pose: keep going at its last velocity, for a little while:
+	Pose const &newest = poses.back();
+	*rotation = newest.rotation;
+	double ahead = time - newest.time;
+	glm::vec3 velocity = glm::vec3(0.0f);
+	if (poses.size() >= 2) {
+		Pose const &before = poses[poses.size() - 2];
+		if (glm::distance(before.position, newest.position) <= SnapDistance) {
+			velocity = (newest.position - before.position) / float(newest.time - before.time);
+		}
+	}
+	*position = newest.position + velocity * float(std::min(ahead, MaxExtrapolation));
+	return (ahead <= MaxExtrapolation ? Extrapolated : Held);
+}
+
+void Interpolation_Stats::add(Pose_Buffer::Result result) {
+	if (result == Pose_Buffer::Empty) return;
+	samples += 1;
+	if (result == Pose_Buffer::Extrapolated) extrapolated += 1;
+	if (result == Pose_Buffer::Held) held += 1;
+}
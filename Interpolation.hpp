@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * Snapshot interpolation for remote players.
+ *
+ * Snapshots arrive once per server tick (give or take network jitter) but frames are
+ *  drawn at whatever rate the client runs. So remote players are drawn slightly in the
+ *  past -- 'delay' seconds behind the newest snapshot -- where there usually are
+ *  snapshots on both sides to blend between:
+ *  - Interpolation_Clock is that playback time (in server seconds, tick * ServerTick).
+ *    It advances with real time, running slightly fast or slow to stay 'delay' behind
+ *    the snapshots as they arrive.
+ *  - Pose_Buffer holds one entity's recent poses and samples them at the playback time,
+ *    extrapolating for at most MaxExtrapolation seconds when the next snapshot is late.
+ */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <deque>
+#include <cstdint>
+
+struct Interpolation_Clock {
+	double delay = 0.1; //seconds behind the newest snapshot (two ticks covers one late or lost snapshot)
+
+	//a snapshot stamped 'snapshot_time' arrived:
+	void on_snapshot(double snapshot_time);
+	//real time passed:
+	void advance(double elapsed);
+
+	double time = 0.0; //playback time
+	double newest = 0.0; //time of the newest snapshot
+	bool started = false;
+};
+
+struct Pose_Buffer {
+	static constexpr size_t Capacity = 16;
+	static constexpr double MaxExtrapolation = 0.1; //seconds past the newest pose
+	static constexpr float SnapDistance = 1.0f; //poses further apart than this (teleports) aren't blended
+
+	enum Result : uint8_t {
+		Empty, //nothing to sample
+		Interpolated, //between two poses
+		Extrapolated, //past the newest pose, guessing from its velocity (an underrun)
+		Held, //past MaxExtrapolation; holding the last guess (an underrun)
+	};
+
+	//add a pose (ignored if it is not newer than the newest one):
+	void push(double time, glm::vec3 const &position, glm::quat const &rotation);
+	Result sample(double time, glm::vec3 *position, glm::quat *rotation) const;
+	void clear() { poses.clear(); }
+
+	struct Pose {
+		double time;
+		glm::vec3 position;
+		glm::quat rotation;
+	};
+	std::deque< Pose > poses; //oldest first
+};
+
+//how often sampling didn't have a pose on both sides:
+struct Interpolation_Stats {
+	void add(Pose_Buffer::Result result);
+	void reset() { *this = Interpolation_Stats(); }
+	uint32_t underruns() const { return extrapolated + held; }
+
+	uint32_t samples = 0;
+	uint32_t extrapolated = 0;
+	uint32_t held = 0;
+};
@@ -43,14 +43,37 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+Load< LitColorTextureProgram > lit_color_texture_program_instanced(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(true);
+
+	//----- add it to the pipeline template (the vao is per-mesh-buffer, so is left to the caller) -----
+	lit_color_texture_program_pipeline.instanced.program = ret->program;
+
+	lit_color_texture_program_pipeline.instanced.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
+	lit_color_texture_program_pipeline.instanced.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
+	lit_color_texture_program_pipeline.instanced.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+
+	return ret;
+});
+
+LitColorTextureProgram::LitColorTextureProgram(bool instanced_) : instanced(instanced_) {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
 		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		+ std::string(instanced ?
+			//(MeshBuffer::make_vao_for_program leaves INSTANCE_* attributes for Scene::RenderQueue to point at its instance buffer)
+			"in mat4 INSTANCE_OBJECT_TO_CLIP;\n"
+			"in mat4x3 INSTANCE_OBJECT_TO_LIGHT;\n"
+			"in mat3 INSTANCE_NORMAL_TO_LIGHT;\n"
+			"#define OBJECT_TO_CLIP INSTANCE_OBJECT_TO_CLIP\n"
+			"#define OBJECT_TO_LIGHT INSTANCE_OBJECT_TO_LIGHT\n"
+			"#define NORMAL_TO_LIGHT INSTANCE_NORMAL_TO_LIGHT\n"
+		:
+			"uniform mat4 OBJECT_TO_CLIP;\n"
+			"uniform mat4x3 OBJECT_TO_LIGHT;\n"
+			"uniform mat3 NORMAL_TO_LIGHT;\n"
+		) +
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -115,10 +138,16 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	//look up the locations of uniforms (per-instance attributes for the instanced variant):
+	if (instanced) {
+		OBJECT_TO_CLIP_mat4 = glGetAttribLocation(program, "INSTANCE_OBJECT_TO_CLIP");
+		OBJECT_TO_LIGHT_mat4x3 = glGetAttribLocation(program, "INSTANCE_OBJECT_TO_LIGHT");
+		NORMAL_TO_LIGHT_mat3 = glGetAttribLocation(program, "INSTANCE_NORMAL_TO_LIGHT");
+	} else {
+		OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
+		OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
+		NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	}
 
 	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
 	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
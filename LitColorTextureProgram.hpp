@@ -5,11 +5,13 @@
 #include "Scene.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
+// the 'instanced' variant reads its object matrices per instance (see Scene::RenderQueue) rather than from uniforms
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	LitColorTextureProgram(bool instanced = false);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
+	bool instanced = false;
 
 	//Attribute (per-vertex variable) locations:
 	GLuint Position_vec4 = -1U;
@@ -18,6 +20,7 @@ struct LitColorTextureProgram {
 	GLuint TexCoord_vec2 = -1U;
 
 	//Uniform (per-invocation variable) locations:
+	// (for the instanced variant, these three are attribute locations instead; each matrix column takes one location)
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
@@ -34,7 +37,9 @@ struct LitColorTextureProgram {
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+extern Load< LitColorTextureProgram > lit_color_texture_program_instanced;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: to let Scene::draw batch copies of a mesh, also set pipeline.instanced.vao (a vao made for lit_color_texture_program_instanced->program)
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
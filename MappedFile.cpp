@@ -0,0 +1,76 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX 1
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename, std::string const &what) {
+	#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open " + what + " '" + filename + "'.");
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		throw std::runtime_error("The " + what + " '" + filename + "' is empty.");
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void const *view = (mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr);
+	if (mapping) CloseHandle(mapping); //(the view keeps the mapping alive)
+	CloseHandle(file);
+	if (!view) throw std::runtime_error("Failed to map " + what + " '" + filename + "'.");
+	size = size_t(file_size.QuadPart);
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("Failed to open " + what + " '" + filename + "': " + std::string(strerror(errno)));
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw std::runtime_error("The " + what + " '" + filename + "' is empty.");
+	}
+	void *view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); //(the mapping stays valid)
+	if (view == MAP_FAILED) throw std::runtime_error("Failed to map " + what + " '" + filename + "': " + std::string(strerror(errno)));
+	size = size_t(st.st_size);
+	#endif
+	data = reinterpret_cast< char const * >(view);
+}
+
+MappedFile::~MappedFile() {
+	if (!data) return;
+	#ifdef _WIN32
+	UnmapViewOfFile(data);
+	#else
+	munmap(const_cast< char * >(data), size);
+	#endif
+}
+
+char const *MappedFile::find_chunk(char const *magic, size_t *chunk_size) const {
+	size_t at = 0;
+	while (at + 8 <= size) {
+		uint32_t length;
+		std::memcpy(&length, data + at + 4, 4);
+		if (at + 8 + length > size) break;
+		if (std::memcmp(data + at, magic, 4) == 0) {
+			*chunk_size = length;
+			return data + at + 8;
+		}
+		at += 8 + length;
+	}
+	return nullptr;
+}
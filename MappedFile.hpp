@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file read-only into memory, for the baked binary
+ *  maps (CollisionMap, HeightMap) that are used in place rather than parsed.
+ * The pages are shared by every process that maps the same file.
+ *
+ * The maps are made of chunks as laid out by read_write_chunk.hpp:
+ *  four byte magic, four byte (native endian) size, then the data.
+ */
+
+#include <string>
+#include <cstddef>
+
+struct MappedFile {
+	//map 'filename'; throws std::runtime_error (naming it as 'what', e.g. "collision map") on failure:
+	MappedFile(std::string const &filename, std::string const &what);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	//data of the first chunk with 'magic' (and its size), or nullptr if there isn't one:
+	char const *find_chunk(char const *magic, size_t *chunk_size) const;
+
+	char const *data = nullptr;
+	size_t size = 0;
+};
@@ -140,6 +140,8 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 		GLenum type = 0;
 		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
 		name[99] = '\0';
+		//(per-instance attributes are pointed at an instance buffer when drawing -- see Scene::RenderQueue)
+		if (std::string(name).compare(0, 9, "INSTANCE_") == 0) continue;
 		GLint location = glGetAttribLocation(program, name);
 		if (!bound.count(GLuint(location))) {
 			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
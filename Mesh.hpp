@@ -40,6 +40,7 @@ struct MeshBuffer {
 	
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
+	//  (other than per-instance attributes, named INSTANCE_*, which are left unbound)
 	GLuint make_vao_for_program(GLuint program) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
@@ -0,0 +1,189 @@
+#include "Movement.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr float Acceleration = 10.0f;
+static constexpr float Damp = 20.0f;
+static constexpr float WalkingSpeedMax = 2.0f;
+static constexpr float AngleSpeed = 720.0f;
+//how far from a wall a sweep stops, and how many times one step may slide along walls:
+static constexpr float ContactSkin = 1e-3f;
+static constexpr uint32_t MaxSlides = 2;
+
+void Movement_Input::set_direction(glm::vec2 const &direction) {
+	for (uint32_t i = 0; i < 2; ++i) {
+		move[i] = int8_t(std::lround(std::max(-1.0f, std::min(1.0f, direction[i])) * 127.0f));
+	}
+}
+
+glm::vec2 Movement_Input::direction() const {
+	glm::vec2 d = glm::vec2(float(move[0]), float(move[1]));
+	if (d == glm::vec2(0.0f)) return d;
+	//(normalized here so that a client can't walk faster by sending longer vectors)
+	return glm::normalize(d);
+}
+
+glm::quat Movement_State::rotation() const {
+	return glm::angleAxis(glm::radians(current_angle), glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+void step_movement(Movement_State *state, glm::vec2 direction, float elapsed, CollisionMap const *collision) {
+	glm::vec3 &velocity = state->velocity;
+	float &current_angle = state->current_angle;
+	float &target_angle = state->target_angle;
+
+	if (direction != glm::vec2(0.0f)) {
+		//update velocity
+		velocity += glm::vec3(direction, 0.0f) * Acceleration * elapsed;
+		if (glm::length(velocity) > WalkingSpeedMax) {
+			velocity = WalkingSpeedMax * glm::normalize(velocity);
+		}
+
+		//update target angle
+		target_angle = glm::degrees(glm::atan(velocity.y, velocity.x)) - 90.0f;
+	}
+	//decrease velocity using damping
+	else {
+		if (velocity != glm::vec3(0.0f)) {
+			glm::vec3 damped_velocity = velocity - glm::normalize(velocity) * Damp * elapsed;
+
+			// make sure damping does not change the direction
+			if ((velocity.x > 0 && damped_velocity.x < 0) || (velocity.x < 0 && damped_velocity.x > 0))
+				damped_velocity.x = 0.0f;
+			if ((velocity.y > 0 && damped_velocity.y < 0) || (velocity.y < 0 && damped_velocity.y > 0))
+				damped_velocity.y = 0.0f;
+
+			velocity = damped_velocity;
+		}
+	}
+
+	//update current angle
+	target_angle = std::fmod(target_angle + 360.0f, 360.0f);
+	if (target_angle > current_angle) {
+		if (target_angle - current_angle < 180.0f) {
+			current_angle = std::min(current_angle + AngleSpeed * elapsed, target_angle);
+		}
+		else {
+			current_angle = std::max(current_angle - AngleSpeed * elapsed, target_angle - 360.0f);
+		}
+	}
+	else {
+		if (current_angle - target_angle < 180.0f) {
+			current_angle = std::max(current_angle - AngleSpeed * elapsed, target_angle);
+		}
+		else {
+			current_angle = std::min(current_angle + AngleSpeed * elapsed, target_angle + 360.0f);
+		}
+	}
+	current_angle = std::fmod(current_angle + 360.0f, 360.0f);
+
+	//update position, sliding along walls rather than stopping dead at (or tunneling through) them
+	glm::vec2 position = glm::vec2(state->position.x, state->position.y);
+	glm::vec2 motion = glm::vec2(velocity.x, velocity.y) * elapsed;
+	for (uint32_t pass = 0; pass < MaxSlides && motion != glm::vec2(0.0f); ++pass) {
+		CollisionMap::Hit hit;
+		if (!collision || !collision->sweep(position, position + motion, &hit)) {
+			position += motion;
+			motion = glm::vec2(0.0f);
+			break;
+		}
+		//stop just short of the wall (measured along its normal, so grazing motion doesn't creep into it)...
+		float approach = -glm::dot(motion, hit.normal);
+		float t = (approach > 0.0f ? std::max(0.0f, hit.t - ContactSkin / approach) : 0.0f);
+		position += motion * t;
+		//...and carry on along it with what's left, no longer pushing into it:
+		motion *= (1.0f - t);
+		motion -= hit.normal * glm::dot(motion, hit.normal);
+		float into = glm::dot(glm::vec2(velocity.x, velocity.y), hit.normal);
+		if (into < 0.0f) {
+			velocity -= glm::vec3(hit.normal * into, 0.0f);
+		}
+	}
+
+	//keep the whole body (not just its center) out of walls; one distance sample says how far in and which way is out:
+	if (collision) {
+		glm::vec2 normal;
+		float clearance = collision->distance(position, &normal);
+		if (clearance < PlayerRadius && normal != glm::vec2(0.0f)) {
+			glm::vec2 pushed = position + normal * (PlayerRadius - clearance);
+			//(in gaps narrower than the body, don't get pushed across the middle or through a wall)
+			CollisionMap::Hit hit;
+			if (collision->distance(pushed) > clearance && !collision->sweep(position, pushed, &hit)) {
+				position = pushed;
+			}
+			float into = glm::dot(glm::vec2(velocity.x, velocity.y), normal);
+			if (into < 0.0f) {
+				velocity -= glm::vec3(normal * into, 0.0f);
+			}
+		}
+	}
+
+	state->position.x = position.x;
+	state->position.y = position.y;
+}
+
+void apply_portals(Movement_State *state, uint8_t flags) {
+	static constexpr float TeleportDistance = 0.75f; //(PlayMode teleports within 0.5, plus some slack)
+	static constexpr uint8_t BothPlaced = Movement_Input::PlacePortal1 | Movement_Input::PlacePortal2;
+	if (flags & Movement_Input::PlacePortal1) state->portal1 = state->position;
+	if (flags & Movement_Input::PlacePortal2) state->portal2 = state->position;
+	state->portals_placed |= (flags & BothPlaced);
+	if (state->portals_placed != BothPlaced) return;
+
+	//(only x and y are simulated -- height is wherever the ground is, which the client and server find separately --
+	// so portals are compared and teleported to on the ground plane, and z is left alone)
+	glm::vec2 at = glm::vec2(state->position.x, state->position.y);
+	glm::vec2 portal1 = glm::vec2(state->portal1.x, state->portal1.y);
+	glm::vec2 portal2 = glm::vec2(state->portal2.x, state->portal2.y);
+	if ((flags & Movement_Input::TeleportToPortal2) && glm::length(at - portal1) < TeleportDistance) {
+		state->position.x = portal2.x;
+		state->position.y = portal2.y;
+	}
+	else if ((flags & Movement_Input::TeleportToPortal1) && glm::length(at - portal2) < TeleportDistance) {
+		state->position.x = portal1.x;
+		state->position.y = portal1.y;
+	}
+}
+
+Movement_Input const &Movement_Predictor::step(glm::vec2 direction, uint8_t flags, uint32_t time_ms, CollisionMap const *collision) {
+	Movement_Input input;
+	input.sequence = next_sequence++;
+	input.time_ms = time_ms;
+	input.set_direction(direction);
+	input.flags = flags;
+
+	//(use the quantized direction, so we walk exactly where the server will)
+	apply_portals(&state, input.flags);
+	step_movement(&state, input.direction(), MovementStep, collision);
+
+	pending.emplace_back(input);
+	//(a server that stops acknowledging shouldn't make us grow forever)
+	if (pending.size() > MaxPendingInputs) pending.pop_front();
+	return pending.back();
+}
+
+float Movement_Predictor::reconcile(uint32_t last_input, Movement_State const &server_state, CollisionMap const *collision) {
+	while (!pending.empty() && pending.front().sequence <= last_input) {
+		pending.pop_front();
+	}
+
+	glm::vec3 old_displayed = displayed_position();
+	glm::vec3 old_position = state.position;
+
+	//rewind to the server's state and replay what it hasn't seen yet:
+	state = server_state;
+	for (Movement_Input const &input : pending) {
+		apply_portals(&state, input.flags);
+		step_movement(&state, input.direction(), MovementStep, collision);
+	}
+
+	correction = old_displayed - state.position;
+	if (glm::length(correction) > SnapDistance) correction = glm::vec3(0.0f);
+	return glm::distance(old_position, state.position);
+}
+
+void Movement_Predictor::update_correction(float elapsed) {
+	correction *= std::exp(-elapsed / CorrectionTime);
+	if (glm::length(correction) < 1e-4f) correction = glm::vec3(0.0f);
+}
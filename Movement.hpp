@@ -0,0 +1,91 @@
+#pragma once
+
+/*
+ * Movement is the player walking simulation.
+ * The client (CharacterController) and the server both step it, so the server
+ *  can simulate players from their inputs instead of trusting their positions.
+ *
+ * Movement advances in fixed steps of MovementStep seconds; each step consumes
+ *  one Movement_Input, numbered so that client and server agree on which step is which.
+ */
+
+#include "CollisionMap.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <deque>
+#include <cstdint>
+
+constexpr float MovementStep = 1.0f / 60.0f;
+//players are kept this far from walls (and from each other, by CollisionSystem):
+constexpr float PlayerRadius = 0.15f;
+
+struct Movement_Input {
+	uint32_t sequence = 0; //one more than the previous step's input (zero is never used)
+	uint32_t time_ms = 0; //client clock when the input was sampled
+	int8_t move[2] = {0, 0}; //world-space walking direction, scaled by 127
+	uint8_t flags = 0;
+
+	enum Flag : uint8_t {
+		TeleportToPortal1 = (1 << 0), //stepped into portal 2 (applied before walking)
+		TeleportToPortal2 = (1 << 1), //stepped into portal 1 (applied before walking)
+		PlacePortal1 = (1 << 2), //put portal 1 where we stand (applied before teleporting)
+		PlacePortal2 = (1 << 3), //put portal 2 where we stand (applied before teleporting)
+	};
+
+	void set_direction(glm::vec2 const &direction);
+	glm::vec2 direction() const; //unit length (or zero), whatever the client sent
+};
+
+struct Movement_State {
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 velocity = glm::vec3(0.0f);
+	float current_angle = 0.0f; //degrees around z
+	float target_angle = 0.0f;
+
+	//portals go where the simulation has the player when it places them, so clients can't put them anywhere else:
+	glm::vec3 portal1 = glm::vec3(0.0f);
+	glm::vec3 portal2 = glm::vec3(0.0f);
+	uint8_t portals_placed = 0; //Movement_Input::PlacePortal1 and/or PlacePortal2, once placed
+
+	glm::quat rotation() const;
+};
+
+//walk for 'elapsed' seconds in 'direction' (unit length, or zero to slow down),
+// sliding along the walls of 'collision' (if given) and keeping PlayerRadius away from them:
+void step_movement(Movement_State *state, glm::vec2 direction, float elapsed, CollisionMap const *collision);
+
+//place portals, then teleport, according to an input's flags
+// (teleporting only if both portals are placed and 'state' really is standing in the portal it left from;
+//  like walking, this only changes x and y):
+void apply_portals(Movement_State *state, uint8_t flags);
+
+//Client-side prediction of the local player:
+// every step is simulated immediately and kept until the server says it has simulated it too.
+// When a server state arrives, the prediction is rewound to it and the unacknowledged inputs are replayed;
+//  the difference from the old prediction becomes a 'correction' offset that fades out over CorrectionTime,
+//  so mispredictions don't show up as snapping.
+struct Movement_Predictor {
+	static constexpr size_t MaxPendingInputs = 256;
+	static constexpr float CorrectionTime = 0.1f; //seconds for the correction to fall to 1/e
+	static constexpr float SnapDistance = 1.0f; //corrections bigger than this aren't smoothed
+
+	//simulate one MovementStep and remember its input (which is returned, with its sequence filled in):
+	Movement_Input const &step(glm::vec2 direction, uint8_t flags, uint32_t time_ms, CollisionMap const *collision);
+
+	//the server simulated inputs up to 'last_input', ending up at 'server_state':
+	// (returns the distance between the old and the new prediction)
+	float reconcile(uint32_t last_input, Movement_State const &server_state, CollisionMap const *collision);
+
+	//fade out the correction:
+	void update_correction(float elapsed);
+
+	//where to draw the player:
+	glm::vec3 displayed_position() const { return state.position + correction; }
+
+	Movement_State state;
+	glm::vec3 correction = glm::vec3(0.0f);
+	std::deque< Movement_Input > pending; //inputs not yet simulated by the server, oldest first
+	uint32_t next_sequence = 1;
+};
@@ -0,0 +1,229 @@
+#include "NavGrid.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+glm::ivec2 const NavGrid::Directions[8] = {
+	glm::ivec2( 1, 0), glm::ivec2( 1, 1), glm::ivec2( 0, 1), glm::ivec2(-1, 1),
+	glm::ivec2(-1, 0), glm::ivec2(-1,-1), glm::ivec2( 0,-1), glm::ivec2( 1,-1),
+};
+
+NavGrid::NavGrid(CollisionMap const &map_, float radius_) : map(map_), radius(radius_) {
+	assert(map.size % NodeCells == 0);
+	size = map.size / NodeCells;
+	extent = map.extent;
+	node_size = 2.0f * extent / float(size);
+
+	std::vector< uint8_t > open(size_t(size) * size);
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			open[y * size + x] = map.distance(center(glm::ivec2(x, y))) >= radius;
+		}
+	}
+
+	//link each node to the open neighbors it can walk straight to, both ways at once so links are symmetric:
+	links.assign(size_t(size) * size, 0);
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			if (!open[y * size + x]) continue;
+			glm::ivec2 at = glm::ivec2(x, y);
+			for (uint32_t d = 0; d < 4; ++d) {
+				glm::ivec2 to = at + Directions[d];
+				if (to.x < 0 || to.y < 0 || uint32_t(to.x) >= size || uint32_t(to.y) >= size) continue;
+				if (!open[uint32_t(to.y) * size + uint32_t(to.x)]) continue;
+				if (!clear_line(center(at), center(to))) continue;
+				links[y * size + x] |= uint8_t(1 << d);
+				links[uint32_t(to.y) * size + uint32_t(to.x)] |= uint8_t(1 << (d + 4));
+			}
+		}
+	}
+
+	//label connected regions (flood fill over the links):
+	regions.assign(size_t(size) * size, 0);
+	std::vector< uint32_t > stack;
+	for (uint32_t i = 0; i < size * size; ++i) {
+		if (!open[i] || regions[i]) continue;
+		region_count += 1;
+		regions[i] = region_count;
+		stack.emplace_back(i);
+		while (!stack.empty()) {
+			uint32_t n = stack.back();
+			stack.pop_back();
+			glm::ivec2 at = glm::ivec2(n % size, n / size);
+			for (uint32_t d = 0; d < 8; ++d) {
+				if (!(links[n] & (1 << d))) continue;
+				glm::ivec2 to = at + Directions[d];
+				uint32_t t = uint32_t(to.y) * size + uint32_t(to.x);
+				if (regions[t]) continue;
+				regions[t] = region_count;
+				stack.emplace_back(t);
+			}
+		}
+	}
+}
+
+glm::ivec2 NavGrid::node(glm::vec2 const &position) const {
+	return glm::ivec2(int32_t(std::floor((position.x + extent) / node_size)), int32_t(std::floor((position.y + extent) / node_size)));
+}
+
+glm::vec2 NavGrid::center(glm::ivec2 const &node) const {
+	return (glm::vec2(node) + glm::vec2(0.5f)) * node_size - glm::vec2(extent);
+}
+
+bool NavGrid::clear_line(glm::vec2 const &a, glm::vec2 const &b) const {
+	//trace in a fixed order, so a line is clear both ways or neither:
+	bool forward = (a.x < b.x || (a.x == b.x && a.y <= b.y));
+	glm::vec2 const &from = (forward ? a : b);
+	glm::vec2 const &to = (forward ? b : a);
+
+	//sphere-trace the distance field: nothing is within (distance - radius) of a sample,
+	// so the body can safely skip that far ahead (but always at least MinStep, to make progress):
+	float const MinStep = 0.5f * (2.0f * extent / float(map.size));
+	float length = glm::length(to - from);
+	glm::vec2 direction = (length > 0.0f ? (to - from) / length : glm::vec2(0.0f));
+	float t = 0.0f;
+	while (true) {
+		float gap = map.distance(from + direction * t) - radius;
+		if (gap < 0.0f) return false;
+		if (t >= length) return true;
+		t = std::min(length, t + std::max(gap, MinStep));
+	}
+}
+
+bool NavGrid::nearest_walkable(glm::vec2 const &position, glm::ivec2 *found) const {
+	glm::ivec2 at = node(position);
+	if (walkable(at)) {
+		*found = at;
+		return true;
+	}
+	constexpr int32_t Reach = 2;
+	float best = std::numeric_limits< float >::infinity();
+	for (int32_t dy = -Reach; dy <= Reach; ++dy) {
+		for (int32_t dx = -Reach; dx <= Reach; ++dx) {
+			glm::ivec2 n = at + glm::ivec2(dx, dy);
+			if (!walkable(n)) continue;
+			glm::vec2 offset = center(n) - position;
+			float distance2 = glm::dot(offset, offset);
+			if (distance2 < best) {
+				best = distance2;
+				*found = n;
+			}
+		}
+	}
+	return best != std::numeric_limits< float >::infinity();
+}
+
+bool NavGrid::find_route(glm::ivec2 const &from, glm::ivec2 const &to, Search *search, std::vector< glm::vec2 > *waypoints) const {
+	waypoints->clear();
+	search->expanded = 0;
+	uint32_t region_from = region(from);
+	if (region_from == 0 || region_from != region(to)) return false;
+	uint32_t start = uint32_t(from.y) * size + uint32_t(from.x);
+	uint32_t goal = uint32_t(to.y) * size + uint32_t(to.x);
+	if (start == goal) {
+		waypoints->emplace_back(center(from));
+		return true;
+	}
+
+	//scratch arrays are only "cleared" by bumping the generation:
+	if (search->visited.size() != size_t(size) * size) {
+		search->cost.assign(size_t(size) * size, 0.0f);
+		search->parent.assign(size_t(size) * size, 0);
+		search->visited.assign(size_t(size) * size, 0);
+		search->generation = 0;
+	}
+	search->generation += 1;
+	if (search->generation == 0) {
+		std::fill(search->visited.begin(), search->visited.end(), 0);
+		search->generation = 1;
+	}
+	uint32_t const generation = search->generation;
+
+	//octile distance, in nodes (exact on an open 8-connected grid):
+	constexpr float Diagonal = 1.41421356f;
+	auto estimate = [&](uint32_t n) {
+		float dx = std::abs(float(int32_t(n % size) - to.x));
+		float dy = std::abs(float(int32_t(n / size) - to.y));
+		//(scaled up a hair, so that among equally good nodes the ones nearer the goal come first)
+		return (std::max(dx, dy) + (Diagonal - 1.0f) * std::min(dx, dy)) * 1.001f;
+	};
+	//(min-heap on estimated total cost)
+	auto later = [](std::pair< float, uint32_t > const &a, std::pair< float, uint32_t > const &b) {
+		return a.first > b.first;
+	};
+
+	auto &open = search->open;
+	open.clear();
+	search->visited[start] = generation;
+	search->cost[start] = 0.0f;
+	search->parent[start] = start;
+	open.emplace_back(estimate(start), start);
+	bool reached = false;
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), later);
+		auto [f, n] = open.back();
+		open.pop_back();
+		float g = search->cost[n];
+		if (f > g + estimate(n) + 1e-4f) continue; //(stale entry: n was reached more cheaply since)
+		if (n == goal) {
+			reached = true;
+			break;
+		}
+		search->expanded += 1;
+		glm::ivec2 at = glm::ivec2(n % size, n / size);
+		for (uint32_t d = 0; d < 8; ++d) {
+			if (!(links[n] & (1 << d))) continue;
+			glm::ivec2 next = at + Directions[d];
+			uint32_t m = uint32_t(next.y) * size + uint32_t(next.x);
+			float cost = g + (d & 1 ? Diagonal : 1.0f);
+			if (search->visited[m] == generation && search->cost[m] <= cost) continue;
+			search->visited[m] = generation;
+			search->cost[m] = cost;
+			search->parent[m] = n;
+			open.emplace_back(cost + estimate(m), m);
+			std::push_heap(open.begin(), open.end(), later);
+		}
+	}
+	if (!reached) return false; //(can't happen within a region, but just in case)
+
+	//walk back to the start, then pull the path taut: from each waypoint, skip ahead past
+	// every node the body can reach in a straight line:
+	std::vector< uint32_t > nodes;
+	for (uint32_t n = goal; n != start; n = search->parent[n]) nodes.emplace_back(n);
+	nodes.emplace_back(start);
+	std::reverse(nodes.begin(), nodes.end());
+	auto center_of = [&](uint32_t n) { return center(glm::ivec2(n % size, n / size)); };
+
+	glm::vec2 anchor = center_of(start);
+	waypoints->emplace_back(anchor);
+	for (size_t i = 1; i + 1 < nodes.size(); ++i) {
+		if (clear_line(anchor, center_of(nodes[i + 1]))) continue;
+		anchor = center_of(nodes[i]);
+		waypoints->emplace_back(anchor);
+	}
+	waypoints->emplace_back(center_of(goal));
+	return true;
+}
+
+bool NavGrid::find_path(glm::vec2 const &start, glm::vec2 const &goal, Search *search, std::vector< glm::vec2 > *path) const {
+	path->clear();
+	glm::ivec2 from, to;
+	if (!nearest_walkable(start, &from) || !nearest_walkable(goal, &to)) return false;
+	std::vector< glm::vec2 > route;
+	if (!find_route(from, to, search, &route)) return false;
+	finish_path(start, route, goal, path);
+	return true;
+}
+
+void NavGrid::finish_path(glm::vec2 const &start, std::vector< glm::vec2 > const &route, glm::vec2 const &goal, std::vector< glm::vec2 > *path) const {
+	//the route runs between node centers, but the start and goal are usually elsewhere in those nodes,
+	// so skip the waypoints at either end that the body can walk straight past:
+	size_t first = 0;
+	while (first < route.size() && clear_line(start, (first + 1 < route.size() ? route[first + 1] : goal))) first += 1;
+	size_t last = route.size();
+	while (last > first + 1 && clear_line(route[last - 2], goal)) last -= 1;
+	path->assign(route.begin() + first, route.begin() + last);
+	path->emplace_back(goal);
+}
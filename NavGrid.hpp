@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ * NavGrid is a coarse navigation grid over a CollisionMap, for finding walking routes
+ *  (for server-driven NPCs and bots) that a player-sized body can actually follow.
+ *
+ * Each node covers NodeCells x NodeCells map cells. A node is walkable if a body of
+ *  'radius' fits at its center, and it links to each of its eight neighbors if the body
+ *  can walk straight between the two centers. Both tests sphere-trace the map's distance
+ *  field, so building the grid reads no wall bits at all.
+ * Nodes are also labeled by connected region, so a query between two regions fails at once
+ *  rather than searching everything reachable from the start.
+ *
+ * find_path() runs A* over the links (octile heuristic, binary heap), then pulls the node
+ *  path taut by skipping every waypoint the body can walk past in a straight line.
+ * The grid is read-only after construction, so any number of threads can search it at once,
+ *  each with its own Search scratch (see Pathfinder.hpp for a pool that does this).
+ */
+
+#include "CollisionMap.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct NavGrid {
+	static constexpr uint32_t NodeCells = 16; //map cells per node side (so 128x128 nodes over a 2048x2048 map)
+
+	//build from 'map' for bodies of 'radius' (the map must outlive the grid):
+	NavGrid(CollisionMap const &map, float radius);
+
+	//node containing 'position' (may be off the grid), and the center of a node:
+	glm::ivec2 node(glm::vec2 const &position) const;
+	glm::vec2 center(glm::ivec2 const &node) const;
+	bool walkable(glm::ivec2 const &node) const { return region(node) != 0; }
+	uint32_t region(glm::ivec2 const &node) const {
+		if (node.x < 0 || node.y < 0 || uint32_t(node.x) >= size || uint32_t(node.y) >= size) return 0;
+		return regions[uint32_t(node.y) * size + uint32_t(node.x)];
+	}
+
+	//can the body walk in a straight line from 'from' to 'to' without touching a wall?
+	bool clear_line(glm::vec2 const &from, glm::vec2 const &to) const;
+
+	//per-thread scratch space for find_path(), reused between queries:
+	struct Search {
+		std::vector< float > cost; //from the start, valid where visited[node] == generation
+		std::vector< uint32_t > parent;
+		std::vector< uint32_t > visited;
+		std::vector< std::pair< float, uint32_t > > open; //(estimated total cost, node) heap
+		uint32_t generation = 0;
+		uint32_t expanded = 0; //nodes expanded by the last query
+	};
+
+	//route from 'start' to 'goal' as waypoints after 'start' (ending with 'goal');
+	// returns false (and leaves 'path' empty) if there is no route:
+	bool find_path(glm::vec2 const &start, glm::vec2 const &goal, Search *search, std::vector< glm::vec2 > *path) const;
+	//the same between nodes, as taut waypoints from the center of one to the center of the other:
+	bool find_route(glm::ivec2 const &from, glm::ivec2 const &to, Search *search, std::vector< glm::vec2 > *waypoints) const;
+	//turn a route between the nodes nearest 'start' and 'goal' into a path between them:
+	void finish_path(glm::vec2 const &start, std::vector< glm::vec2 > const &route, glm::vec2 const &goal, std::vector< glm::vec2 > *path) const;
+	//a walkable node within a couple of nodes of 'position' (nearest first), or false if there isn't one:
+	bool nearest_walkable(glm::vec2 const &position, glm::ivec2 *node) const;
+
+	CollisionMap const &map;
+	float radius;
+	uint32_t size = 0; //nodes per side
+	float extent = 0.0f; //(same as the map's)
+	float node_size = 0.0f; //world units per node side
+
+	//per node, row-major:
+	std::vector< uint8_t > links; //bit d set if the body can step to neighbor Directions[d]
+	std::vector< uint32_t > regions; //connected region (0 for unwalkable nodes)
+	uint32_t region_count = 0;
+
+	static glm::ivec2 const Directions[8];
+};
@@ -1,8 +1,10 @@
 #include "NetworkPlayer.hpp"
 
-size_t Client_Player::Client_Player_mes_size = ( sizeof(glm::vec3) + sizeof(glm::quat) ) * 3 + 1 + 1 + sizeof(unsigned int);
-size_t Server_Player::Server_Player_mes_size = sizeof(uint8_t) + ( sizeof(glm::vec3) + sizeof(glm::quat) ) * 3 + sizeof(bool) + 1 + sizeof(unsigned int);
-std::array<bool, PLAYER_NUM> Server_Player::id_used = {false};
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+std::array<bool, MaxPlayerIds> Server_Player::id_used = {false};
 
 // ------------------------------ client side -------------------------- //
 
@@ -16,123 +18,72 @@ portal2_position(portal2_position_), portal2_rotation(portal2_rotation_), hit_id
 animState(animState_), curFrame(curFrame_)
 {};
 
-void Client_Player::convert_to_message(std::vector<unsigned char> & client_message){
-    assert(client_message.size() == 0);
-    client_message.reserve(Client_Player_mes_size);
-
-    // position
-    vec3_as_byte position_bytes;
-    position_bytes.vec3_value = position;
-    for (size_t i =0; i < sizeof(glm::vec3); i++){
-        client_message.emplace_back(position_bytes.bytes_value[i]);
-    }
-    // rotation
-    quat_as_byte rotation_bytes;
-    rotation_bytes.quat_value = rotation;
-    for (size_t i =0; i < sizeof(glm::quat); i++){
-        client_message.emplace_back(rotation_bytes.bytes_value[i]);
-    }
-    // portal1 position
-    vec3_as_byte portal1_position_bytes;
-    portal1_position_bytes.vec3_value = portal1_position;
-    for (size_t i =0; i < sizeof(glm::vec3); i++){
-        client_message.emplace_back(portal1_position_bytes.bytes_value[i]);
-    }
-    // portal1 rotation
-    quat_as_byte portal1_rotation_bytes;
-    portal1_rotation_bytes.quat_value = portal1_rotation;
-    for (size_t i =0; i < sizeof(glm::quat); i++){
-        client_message.emplace_back(portal1_rotation_bytes.bytes_value[i]);
-    }
-    // portal2 position
-    vec3_as_byte portal2_position_bytes;
-    portal2_position_bytes.vec3_value = portal2_position;
-    for (size_t i =0; i < sizeof(glm::vec3); i++){
-        client_message.emplace_back(portal2_position_bytes.bytes_value[i]);
-    }
-    // portal2 rotation
-    quat_as_byte portal2_rotation_bytes;
-    portal2_rotation_bytes.quat_value = portal2_rotation;
-    for (size_t i =0; i < sizeof(glm::quat); i++){
-        client_message.emplace_back(portal2_rotation_bytes.bytes_value[i]);
-    }
-    // hit id
-    client_message.emplace_back((unsigned char) hit_id );
-    // anim state
-    client_message.emplace_back((unsigned char) animState );
-    // current frame
-    unsignedInt_as_byte curFrame_bytes;
-    curFrame_bytes.unsignedInt_value = curFrame;
-    for (size_t i =0; i < sizeof(unsigned int); i++){
-        client_message.emplace_back(curFrame_bytes.bytes_value[i]);
-    }
+Client_Player_Wire Client_Player::to_wire() const {
+    Client_Player_Wire wire;
+    wire.version = NetworkProtocolVersion;
+    wire.anim_state = (uint8_t)animState;
+    wire.input_count = 0;
+    wire.reserved = 0;
+    wire.cur_frame = curFrame;
+    wire.ack_tick = ackTick;
+    wire_swap(wire);
+    return wire;
+}
 
-    // -----------
-    assert(client_message.size() == Client_Player_mes_size);
+void Client_Player::send_message(Connection & c) const {
+    // attacks must not be lost, so they go on the reliable stream
+    if (attacking) {
+        double view_ticks = std::max(0.0, viewTime / ServerTick);
+        Attack_Wire attack;
+        attack.target = hit_id;
+        attack.reserved = 0;
+        attack.view_tick = (uint32_t)view_ticks;
+        attack.view_fraction = (uint16_t)std::min(65535.0, (view_ticks - std::floor(view_ticks)) * 65536.0);
+        wire_swap(attack);
+        c.send('h');
+        c.send(attack);
+    }
+    // the rest is state: only the newest one matters
+    // (over UDP that means unacknowledged inputs are repeated in every message until the server has them;
+    //  over TCP the caller only passes new inputs, and they may need more than one message)
+    size_t begin = 0;
+    if (c.transport == Transport::UDP && inputs.size() > MaxInputsPerMessage) {
+        begin = inputs.size() - MaxInputsPerMessage;
+    }
+    do {
+        size_t count = std::min(MaxInputsPerMessage, inputs.size() - begin);
+        Client_Player_Wire wire = to_wire();
+        wire.input_count = (uint8_t)count;
+        char message[1 + sizeof(wire) + MaxInputsPerMessage * sizeof(Input_Wire)];
+        message[0] = 'b';
+        memcpy(message + 1, &wire, sizeof(wire));
+        for (size_t i = 0; i < count; i++) {
+            Movement_Input const & input = inputs[begin + i];
+            Input_Wire input_wire;
+            input_wire.sequence = input.sequence;
+            input_wire.time_ms = input.time_ms;
+            input_wire.move[0] = input.move[0];
+            input_wire.move[1] = input.move[1];
+            input_wire.flags = input.flags;
+            input_wire.reserved = 0;
+            wire_swap(input_wire);
+            memcpy(message + 1 + sizeof(wire) + i * sizeof(Input_Wire), &input_wire, sizeof(input_wire));
+        }
+        c.send_state(message, 1 + sizeof(wire) + count * sizeof(Input_Wire));
+        begin += count;
+    } while (begin < inputs.size());
 }
 
-void Client_Player::read_from_message(const std::vector<unsigned char> & server_message, uint8_t & id, bool & gotHit, 
+void Client_Player::read_from_snapshot(Quantized_Player const & server_player, uint8_t & id, bool & gotHit, 
     AnimationState & animState_read, unsigned int & curFrame_read)
 {
-    assert(server_message.size() == Server_Player::Server_Player_mes_size);
-    // id
-    id = (uint8_t)server_message[0];
-    size_t index = 1;
-    // position
-    vec3_as_byte position_bytes;
-    for (size_t j =0; j < sizeof(glm::vec3); j++){
-        position_bytes.bytes_value[j] = server_message[j + index];
-    }
-    position = position_bytes.vec3_value;
-    index += sizeof(glm::vec3);
-    // rotation
-    quat_as_byte rotation_bytes;
-    for (size_t j =0; j < sizeof(glm::quat); j++){
-        rotation_bytes.bytes_value[j] = server_message[j + index];
-    }
-    rotation = rotation_bytes.quat_value;
-    index += sizeof(glm::quat);
-    // portal1_position
-    vec3_as_byte portal1_position_bytes;
-    for (size_t j =0; j < sizeof(glm::vec3); j++){
-        portal1_position_bytes.bytes_value[j] = server_message[j + index];
-    }
-    portal1_position = portal1_position_bytes.vec3_value;
-    index += sizeof(glm::vec3);
-    // portal1_rotation
-    quat_as_byte portal1_rotation_bytes;
-    for (size_t j =0; j < sizeof(glm::quat); j++){
-        portal1_rotation_bytes.bytes_value[j] = server_message[j + index];
-    }
-    portal1_rotation = portal1_rotation_bytes.quat_value;
-    index += sizeof(glm::quat);
-    // portal2_position
-    vec3_as_byte portal2_position_bytes;
-    for (size_t j =0; j < sizeof(glm::vec3); j++){
-        portal2_position_bytes.bytes_value[j] = server_message[j + index];
-    }
-    portal2_position = portal2_position_bytes.vec3_value;
-    index += sizeof(glm::vec3);
-    // portal2_rotation
-    quat_as_byte portal2_rotation_bytes;
-    for (size_t j =0; j < sizeof(glm::quat); j++){
-        portal2_rotation_bytes.bytes_value[j] = server_message[j + index];
-    }
-    portal2_rotation = portal2_rotation_bytes.quat_value;
-    index += sizeof(glm::quat);
-    // got hit
-    gotHit = (bool) server_message[index];
-    index += sizeof(bool);
-    // anim state
-    animState_read = (AnimationState) server_message[index];
-    index += 1;
-    // cur frame
-    unsignedInt_as_byte curFrame_bytes;
-    for (size_t j =0; j < sizeof(unsigned int); j++){
-        curFrame_bytes.bytes_value[j] = server_message[j + index];
-    }
-    curFrame_read = curFrame_bytes.unsignedInt_value;
-    index += sizeof(unsigned int);
+    id = server_player.id;
+    server_player.player.get(&position, &rotation);
+    server_player.portal1.get(&portal1_position, &portal1_rotation);
+    server_player.portal2.get(&portal2_position, &portal2_rotation);
+    gotHit = (server_player.got_hit != 0);
+    animState_read = (AnimationState)server_player.anim_state;
+    curFrame_read = server_player.cur_frame;
 }
 
 // ----------------------------- server side --------------------------- //
@@ -148,137 +99,135 @@ Server_Player::Server_Player() {
         }
     }   
     assert(id != 0);
-    position = playerInitPos + playerInitPosDistance * (float)(id-1);
-	rotation = playerInitRot;
+    position = player_spawn_position(id);
+    movement.position = position;
+    // (facing the same way as playerInitRot)
+    movement.current_angle = movement.target_angle = 270.0f;
+    rotation = movement.rotation();
+    portal1_position = portal2_position = portalInitPos;
+    portal1_rotation = portal2_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    gotHit = false;
+    animState = IDLE;
+    curFrame = 0;
 }
     
-// convert player's info into bytes
-void Server_Player::convert_to_message(std::vector<unsigned char> & server_message){
-    size_t before = server_message.size();
-    server_message.reserve(Server_Player_mes_size);
+Quantized_Player Server_Player::quantize() const {
+    Quantized_Player q;
+    q.id = id;
+    q.got_hit = (uint8_t)gotHit;
+    q.anim_state = (uint8_t)animState;
+    q.cur_frame = curFrame;
+    q.player.set(position, rotation);
+    q.portal1.set(portal1_position, portal1_rotation);
+    q.portal2.set(portal2_position, portal2_rotation);
+    return q;
+}
 
-    // id
-    server_message.emplace_back((unsigned char)id);
-    // position
-    vec3_as_byte position_bytes;
-    position_bytes.vec3_value = position;
-    for (size_t i =0; i < sizeof(position); i++){
-        server_message.emplace_back (position_bytes.bytes_value[i]);
-    }
-    // rotation
-    quat_as_byte rotation_bytes;
-    rotation_bytes.quat_value = rotation;
-    for (size_t i =0; i < sizeof(rotation); i++){
-        server_message.emplace_back (rotation_bytes.bytes_value[i]);
-    }
-    // portal1_position
-    vec3_as_byte portal1_position_bytes;
-    portal1_position_bytes.vec3_value = portal1_position;
-    for (size_t i =0; i < sizeof(portal1_position); i++){
-        server_message.emplace_back (portal1_position_bytes.bytes_value[i]);
-    }
-    // portal1_rotation
-    quat_as_byte portal1_rotation_bytes;
-    portal1_rotation_bytes.quat_value = portal1_rotation;
-    for (size_t i =0; i < sizeof(portal1_rotation); i++){
-        server_message.emplace_back (portal1_rotation_bytes.bytes_value[i]);
-    }
-    // portal2_position
-    vec3_as_byte portal2_position_bytes;
-    portal2_position_bytes.vec3_value = portal2_position;
-    for (size_t i =0; i < sizeof(portal2_position); i++){
-        server_message.emplace_back (portal2_position_bytes.bytes_value[i]);
-    }
-    // portal2_rotation
-    quat_as_byte portal2_rotation_bytes;
-    portal2_rotation_bytes.quat_value = portal2_rotation;
-    for (size_t i =0; i < sizeof(portal2_rotation); i++){
-        server_message.emplace_back (portal2_rotation_bytes.bytes_value[i]);
+void Server_Player::simulate(uint32_t steps, CollisionMap const * collision) {
+    // (unused budget carries over a little, so inputs that arrive late in a burst still get simulated)
+    inputBudget = std::min(inputBudget + (float)steps, 2.0f * (float)steps);
+    while (inputBudget >= 1.0f && !inputs.empty()) {
+        Movement_Input const & input = inputs.front();
+
+        apply_portals(&movement, input.flags);
+        // (portals face the way the player did when placing them)
+        if (input.flags & Movement_Input::PlacePortal1) {
+            portal1_position = movement.portal1;
+            portal1_rotation = movement.rotation();
+        }
+        if (input.flags & Movement_Input::PlacePortal2) {
+            portal2_position = movement.portal2;
+            portal2_rotation = movement.rotation();
+        }
+        step_movement(&movement, input.direction(), MovementStep, collision);
+        position = movement.position;
+        rotation = movement.rotation();
+        lastInput = input.sequence;
+        lastInputTime = input.time_ms;
+
+        inputs.pop_front();
+        inputBudget -= 1.0f;
     }
-    // got hit
-    server_message.emplace_back((unsigned char) gotHit);
-    // anim state
-    server_message.emplace_back((AnimationState) animState);
-    // current frame
-    unsignedInt_as_byte curFrame_bytes;
-    curFrame_bytes.unsignedInt_value = curFrame;
-    for (size_t i =0; i < sizeof(unsigned int); i++){
-        server_message.emplace_back(curFrame_bytes.bytes_value[i]);
+}
+
+// read one 'b' message (without the 'b'), which has already been checked to contain all of its inputs
+bool Server_Player::read_wire(Connection * c, const char * message) {
+    Client_Player_Wire wire;
+    memcpy(&wire, message, sizeof(wire));
+    wire_swap(wire);
+    if (wire.version != NetworkProtocolVersion) {
+        std::cout << " client speaks protocol version " << int(wire.version) << ", expected " << int(NetworkProtocolVersion) << "!" << std::endl;
+        c->close();
+        return false;
     }
 
-    assert(server_message.size() - before == Server_Player_mes_size);
+    animState = (AnimationState)wire.anim_state;
+    curFrame = wire.cur_frame;
+    ackTick = wire.ack_tick;
+
+    // buffer inputs we haven't seen (over UDP, most of them are repeats)
+    for (uint32_t i = 0; i < wire.input_count; i++) {
+        Input_Wire input_wire;
+        memcpy(&input_wire, message + sizeof(wire) + i * sizeof(Input_Wire), sizeof(input_wire));
+        wire_swap(input_wire);
+        uint32_t newest = (inputs.empty() ? lastInput : inputs.back().sequence);
+        if (input_wire.sequence <= newest) continue;
+
+        Movement_Input input;
+        input.sequence = input_wire.sequence;
+        input.time_ms = input_wire.time_ms;
+        input.move[0] = input_wire.move[0];
+        input.move[1] = input_wire.move[1];
+        input.flags = input_wire.flags;
+        inputs.emplace_back(input);
+        if (inputs.size() > MaxBufferedInputs) inputs.pop_front();
+    }
+    return true;
+}
+
+// size of the 'b' message (with the 'b') whose Client_Player_Wire starts at 'wire'
+static size_t client_message_size(const char * wire) {
+    uint8_t input_count = (uint8_t)wire[offsetof(Client_Player_Wire, input_count)];
+    return 1 + sizeof(Client_Player_Wire) + input_count * sizeof(Input_Wire);
 }
 
-void Server_Player::read_from_message(Connection * c, uint8_t & hit_id){
+void Server_Player::read_from_message(Connection * c, std::vector< Attack > & attacks){
     size_t client_mes_size = Client_Player::Client_Player_mes_size;
-    while (c->recv_buffer.size() >= client_mes_size) {
-        size_t index = 0;
-        // expecting messages 'b' 
+    // reliable stream: 'b' (over TCP) and 'h' messages
+    while (c->recv_buffer.size() >= 2) {
         char type = c->recv_buffer[0];
-        if (type != 'b') {
-            std::cout << " message of non-'b' type received from client!" << std::endl;
+        if (type == 'h') {
+            if (c->recv_buffer.size() < 1 + sizeof(Attack_Wire)) break;
+            Attack_Wire wire;
+            c->recv_buffer.copy_out(1, &wire, sizeof(wire));
+            wire_swap(wire);
+            attacks.emplace_back(Attack{ wire.target, wire.view_tick, (float)wire.view_fraction / 65536.0f });
+            c->recv_buffer.consume(1 + sizeof(Attack_Wire));
+        }
+        else if (type == 'b') {
+            if (c->recv_buffer.size() < client_mes_size + 1) break;
+            // (remeber +1 for the 'b')
+            size_t size = client_message_size(c->recv_buffer.contiguous(client_mes_size + 1) + 1);
+            if (c->recv_buffer.size() < size) break;
+            if (!read_wire(c, c->recv_buffer.contiguous(size) + 1)) return;
+            c->recv_buffer.consume(size);
+        }
+        else {
+            std::cout << " message of unknown type received from client!" << std::endl;
             //shut down client connection:
             c->close();
             return;
         }
-        index += 1;
-        // position
-        vec3_as_byte position_mes;
-        for (size_t j =0; j < sizeof(glm::vec3); j++){
-            position_mes.bytes_value[j] = c->recv_buffer[index+j];
-        }
-        position = position_mes.vec3_value;
-        index += sizeof(glm::vec3);
-        // rotation
-        quat_as_byte rotation_mes;
-        for (size_t j =0; j < sizeof(glm::quat); j++){
-            rotation_mes.bytes_value[j] = c->recv_buffer[index+j];
-        }
-        rotation = rotation_mes.quat_value;
-        index += sizeof(glm::quat);
-        // portal 1 position
-        vec3_as_byte portal1_position_mes;
-        for (size_t j =0; j < sizeof(glm::vec3); j++){
-            portal1_position_mes.bytes_value[j] = c->recv_buffer[index+j];
-        }
-        portal1_position = portal1_position_mes.vec3_value;
-        index += sizeof(glm::vec3);
-        // portal 1 rotation
-        quat_as_byte portal1_rotation_mes;
-        for (size_t j =0; j < sizeof(glm::quat); j++){
-            portal1_rotation_mes.bytes_value[j] = c->recv_buffer[index+j];
-        }
-        portal1_rotation = portal1_rotation_mes.quat_value;
-        index += sizeof(glm::quat);
-        // portal 2 position
-        vec3_as_byte portal2_position_mes;
-        for (size_t j =0; j < sizeof(glm::vec3); j++){
-            portal2_position_mes.bytes_value[j] = c->recv_buffer[index+j];
-        }
-        portal2_position = portal2_position_mes.vec3_value;
-        index += sizeof(glm::vec3);
-        // portal 2 rotation
-        quat_as_byte portal2_rotation_mes;
-        for (size_t j =0; j < sizeof(glm::quat); j++){
-            portal2_rotation_mes.bytes_value[j] = c->recv_buffer[index+j];
-        }
-        portal2_rotation = portal2_rotation_mes.quat_value;
-        index += sizeof(glm::quat);
-        // hit id
-        hit_id = (uint8_t)c->recv_buffer[index];
-        index += 1;
-        // anim state
-        animState = (AnimationState)c->recv_buffer[index];
-        index += 1;
-        // cur frame
-        unsignedInt_as_byte curFrame_mes;
-        for (size_t j =0; j < sizeof(unsigned int); j++){
-            curFrame_mes.bytes_value[j] = c->recv_buffer[index+j];
+    }
+    // newest state (over UDP)
+    if (!c->recv_state.empty()) {
+        if (c->recv_state.size() < client_mes_size + 1 || c->recv_state[0] != 'b'
+            || c->recv_state.size() != client_message_size(c->recv_state.data() + 1)) {
+            std::cout << " malformed state message received from client!" << std::endl;
+            c->close();
+            return;
         }
-        curFrame = curFrame_mes.unsignedInt_value;
-        index += sizeof(unsigned int);
-
-        // erase bytes (remeber +1 for the 'b')
-        c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + client_mes_size + 1);
+        read_wire(c, c->recv_state.data() + 1);
+        c->recv_state.clear();
     }
-}
\ No newline at end of file
+}
@@ -1,28 +1,159 @@
 #pragma once
 
-#include "Scene.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/glm.hpp>
 #include "Connection.hpp"
+#include "Snapshot.hpp"
+#include "Movement.hpp"
 #include <vector>
 #include <array>
+#include <deque>
 #include <iostream>
+#include <cstring>
 # include "AnimationStateMachine.hpp"
 
 // how many players in our game 
 static const size_t PLAYER_NUM = 16;
+// most players a server can hold (ids are a uint8, and zero means nobody); only load tests go past PLAYER_NUM
+static const size_t MaxPlayerIds = 255;
+
+// the server sends a snapshot every tick; snapshot times are tick * ServerTick
+constexpr float ServerTick = 1.0f / 20.0f;
 
 // init positions/rotations for players
 static const glm::vec3 playerInitPos = glm::vec3(1,0,0);
 static const glm::vec3 playerInitPosDistance = glm::vec3(0.2,0.2,0);
 static const glm::quat playerInitRot = glm::angleAxis(glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+// portals wait out of sight (below the ground) until they are placed
+static const glm::vec3 portalInitPos = glm::vec3(-7,-1,-3);
+// where player 'id' starts (players past PLAYER_NUM start in further rows)
+inline glm::vec3 player_spawn_position(uint8_t id) {
+    size_t row = (size_t(id) - 1) / PLAYER_NUM, column = (size_t(id) - 1) % PLAYER_NUM;
+    return playerInitPos + playerInitPosDistance * (float)column - glm::vec3(0.0f, 0.5f * (float)row, 0.0f);
+}
+
+// ------------ wire formats ------------ //
+// Messages are fixed-layout structs that are copied to/from the wire with a single memcpy.
+// All multi-byte fields are little-endian on the wire (floats are IEEE-754 binary32);
+//  on big-endian hosts wire_swap() converts in place, on little-endian hosts it does nothing.
+//
+// client -> server: 'b' + Client_Player_Wire + input_count * Input_Wire (state)
+//                   'h' + Attack_Wire (event)
+// server -> client: 'm' + uint32 size + Server_Message_Header + snapshot delta (state, see Snapshot.hpp)
+//  (the header is per-recipient; the delta is shared by every client with the same baseline,
+//   and header.you is the index of the recipient's own entry in it)
+//
+// The client acknowledges the last snapshot it applied in Client_Player_Wire::ack_tick;
+//  the server encodes each client's update against that snapshot.
+//
+// Clients don't send their position (or their portals'): they send the inputs of each movement step
+//  (see Movement.hpp; placing a portal is an input flag), which the server buffers and simulates at a fixed rate. Server_Message_Header::last_input says
+//  which inputs have been simulated; the client repeats newer ones until they are.
+// The header also carries the recipient's exact movement state after those inputs,
+//  which the client rewinds its prediction to before replaying the rest.
+//
+// Attacks say when (in server ticks) the attacker saw the world it swung at;
+//  the server rewinds the other players to then to decide who was hit (see PoseHistory.hpp).
+//
+// State messages go through Connection::send_state (over UDP only the newest one needs to arrive),
+//  events go through the reliable stream.
+
+// bump this whenever a wire struct changes:
+static const uint8_t NetworkProtocolVersion = 8;
+
+struct Input_Wire {
+    uint32_t sequence;
+    uint32_t time_ms;
+    int8_t move[2];
+    uint8_t flags;
+    uint8_t reserved;
+};
+static_assert(sizeof(Input_Wire) == 12, "Input_Wire is packed.");
+
+struct Client_Player_Wire {
+    uint8_t version;
+    uint8_t anim_state;
+    uint8_t input_count; // number of Input_Wire that follow, oldest first
+    uint8_t reserved;
+    uint32_t cur_frame;
+    uint32_t ack_tick; // last server snapshot applied (0 for none)
+};
+static_assert(sizeof(Client_Player_Wire) == 4 + 4 + 4, "Client_Player_Wire is packed.");
+
+struct Attack_Wire {
+    uint8_t target; // who the attacker thinks it hit (0 for nobody)
+    uint8_t reserved;
+    uint16_t view_fraction; // fraction of a tick past view_tick, in 1/65536ths
+    uint32_t view_tick; // the other players were drawn at view_tick + view_fraction
+};
+static_assert(sizeof(Attack_Wire) == 8, "Attack_Wire is packed.");
+
+struct Movement_Wire {
+    float position[3];
+    float velocity[3];
+    float current_angle;
+    float target_angle;
+    float portal1[3];
+    float portal2[3];
+    uint8_t portals_placed;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(Movement_Wire) == 4*14 + 4, "Movement_Wire is packed.");
+
+struct Server_Message_Header {
+    uint8_t version;
+    uint8_t ping;
+    uint8_t player_count;
+    uint8_t you; // index of the recipient's entry in the snapshot
+    uint32_t tick; // tick of this snapshot
+    uint32_t baseline_tick; // tick the delta is against (0 for none)
+    uint32_t last_input; // sequence of the recipient's last simulated input (0 for none)
+    Movement_Wire movement; // the recipient's movement state after that input
+};
+static_assert(sizeof(Server_Message_Header) == 16 + sizeof(Movement_Wire), "Server_Message_Header is packed.");
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline void wire_swap(uint32_t &v) { v = __builtin_bswap32(v); }
+inline void wire_swap(float &v) { uint32_t u; memcpy(&u, &v, 4); wire_swap(u); memcpy(&v, &u, 4); }
+inline void wire_swap(Input_Wire &w) { wire_swap(w.sequence); wire_swap(w.time_ms); }
+inline void wire_swap(Client_Player_Wire &w) { wire_swap(w.cur_frame); wire_swap(w.ack_tick); }
+inline void wire_swap(uint16_t &v) { v = __builtin_bswap16(v); }
+inline void wire_swap(Attack_Wire &w) { wire_swap(w.view_fraction); wire_swap(w.view_tick); }
+inline void wire_swap(Movement_Wire &m) { for (float &f : m.position) wire_swap(f); for (float &f : m.velocity) wire_swap(f); wire_swap(m.current_angle); wire_swap(m.target_angle); for (float &f : m.portal1) wire_swap(f); for (float &f : m.portal2) wire_swap(f); }
+inline void wire_swap(Server_Message_Header &h) { wire_swap(h.tick); wire_swap(h.baseline_tick); wire_swap(h.last_input); wire_swap(h.movement); }
+#else
+template< typename T >
+inline void wire_swap(T &) { }
+#endif
+
+inline Movement_Wire movement_to_wire(Movement_State const &state) {
+    return Movement_Wire{
+        {state.position.x, state.position.y, state.position.z},
+        {state.velocity.x, state.velocity.y, state.velocity.z},
+        state.current_angle, state.target_angle,
+        {state.portal1.x, state.portal1.y, state.portal1.z},
+        {state.portal2.x, state.portal2.y, state.portal2.z},
+        state.portals_placed, {0, 0, 0}
+    };
+}
+inline Movement_State movement_from_wire(Movement_Wire const &wire) {
+    Movement_State state;
+    state.position = glm::vec3(wire.position[0], wire.position[1], wire.position[2]);
+    state.velocity = glm::vec3(wire.velocity[0], wire.velocity[1], wire.velocity[2]);
+    state.current_angle = wire.current_angle;
+    state.target_angle = wire.target_angle;
+    state.portal1 = glm::vec3(wire.portal1[0], wire.portal1[1], wire.portal1[2]);
+    state.portal2 = glm::vec3(wire.portal2[0], wire.portal2[1], wire.portal2[2]);
+    state.portals_placed = wire.portals_placed;
+    return state;
+}
 
 // ------------ player class on the client side ------------ //
 // (how/what client track the infos of players): client side send this to server
 class Client_Player {
 public:
-    // info that will be sent to server
+    // info that will be sent to server (portals are only read from snapshots: placing them is a movement input)
     glm::vec3 position;
     glm::quat rotation;
     glm::vec3 portal1_position;
@@ -30,8 +161,12 @@ public:
     glm::vec3 portal2_position;
     glm::quat portal2_rotation;
     uint8_t hit_id; // who I hit (0 means hit no one)
+    bool attacking = false; // did an attack land this frame? (the server decides whom it hit)
+    double viewTime = 0.0; // time (tick * ServerTick) that other players were drawn at
     AnimationState animState;
     unsigned int curFrame;
+    uint32_t ackTick = 0; // last server snapshot applied
+    std::vector< Movement_Input > inputs; // movement inputs the server hasn't simulated yet, oldest first
 
     Client_Player(){};
     Client_Player(
@@ -39,15 +174,19 @@ public:
         glm::quat portal1_rotation_, glm::vec3 portal2_position_, glm::quat ortal2_rotation_, uint8_t hit_id_,
         AnimationState animState_ , unsigned int curFrame_
     );
-    // convert client side player's info into bytes (and send this to server)
-    void convert_to_message(std::vector<unsigned char> & client_message);
-    // read the message sent by the server, and put it in the client side player obj
-    void read_from_message(
-        const std::vector<unsigned char> & server_message, uint8_t & id, bool & gotHit, 
+    // convert client side player's info into its wire format
+    Client_Player_Wire to_wire() const;
+    // send this player's info as a 'b' state message, plus an 'h' event if attacking
+    // (over UDP only the newest MaxInputsPerMessage inputs fit; over TCP all of them are sent)
+    void send_message(Connection & c) const;
+    // read one player's entry of a snapshot sent by the server, and put it in the client side player obj
+    void read_from_snapshot(
+        Quantized_Player const & server_player, uint8_t & id, bool & gotHit, 
         AnimationState & animState_read, unsigned int & curFrame_read
     );
 
-    static size_t Client_Player_mes_size;
+    static constexpr size_t Client_Player_mes_size = sizeof(Client_Player_Wire);
+    static constexpr size_t MaxInputsPerMessage = 16;
 };
 
 // ------------- player class on the server side ---------------- //
@@ -58,42 +197,38 @@ public:
     uint8_t id;
     glm::vec3 position;
     glm::quat rotation;
-    glm::vec3 portal1_position;
+    glm::vec3 portal1_position; // (placed by the simulation, see Movement_Input::PlacePortal1)
     glm::quat portal1_rotation;
     glm::vec3 portal2_position;
     glm::quat portal2_rotation;
     bool gotHit; // was hit by someone
     AnimationState animState;
     unsigned int curFrame;
+    uint32_t ackTick = 0; // last snapshot the client applied
 
-    Server_Player();
-    // convert server side player's info into bytes (and send this to client)
-    void convert_to_message(std::vector<unsigned char> & server_message);
-    // read the message sent by the client, and put it in the server side player obj
-    void read_from_message(Connection * c, uint8_t & hit_id);
+    // movement, simulated from the client's inputs
+    Movement_State movement;
+    std::deque< Movement_Input > inputs; // received but not yet simulated, oldest first
+    uint32_t lastInput = 0; // sequence of the last input simulated
+    uint32_t lastInputTime = 0; // client clock of the last input simulated (ms)
+    float inputBudget = 0.0f; // how many inputs the client may still have simulated
+    static constexpr size_t MaxBufferedInputs = 60;
 
-    static size_t Server_Player_mes_size;
-    static std::array<bool, PLAYER_NUM> id_used;
-};
+    Server_Player();
+    // simulate buffered inputs; 'steps' more may run this tick (limits clients that send too many)
+    void simulate(uint32_t steps, CollisionMap const * collision);
+    // quantize server side player's info for this tick's snapshot
+    Quantized_Player quantize() const;
+    // an attack, as reported by the client:
+    struct Attack {
+        uint8_t claimedTarget;
+        uint32_t viewTick;
+        float viewFraction;
+    };
+    // read the messages sent by the client, and put them in the server side player obj
+    // (this client's attacks are appended to 'attacks')
+    void read_from_message(Connection * c, std::vector< Attack > & attacks);
+    bool read_wire(Connection * c, const char * message);
 
-// -------- unions for convertion ---------- //
-union vec3_as_byte
-{
-	glm::vec3 vec3_value;
-	unsigned char bytes_value[sizeof(glm::vec3)];
-};
-union quat_as_byte
-{
-	glm::quat quat_value;
-	unsigned char bytes_value[sizeof(glm::quat)];
-};
-union sizet_as_byte
-{
-	size_t sizet_value;
-	unsigned char bytes_value[sizeof(size_t)];
+    static std::array<bool, MaxPlayerIds> id_used;
 };
-union unsignedInt_as_byte
-{
-    unsigned int unsignedInt_value;
-    unsigned char bytes_value[sizeof(unsigned int)];
-};
\ No newline at end of file
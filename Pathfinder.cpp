@@ -0,0 +1,114 @@
+#include "Pathfinder.hpp"
+
+#include <algorithm>
+
+Pathfinder::Pathfinder(NavGrid const &grid_, uint32_t threads, size_t cache_capacity_) : grid(grid_), cache_capacity(cache_capacity_) {
+	if (threads == 0) {
+		uint32_t hardware = std::thread::hardware_concurrency();
+		threads = std::max(1U, std::min(hardware > 1 ? hardware - 1 : 1U, 16U));
+	}
+	workers.reserve(threads);
+	for (uint32_t t = 0; t < threads; ++t) {
+		workers.emplace_back([this]() { work(); });
+	}
+}
+
+Pathfinder::~Pathfinder() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) worker.join();
+}
+
+uint32_t Pathfinder::request(glm::vec2 const &start, glm::vec2 const &goal) {
+	uint32_t ticket;
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		ticket = next_ticket++;
+		if (next_ticket == 0) next_ticket = 1; //(zero is never a ticket)
+		queries.emplace_back(Query{ticket, start, goal});
+		outstanding += 1;
+	}
+	wake.notify_one();
+	return ticket;
+}
+
+void Pathfinder::poll(std::vector< Response > *done) {
+	std::lock_guard< std::mutex > lock(mutex);
+	outstanding -= finished.size();
+	for (auto &response : finished) done->emplace_back(std::move(response));
+	finished.clear();
+}
+
+size_t Pathfinder::pending() const {
+	std::lock_guard< std::mutex > lock(mutex);
+	return outstanding;
+}
+
+uint64_t Pathfinder::cache_hits() const {
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	return hits;
+}
+
+uint64_t Pathfinder::cache_misses() const {
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	return misses;
+}
+
+void Pathfinder::work() {
+	NavGrid::Search search;
+	while (true) {
+		Query query;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			wake.wait(lock, [this]() { return quit || !queries.empty(); });
+			if (quit) return;
+			query = queries.front();
+			queries.pop_front();
+		}
+
+		Response response;
+		response.ticket = query.ticket;
+		glm::ivec2 from, to;
+		if (grid.nearest_walkable(query.start, &from) && grid.nearest_walkable(query.goal, &to)) {
+			std::shared_ptr< Route const > found = route(from, to, &search);
+			if (found->found) {
+				grid.finish_path(query.start, found->waypoints, query.goal, &response.path);
+				response.found = true;
+			}
+		}
+
+		std::lock_guard< std::mutex > lock(mutex);
+		finished.emplace_back(std::move(response));
+	}
+}
+
+std::shared_ptr< Pathfinder::Route const > Pathfinder::route(glm::ivec2 const &from, glm::ivec2 const &to, NavGrid::Search *search) {
+	uint64_t key = (uint64_t(uint32_t(from.y) * grid.size + uint32_t(from.x)) << 32) | (uint32_t(to.y) * grid.size + uint32_t(to.x));
+	{
+		std::lock_guard< std::mutex > lock(cache_mutex);
+		auto f = cache.find(key);
+		if (f != cache.end()) {
+			hits += 1;
+			return f->second;
+		}
+		misses += 1;
+	}
+
+	//(two workers may search for the same route at once; both get the same answer, and the second insert is skipped)
+	auto made = std::make_shared< Route >();
+	made->found = grid.find_route(from, to, search, &made->waypoints);
+	if (cache_capacity == 0) return made;
+
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	if (cache.emplace(key, made).second) {
+		cache_order.emplace_back(key);
+		while (cache.size() > cache_capacity) {
+			cache.erase(cache_order.front());
+			cache_order.pop_front();
+		}
+	}
+	return made;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+ * Pathfinder answers NavGrid path queries on a pool of worker threads, so that gameplay code
+ *  (e.g. the server stepping NPCs) never waits on a search:
+ *  - request() queues a query and returns a ticket straight away;
+ *  - poll() (called once a frame) hands back every query finished since the last poll.
+ *
+ * Routes are cached by (start node, goal node), so agents heading the same way from the same
+ *  spot -- a crowd chasing one player, bots patrolling between a few points -- share one search.
+ *  Only the ends of each path (from the exact start, to the exact goal) are worked out per query.
+ *  The cache holds up to cache_capacity routes and forgets the oldest first.
+ */
+
+#include "NavGrid.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+struct Pathfinder {
+	//'threads' workers (0 for one per spare hardware thread); the grid must outlive the pathfinder:
+	explicit Pathfinder(NavGrid const &grid, uint32_t threads = 0, size_t cache_capacity = 4096);
+	~Pathfinder();
+
+	Pathfinder(Pathfinder const &) = delete;
+	Pathfinder &operator=(Pathfinder const &) = delete;
+
+	//queue a search for a path from 'start' to 'goal'; returns the ticket its response will carry:
+	uint32_t request(glm::vec2 const &start, glm::vec2 const &goal);
+
+	struct Response {
+		uint32_t ticket = 0;
+		bool found = false;
+		std::vector< glm::vec2 > path; //waypoints after the start, ending at the goal (see NavGrid::find_path)
+	};
+	//append the responses finished since the last poll (in no particular order):
+	void poll(std::vector< Response > *done);
+	//queries requested but not yet handed back by poll():
+	size_t pending() const;
+
+	//cache statistics (since construction):
+	uint64_t cache_hits() const;
+	uint64_t cache_misses() const;
+
+	//internals:
+	NavGrid const &grid;
+	size_t cache_capacity;
+
+	struct Query {
+		uint32_t ticket;
+		glm::vec2 start, goal;
+	};
+	struct Route {
+		bool found;
+		std::vector< glm::vec2 > waypoints; //from node center to node center (NavGrid::find_route)
+	};
+
+	mutable std::mutex mutex; //guards the queues and counters up to the cache
+	std::condition_variable wake; //signaled when queries arrive or on shutdown
+	std::deque< Query > queries;
+	std::vector< Response > finished;
+	uint32_t next_ticket = 1;
+	size_t outstanding = 0; //requested, not yet polled
+	bool quit = false;
+
+	mutable std::mutex cache_mutex; //guards the cache (held only for lookups and inserts, never during a search)
+	std::unordered_map< uint64_t, std::shared_ptr< Route const > > cache;
+	std::deque< uint64_t > cache_order; //keys, oldest first
+	uint64_t hits = 0, misses = 0;
+
+	std::vector< std::thread > workers;
+	void work();
+	std::shared_ptr< Route const > route(glm::ivec2 const &from, glm::ivec2 const &to, NavGrid::Search *search);
+};
@@ -14,15 +14,18 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include <random>
+#include <unordered_map>
 
 #define BACKGROUND_VOL 0.3f
 #define COMBAT_VOL 0.5f
 #define FX_VOL 0.4f
 
 GLuint stage_meshes_for_lit_color_texture_program = 0;
+GLuint stage_meshes_for_lit_color_texture_program_instanced = 0;
 Load< MeshBuffer > stage_meshes(LoadTagDefault, []() -> MeshBuffer const * {
 	MeshBuffer const *ret = new MeshBuffer(data_path("field.pnct"));
 	stage_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	stage_meshes_for_lit_color_texture_program_instanced = ret->make_vao_for_program(lit_color_texture_program_instanced->program);
 	return ret;
 });
 
@@ -36,10 +39,14 @@ Load< Scene > stage_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline = lit_color_texture_program_pipeline;
 
 		drawable.pipeline.vao = stage_meshes_for_lit_color_texture_program;
+		drawable.pipeline.instanced.vao = stage_meshes_for_lit_color_texture_program_instanced;
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
 
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
+
 	});
 });
 
@@ -109,28 +116,31 @@ PlayMode::PlayMode(Client &client_) : scene(*stage_scene), client(client_) {
 	characterController = new CharacterController(my_transform, my_camera);
 
 	//create collision system
-	collisionSystem = new CollisionSystem();
+	collisionSystem = new CollisionSystem(&characterController->collision_map);
 
-	// get the transforms of all players' models and portals
+	// get the transforms of all players' models and portals (by name, in one pass over the transforms)
+	std::unordered_map< std::string, Scene::Transform * > named_transforms;
+	for (auto &transform : scene.transforms) {
+		named_transforms[transform.name] = &transform;
+	}
+	auto find_transform = [&named_transforms](std::string const &name) -> Scene::Transform * {
+		auto f = named_transforms.find(name);
+		return (f == named_transforms.end() ? nullptr : f->second);
+	};
 	for(uint8_t i =0; i < PLAYER_NUM; i++){
-		for (auto &transform : scene.transforms) {
-			if (transform.name == "Player" + std::to_string(i+1)) {
-				players_transform[i] = &transform;
-				collisionSystem->AddElement(new CollisionSystem::Collidable(collisionSystem, &transform, 0.15f));
-				// add skeletal
-				if(true)	// can only add one skelatal, adding more will break the sahder
-				{
-					std::cout <<"adding skelatal \n";
-					scene.skeletals.emplace_back(&transform);
-				}
-			}
-			if (transform.name == "Player" + std::to_string(i+1) + "Portal1") {
-				portal1_transform[i] = &transform;
-			}
-			if (transform.name == "Player" + std::to_string(i+1) + "Portal2") {
-				portal2_transform[i] = &transform;
+		std::string player_name = "Player" + std::to_string(i+1);
+		if (Scene::Transform *transform = find_transform(player_name)) {
+			players_transform[i] = transform;
+			collisionSystem->AddElement(new CollisionSystem::Collidable(collisionSystem, transform, PlayerRadius));
+			// add skeletal
+			if(true)	// can only add one skelatal, adding more will break the sahder
+			{
+				std::cout <<"adding skelatal \n";
+				scene.skeletals.emplace_back(transform);
 			}
 		}
+		portal1_transform[i] = find_transform(player_name + "Portal1");
+		portal2_transform[i] = find_transform(player_name + "Portal2");
 	}
 	// disable other players' drawing, util recieve other players' info from server
 	for (size_t i =0; i < players_transform.size(); i++){
@@ -189,6 +199,10 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 		} else if (evt.key.keysym.sym == SDLK_e) {
 			place.pressed = true;
 			return true;
+		} else if (evt.key.keysym.sym == SDLK_F3) {
+			render_report = !render_report;
+			scene.render_queue.reset_totals();
+			return true;
 		} /*else if (evt.key.keysym.sym == SDLK_f) {
 			if(my_id != 0) animation_machines[my_id-1].set_state(HIT_1);
 			return true;
@@ -355,14 +369,25 @@ void PlayMode::update(float elapsed) {
 			pre_move = cur_move;
 
 
-			// place portals
+			// our portals are where our simulation placed them (the server places them the same way)
+			Movement_State const &simulated = characterController->predictor.state;
+			if (simulated.portals_placed & Movement_Input::PlacePortal1) {
+				p1_transform->position = simulated.portal1;
+				p1_transform->position.z = characterController->ground.height(glm::vec2(simulated.portal1.x, simulated.portal1.y));
+			}
+			if (simulated.portals_placed & Movement_Input::PlacePortal2) {
+				p2_transform->position = simulated.portal2;
+				p2_transform->position.z = characterController->ground.height(glm::vec2(simulated.portal2.x, simulated.portal2.y));
+			}
+
+			// place portals (on our next movement step)
 			if (place.pressed && can_place) {
 				if (place_p1) {
-					p1_transform->position = my_transform->position;
+					characterController->PlacePortal(Movement_Input::PlacePortal1);
 					p1_transform->rotation = my_transform->rotation;
 				}
 				else {
-					p2_transform->position = my_transform->position;
+					characterController->PlacePortal(Movement_Input::PlacePortal2);
 					p2_transform->rotation = my_transform->rotation;
 					both_placed = true;
 				}
@@ -371,19 +396,22 @@ void PlayMode::update(float elapsed) {
 				place_p1 = !place_p1;
 			}
 
-			// check if I stepped into a portal
-			if (glm::distance(my_transform->position, p1_transform->position) < 0.5f &&
-				can_teleport && both_placed) {
+			// check if I stepped into a portal (we go through on our next movement step)
+			// (measured on the ground plane, as the simulation does -- we and the portals may stand at different heights)
+			auto ground_distance = [](glm::vec3 const &a, glm::vec3 const &b) {
+				return glm::length(glm::vec2(a.x - b.x, a.y - b.y));
+			};
+			float to_p1 = ground_distance(my_transform->position, p1_transform->position);
+			float to_p2 = ground_distance(my_transform->position, p2_transform->position);
+			if (to_p1 < 0.5f && can_teleport && both_placed) {
 				can_teleport = false;
-				my_transform->position = p2_transform->position;
+				characterController->Teleport(Movement_Input::TeleportToPortal2);
 			}
-			else if (glm::distance(my_transform->position, p2_transform->position) < 0.5f &&
-				can_teleport && both_placed) {
+			else if (to_p2 < 0.5f && can_teleport && both_placed) {
 				can_teleport = false;
-				my_transform->position = p1_transform->position;
+				characterController->Teleport(Movement_Input::TeleportToPortal1);
 			}
-			else if (glm::distance(my_transform->position, p1_transform->position) > 0.5f &&
-				glm::distance(my_transform->position, p2_transform->position) > 0.5f) {
+			else if (to_p1 > 0.5f && to_p2 > 0.5f) {
 				can_teleport = true;
 			}
 		}
@@ -392,8 +420,12 @@ void PlayMode::update(float elapsed) {
 			pre_move = false;
 		}
 
+		//everyone has moved since last frame (us just now, remote players when last sampled), so refresh the broadphase
+		collisionSystem->Update();
+
 		//attack command
 		hit_id = 0;
+		attacking = false;
 		if (hitTimer <= 0.0f && blockTimer <= 0.0f && stunTimer <= 0.0f) {
 			//initialize attack
 			if (attack.pressed) {
@@ -405,6 +437,7 @@ void PlayMode::update(float elapsed) {
 			float updatedHitTimer = hitTimer - elapsed;
 			if (hitTimer > hitCD - hitWindup && updatedHitTimer <= hitCD - hitWindup) {
 				hit_id = collisionSystem->CheckOverLap(my_id, attackDegree, attackRadius);
+				attacking = true;
 				// if I hit something, play hit sound
 				if (hit_id != 0) {
 					Sound::play_3D(*hit_sample, FX_VOL, players_transform[my_id-1]->position, 1.0f);
@@ -452,34 +485,32 @@ void PlayMode::update(float elapsed) {
 
 	// sending my info to server:
 	{
-		// convert info to msg
-		if (my_id == 0) {
-			Client_Player myself(
-				my_transform->position, my_transform->rotation, p1_transform->position, p1_transform->rotation,
-				p2_transform->position, p2_transform->rotation, hit_id,
-				IDLE, 0
-			);
-			std::vector<unsigned char> client_message;
-			myself.convert_to_message(client_message);
-			// send msg
-			Connection & c = client.connections.back();
-			c.send('b');
-			c.send_buffer.insert(c.send_buffer.end(), client_message.begin(), client_message.end());
+		Client_Player myself(
+			my_transform->position, my_transform->rotation, p1_transform->position, p1_transform->rotation,
+			p2_transform->position, p2_transform->rotation, hit_id,
+			IDLE, 0
+		);
+		if (my_id != 0) {
+			myself.animState = animation_machines[my_id - 1].current_state;
+			myself.curFrame = animation_machines[my_id - 1].current_frame;
 		}
-		else {
-			Client_Player myself(
-				my_transform->position, my_transform->rotation, p1_transform->position, p1_transform->rotation,
-				p2_transform->position, p2_transform->rotation, hit_id,
-				animation_machines[my_id - 1].current_state, animation_machines[my_id - 1].current_frame
-			);
-			std::vector<unsigned char> client_message;
-			myself.convert_to_message(client_message);
-			// send msg
-			Connection & c = client.connections.back();
-			c.send('b');
-			c.send_buffer.insert(c.send_buffer.end(), client_message.begin(), client_message.end());
+		// attacks are judged against what we saw: other players as drawn at interpolation.time
+		myself.attacking = attacking;
+		myself.viewTime = interpolation.time;
+		// acknowledge the last snapshot we applied, so the server can send deltas against it
+		myself.ackTick = server_snapshots.latest_tick();
+		// movement inputs the server hasn't simulated yet (over TCP, only ones we haven't sent)
+		Connection & connection = client.connections.back();
+		std::deque< Movement_Input > const & pending = characterController->predictor.pending;
+		for (Movement_Input const & input : pending) {
+			if (connection.transport == Transport::TCP && input.sequence <= characterController->sent_sequence) continue;
+			myself.inputs.emplace_back(input);
 		}
-		
+		if (!pending.empty()) {
+			characterController->sent_sequence = pending.back().sequence;
+		}
+		// write msg straight into the send buffer
+		myself.send_message(connection);
 	}
 
 	//receive data:
@@ -494,8 +525,23 @@ void PlayMode::update(float elapsed) {
 		else { assert(event == Connection::OnRecv);
 			//std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
 			// descriptor: 'm' + size_of_message
-			size_t descriptor_size = 1 + sizeof(size_t);
+			size_t descriptor_size = 1 + sizeof(uint32_t);
 			
+			// newest state (over UDP) arrives on its own, as one whole message:
+			if (!c->recv_state.empty()) {
+				uint32_t size = 0;
+				if (c->recv_state.size() >= descriptor_size) {
+					memcpy(&size, c->recv_state.data() + 1, sizeof(uint32_t));
+					wire_swap(size);
+				}
+				if (c->recv_state[0] != 'm' || c->recv_state.size() != descriptor_size + size) {
+					throw std::runtime_error("Server sent a malformed state message");
+				}
+				read_server_message(reinterpret_cast< const unsigned char * >(c->recv_state.data()) + descriptor_size, size);
+				c->recv_state.clear();
+			}
+
+			// reliable stream:
 			while (c->recv_buffer.size() >= descriptor_size) {
 				//std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
 				char type = c->recv_buffer[0];
@@ -503,119 +549,175 @@ void PlayMode::update(float elapsed) {
 					throw std::runtime_error("Server sent unknown message type '" + std::to_string(type) + "'");
 				}
 				// get size
-				sizet_as_byte sizet_bytes;
-				for(size_t i=0; i < sizeof(size_t); i++){
-					sizet_bytes.bytes_value[i] = c->recv_buffer[1+i];
-				}
-				size_t size = sizet_bytes.sizet_value;
+				uint32_t size;
+				c->recv_buffer.copy_out(1, &size, sizeof(uint32_t));
+				wire_swap(size);
 				if (c->recv_buffer.size() < descriptor_size + size) break; //if whole message isn't here, can't process
-				//whole message *is* here, so set current server message:
-				server_message = std::vector<unsigned char>(c->recv_buffer.begin() + descriptor_size, c->recv_buffer.begin() + descriptor_size + size);
+				//whole message *is* here, so read it in place:
+				const char * message = c->recv_buffer.contiguous(descriptor_size + size) + descriptor_size;
+				read_server_message(reinterpret_cast< const unsigned char * >(message), size);
 				//and consume this part of the buffer:
-				c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + descriptor_size + size);
+				c->recv_buffer.consume(descriptor_size + size);
 			}
 		}
 	}, 0.0);
 
-	// update local state according to the server's message
-	{
-		assert(server_message.size() > 0);
-		// read the public stuff before offset. These are infos same for all players.
-		ping = (bool)server_message[0];
-		size_t i_offset = 1; // message after this contains all players' individual infos
-
-		// read player's info one by one
-		for(size_t i =i_offset; i < server_message.size(); ){
-
-			// get content of this player
-			std::vector<unsigned char> content(server_message.begin()+i, server_message.begin()+i+Server_Player::Server_Player_mes_size);
-			// ---------- read content ----------- //
-			Client_Player client_player;
-			uint8_t id;
-			bool gotHit;
-			AnimationState animState;
-			unsigned int current_frame;
-			client_player.read_from_message(content, id, gotHit, animState, current_frame);
-
-			// damage logic
-			if (id == my_id) {
-				// someone hit me
-				if (!hitLastTime && gotHit) {
-					combat_timer = MAX_COMBAT_TIME;
-					if (!is_in_combat) {
-						is_in_combat = true;
-						background_music->stop(1.0f);
-						combat_music = Sound::loop(*grime_sample, COMBAT_VOL);
-					}
-					
-					// parry successfully
-					if (blockTimer >= blockCD - blockZone) {
-						std::cout << "parry!!" << std::endl;
-						Sound::play_3D(*block_sample, FX_VOL, players_transform[my_id-1]->position, 1.0f);
-					}
-					// no parry
-					else {
-						health -= damage;
-						stunTimer = stunCD;
-						hitTimer = 0.0f;
-						blockTimer = 0.0f;
-						std::cout << "I am damaged!!" << std::endl;
-						Sound::play_3D(*damage_sample, FX_VOL, players_transform[my_id-1]->position, 1.0f);
-					}
-				}
-				hitLastTime = gotHit;	
-			}
+	// place other players where they were interpolation.delay ago:
+	interpolation.advance(elapsed);
+	for (uint8_t i = 0; i < PLAYER_NUM; i++) {
+		if (i + 1 == my_id || !players_transform[i]) continue;
+		Pose_Buffer::Result result = remote_poses[i].sample(interpolation.time, &players_transform[i]->position, &players_transform[i]->rotation);
+		interpolation_stats.add(result);
+	}
+	// report underruns (snapshots arriving too late for the delay) every few seconds
+	interpolation_report_timer += elapsed;
+	if (interpolation_report_timer >= 5.0f) {
+		if (interpolation_stats.underruns() != 0) {
+			std::cout << "[interpolation] " << interpolation_stats.underruns() << " of " << interpolation_stats.samples
+				<< " samples past the newest snapshot (" << interpolation_stats.held << " held); delay is " << interpolation.delay * 1000.0 << "ms" << std::endl;
+		}
+		interpolation_stats.reset();
+		if (render_report && scene.render_queue.frames != 0) {
+			Scene::RenderQueue::Stats const &total = scene.render_queue.total;
+			float frames = float(scene.render_queue.frames);
+			std::cout << "[render] per frame: " << total.culled / frames << " drawables culled, " << total.draws / frames << " draws (" << total.instanced_draws / frames << " instanced, of "
+				<< total.instances / frames << " drawables), " << total.calls() / frames << " GL calls (" << total.programs / frames << " programs, "
+				<< total.vaos / frames << " vertex arrays, " << total.textures / frames << " texture calls, " << total.uniforms / frames << " uniforms, "
+				<< total.attributes / frames << " instance attribute calls); " << total.unsorted / frames << " without sorting or instancing" << std::endl;
+		}
+		scene.render_queue.reset_totals();
+		interpolation_report_timer = 0.0f;
+	}
+
+	// std::cerr << "Finished update()\n";
+
+}
+
+// update local state according to a message from the server
+void PlayMode::read_server_message(const unsigned char * server_message, size_t size) {
+	// read the public stuff before offset. These are infos same for all players.
+	Server_Message_Header header;
+	if (size < sizeof(header)) {
+		throw std::runtime_error("Server sent a truncated message");
+	}
+	memcpy(&header, server_message, sizeof(header));
+	wire_swap(header);
+	if (header.version != NetworkProtocolVersion) {
+		throw std::runtime_error("Server speaks protocol version " + std::to_string(header.version) + ", expected " + std::to_string(NetworkProtocolVersion));
+	}
+	if (header.you >= header.player_count) {
+		throw std::runtime_error("Server sent a message without this client in it");
+	}
+	// (over UDP, an older snapshot can show up after a newer one; it's of no use)
+	if (header.tick <= server_snapshots.latest_tick()) return;
+	ping = (bool)header.ping;
+
+	// rebuild the snapshot from the delta against the baseline we acknowledged
+	Snapshot const * baseline = nullptr;
+	if (header.baseline_tick != 0) {
+		baseline = server_snapshots.find(header.baseline_tick);
+		if (!baseline) {
+			// (can happen over UDP if our acks were lost for a long while; the next update will use a newer ack)
+			std::cerr << "Dropping delta against unknown snapshot " << header.baseline_tick << std::endl;
+			return;
+		}
+	}
+	Snapshot snapshot;
+	snapshot.tick = header.tick;
+	snapshot.read_delta(baseline, header.player_count, reinterpret_cast< const char * >(server_message) + sizeof(header), size - sizeof(header));
+	double snapshot_time = double(header.tick) * ServerTick;
+	interpolation.on_snapshot(snapshot_time);
+
+	// read player's info one by one
+	for(size_t slot = 0; slot < snapshot.players.size(); slot++){
+
+		// ---------- read content ----------- //
+		Client_Player client_player;
+		uint8_t id;
+		bool gotHit;
+		AnimationState animState;
+		unsigned int current_frame;
+		client_player.read_from_snapshot(snapshot.players[slot], id, gotHit, animState, current_frame);
+		// (a server run for load testing can have more players than we have models for)
+		if (id > PLAYER_NUM) {
+			if (slot == header.you) throw std::runtime_error("Server gave this client id " + std::to_string(id) + ", but only " + std::to_string(PLAYER_NUM) + " players can be shown");
+			continue;
+		}
 
-			// --------- process info ---------- //
-			// is this my info ? (server will put my own info at first)
-			if(i == i_offset){
-				// if unkonwn before (following code only runs once)
-				if(my_id == 0){
-					my_id = id;
-					// set my init position and rotation accroding to my id
-					my_transform->position = playerInitPos + playerInitPosDistance * (float)(id-1);
-					my_transform->rotation = playerInitRot;
-					p1_transform->position = portalInitPos;
-					// p1_transform->rotation = playerInitRot;
-					p2_transform->position = portalInitPos;
-					// p2_transform->rotation = playerInitRot;
-					// enable my own model's drawing (delete if want to disable)
-					players_transform[id-1]->draw = true;
-					portal1_transform[id-1]->draw = true;
-					portal2_transform[id-1]->draw = true;
-					//adjust collision transform
-					collisionSystem->elements[my_id - 1]->parent = my_transform;
+		// damage logic
+		if (id == my_id) {
+			// someone hit me
+			if (!hitLastTime && gotHit) {
+				combat_timer = MAX_COMBAT_TIME;
+				if (!is_in_combat) {
+					is_in_combat = true;
+					background_music->stop(1.0f);
+					combat_music = Sound::loop(*grime_sample, COMBAT_VOL);
+				}
+				
+				// parry successfully
+				if (blockTimer >= blockCD - blockZone) {
+					std::cout << "parry!!" << std::endl;
+					Sound::play_3D(*block_sample, FX_VOL, players_transform[my_id-1]->position, 1.0f);
+				}
+				// no parry
+				else {
+					health -= damage;
+					stunTimer = stunCD;
+					hitTimer = 0.0f;
+					blockTimer = 0.0f;
+					std::cout << "I am damaged!!" << std::endl;
+					Sound::play_3D(*damage_sample, FX_VOL, players_transform[my_id-1]->position, 1.0f);
 				}
 			}
-			// other players' info, update their models' transform & portals
-			else{
+			hitLastTime = gotHit;	
+		}
+
+		// --------- process info ---------- //
+		// is this my info ? (header says which slot is mine)
+		if(slot == header.you){
+			// if unkonwn before (following code only runs once)
+			if(my_id == 0){
+				my_id = id;
+				// set my init position and rotation accroding to my id
+				my_transform->position = player_spawn_position(id);
+				my_transform->rotation = playerInitRot;
+				p1_transform->position = portalInitPos;
+				// p1_transform->rotation = playerInitRot;
+				p2_transform->position = portalInitPos;
+				// p2_transform->rotation = playerInitRot;
+				// enable my own model's drawing (delete if want to disable)
 				players_transform[id-1]->draw = true;
 				portal1_transform[id-1]->draw = true;
 				portal2_transform[id-1]->draw = true;
-				// positions
-				players_transform[id-1]->position = client_player.position;
-				portal1_transform[id-1]->position = client_player.portal1_position;
-				portal2_transform[id-1]->position = client_player.portal2_position;
-				// rotations
-				players_transform[id-1]->rotation = client_player.rotation;
-				portal1_transform[id-1]->rotation = client_player.portal1_rotation;
-				portal2_transform[id-1]->rotation = client_player.portal2_rotation;
-
-				if (animState != animation_machines[id-1].current_state) {
-					animation_machines[id-1].set_state(animState);
-				}
+				//adjust collision transform
+				collisionSystem->elements[my_id - 1]->parent = my_transform;
+			}
+			// rewind our prediction to where the server has us, and replay the inputs it hasn't simulated yet
+			characterController->Reconcile(header.last_input, movement_from_wire(header.movement));
+		}
+		// other players' info, update their models' transform & portals
+		else{
+			players_transform[id-1]->draw = true;
+			portal1_transform[id-1]->draw = true;
+			portal2_transform[id-1]->draw = true;
+			// player poses are buffered, and drawn interpolated (see end of update())
+			remote_poses[id-1].push(snapshot_time, client_player.position, client_player.rotation);
+			// portals don't move, they just get placed
+			portal1_transform[id-1]->position = client_player.portal1_position;
+			portal2_transform[id-1]->position = client_player.portal2_position;
+			portal1_transform[id-1]->rotation = client_player.portal1_rotation;
+			portal2_transform[id-1]->rotation = client_player.portal2_rotation;
+
+			if (animState != animation_machines[id-1].current_state) {
+				animation_machines[id-1].set_state(animState);
 			}
-
-			// move to next player's info
-			i += Server_Player::Server_Player_mes_size;
 		}
-
-		// game logic 
-
 	}
 
-	// std::cerr << "Finished update()\n";
+	server_snapshots.push(std::move(snapshot));
 
+	// game logic
 }
 
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
@@ -626,11 +728,13 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	my_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	//set up light type and position for lit_color_texture_program (and its instanced variant):
+	for (LitColorTextureProgram const *program : { &*lit_color_texture_program, &*lit_color_texture_program_instanced }) {
+		glUseProgram(program->program);
+		glUniform1i(program->LIGHT_TYPE_int, 1);
+		glUniform3fv(program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
+		glUniform3fv(program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	}
 	glUseProgram(0);
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
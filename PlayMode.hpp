@@ -4,6 +4,7 @@
 #include "Connection.hpp"
 #include "TextRenderer.hpp"
 #include "NetworkPlayer.hpp"
+#include "Interpolation.hpp"
 #include "CameraController.hpp"
 #include "CharacterController.hpp"
 #include "CollisionSystem.hpp"
@@ -61,10 +62,10 @@ struct PlayMode : Mode {
 	CollisionSystem* collisionSystem;
 
 	// gameplay related
-	const float attackDegree = 90.0f;
-	const float attackRadius = 2.0f;
-	const glm::vec3 portalInitPos = glm::vec3(-7,-1,-3);
+	const float attackDegree = AttackDegree;
+	const float attackRadius = AttackRadius;
 	uint8_t hit_id = 0; // who I hit (0 means hit no one)
+	bool attacking = false; // did an attack land this frame? (the server decides whom it hit)
 	bool hitLastTime = false;
 
 	// attack
@@ -86,7 +87,19 @@ struct PlayMode : Mode {
 	const float damage = 25.0f;
 	float health = 100.0f;
 	
-	bool ping;
+	bool ping = false;
+
+	// recent snapshots from the server (baselines for its delta updates)
+	Snapshot_History server_snapshots;
+
+	// other players are drawn interpolation.delay behind the newest snapshot, blending between snapshots
+	Interpolation_Clock interpolation;
+	std::array< Pose_Buffer, PLAYER_NUM > remote_poses;
+	Interpolation_Stats interpolation_stats;
+	float interpolation_report_timer = 0.0f;
+
+	// F3 toggles a report of GL calls per frame made by scene.draw (with the same timer)
+	bool render_report = false;
 
 	// font
 	std::shared_ptr<TextRenderer> hintFont;
@@ -102,8 +115,8 @@ struct PlayMode : Mode {
 	// transforms of all players' portal models, including my models
 	std::array <Scene::Transform *, PLAYER_NUM> portal1_transform{};
 	std::array <Scene::Transform *, PLAYER_NUM> portal2_transform{};
-	//last message from server:
-	std::vector<unsigned char> server_message;
+	//apply a message from server (read in place from the connection's recv_buffer):
+	void read_server_message(const unsigned char * server_message, size_t size);
 	//connection to server:
 	Client &client;
 
@@ -0,0 +1,140 @@
+#include "PoseHistory.hpp"
+#include "Combat.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cassert>
+
+PoseHistory::PoseHistory(size_t max_players_) : max_players(max_players_),
+	ticks(Capacity, 0), positions(Capacity * max_players_), present(Capacity * max_players_, 0),
+	nearby(AttackRadius, 256) {
+}
+
+void PoseHistory::begin_tick(uint32_t tick) {
+	assert(tick > newest_tick);
+	newest_tick = tick;
+	uint32_t s = tick % Capacity;
+	ticks[s] = tick;
+	std::fill(present.begin() + s * max_players, present.begin() + (s + 1) * max_players, uint8_t(0));
+}
+
+void PoseHistory::record(uint8_t id, glm::vec3 const &position) {
+	assert(newest_tick != 0 && id >= 1 && id <= max_players);
+	size_t i = (newest_tick % Capacity) * max_players + (id - 1);
+	positions[i] = position;
+	present[i] = 1;
+}
+
+int32_t PoseHistory::slot(uint32_t tick) const {
+	if (tick == 0 || tick > newest_tick) return -1;
+	uint32_t s = tick % Capacity;
+	return (ticks[s] == tick ? int32_t(s) : -1);
+}
+
+//clamp a view time to the ticks an attack may rewind to: (returns the slots to blend, and how far between them)
+static bool clamp_view(PoseHistory const &history, uint32_t &view_tick, float &view_fraction, int32_t &a, int32_t &b) {
+	if (history.newest_tick == 0) return false;
+	uint32_t oldest = (history.newest_tick > PoseHistory::MaxRewindTicks ? history.newest_tick - PoseHistory::MaxRewindTicks : 1);
+	if (view_tick >= history.newest_tick) {
+		view_tick = history.newest_tick;
+		view_fraction = 0.0f;
+	} else if (view_tick < oldest) {
+		view_tick = oldest;
+		view_fraction = 0.0f;
+	}
+	view_fraction = std::max(0.0f, std::min(1.0f, view_fraction));
+	a = history.slot(view_tick);
+	b = (view_fraction > 0.0f ? history.slot(view_tick + 1) : a);
+	return a >= 0 && b >= 0;
+}
+
+bool PoseHistory::rewind(uint8_t id, uint32_t view_tick, float view_fraction, glm::vec3 *position) const {
+	if (id < 1 || id > max_players) return false;
+	int32_t a, b;
+	if (!clamp_view(*this, view_tick, view_fraction, a, b)) return false;
+	size_t ia = size_t(a) * max_players + (id - 1);
+	size_t ib = size_t(b) * max_players + (id - 1);
+	if (!present[ia] || !present[ib]) return false;
+	*position = glm::mix(positions[ia], positions[ib], view_fraction);
+	return true;
+}
+
+uint8_t PoseHistory::find_target(uint8_t attacker, glm::vec3 const &position, glm::vec3 const &forward, uint32_t view_tick, float view_fraction, float attack_degree, float attack_radius) const {
+	Attack attack{attacker, AttackCone(position, forward, attack_degree, attack_radius), view_tick, view_fraction};
+	uint8_t target = 0;
+	find_targets(&attack, 1, &target);
+	return target;
+}
+
+void PoseHistory::find_targets(Attack const *attacks, size_t count, uint8_t *targets) const {
+	//which pair of ticks each attack blends between:
+	struct View {
+		int32_t a, b;
+		float fraction;
+		uint32_t index; //in attacks
+	};
+	std::vector< View > views;
+	views.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		targets[i] = 0;
+		uint32_t view_tick = attacks[i].view_tick;
+		float view_fraction = attacks[i].view_fraction;
+		int32_t a, b;
+		if (!clamp_view(*this, view_tick, view_fraction, a, b)) continue;
+		views.emplace_back(View{a, b, view_fraction, uint32_t(i)});
+	}
+	std::sort(views.begin(), views.end(), [](View const &x, View const &y) {
+		if (x.a != y.a) return x.a < y.a;
+		if (x.b != y.b) return x.b < y.b;
+		return x.index < y.index;
+	});
+
+	for (size_t begin = 0; begin < views.size(); ) {
+		size_t end = begin + 1;
+		while (end < views.size() && views[end].a == views[begin].a && views[end].b == views[begin].b) ++end;
+
+		glm::vec3 const *from = positions.data() + size_t(views[begin].a) * max_players;
+		glm::vec3 const *to = positions.data() + size_t(views[begin].b) * max_players;
+		uint8_t const *from_present = present.data() + size_t(views[begin].a) * max_players;
+		uint8_t const *to_present = present.data() + size_t(views[begin].b) * max_players;
+
+		//bucket the players around for the whole blend (at the earlier tick; the query radius
+		// is widened by RewindSlack to cover where they are by the view time):
+		movers.clear();
+		for (size_t i = 0; i < max_players; ++i) {
+			if (!from_present[i] || !to_present[i]) {
+				nearby.remove(uint32_t(i + 1));
+				continue;
+			}
+			glm::vec3 moved = to[i] - from[i];
+			if (glm::dot(moved, moved) > RewindSlack * RewindSlack) {
+				nearby.remove(uint32_t(i + 1));
+				movers.emplace_back(uint32_t(i + 1));
+			} else {
+				nearby.update(uint32_t(i + 1), from[i]);
+			}
+		}
+
+		//same as CollisionSystem::CheckOverLap, on the rewound positions of the players near each attacker:
+		for (size_t v = begin; v < end; ++v) {
+			Attack const &attack = attacks[views[v].index];
+			candidates.clear();
+			nearby.query_radius(attack.cone.position, attack.cone.radius + RewindSlack, &candidates);
+			candidates.insert(candidates.end(), movers.begin(), movers.end());
+			float nearest = std::numeric_limits< float >::infinity();
+			uint8_t &target = targets[views[v].index];
+			for (uint32_t id : candidates) {
+				if (id == attack.attacker) continue;
+				glm::vec3 then = glm::mix(from[id - 1], to[id - 1], views[v].fraction);
+				float distance2;
+				if (!attack.cone.contains(then, &distance2)) continue;
+				//(candidates come in no particular order, so ties go to the lowest id explicitly)
+				if (distance2 < nearest || (distance2 == nearest && id < target)) {
+					nearest = distance2;
+					target = uint8_t(id);
+				}
+			}
+		}
+		begin = end;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+ * PoseHistory keeps where every player was over the last few server ticks, so that the server
+ *  can judge an attack against what the attacker saw. A client draws other players
+ *  interpolated between past snapshots (see Interpolation.hpp), so by the time an attack
+ *  reaches the server its targets have moved on; rewinding them to the attacker's
+ *  view time and running the same cone test (Combat.hpp) there is fair to the attacker
+ *  without trusting it. (The view time is the client's word, though, so rewinds are capped
+ *  at MaxRewindTicks -- the interpolation delay plus a round trip -- and older view times
+ *  are judged as that old; a client can't reach back to where someone stood a second ago.)
+ *
+ * Storage is a ring of Capacity ticks, each a flat array of positions indexed by player id,
+ *  so a rewind is two array lookups per player. To judge attacks, each pair of ticks being
+ *  viewed has its players bucketed in a SpatialHash, so an attack only tests the players
+ *  near its attacker.
+ */
+
+#include "Combat.hpp"
+#include "SpatialHash.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct PoseHistory {
+	static constexpr uint32_t Capacity = 32; //ticks (1.6s at ServerTick) of positions kept
+	//furthest back an attack is judged: Interpolation_Clock's 0.1s delay (2 ticks) plus 150ms of round trip;
+	// older view times are clamped to this many ticks before the newest:
+	static constexpr uint32_t MaxRewindTicks = 5;
+	static_assert(MaxRewindTicks < Capacity, "rewinds stay within the stored ticks");
+
+	//ids run from 1 to max_players:
+	explicit PoseHistory(size_t max_players);
+
+	//start recording 'tick' (ticks must be recorded in increasing order):
+	void begin_tick(uint32_t tick);
+	//record where player 'id' is during the current tick:
+	void record(uint8_t id, glm::vec3 const &position);
+
+	//where was player 'id' at 'view_tick' + 'view_fraction' (in ticks)?
+	// returns false if the player wasn't around then.
+	bool rewind(uint8_t id, uint32_t view_tick, float view_fraction, glm::vec3 *position) const;
+
+	//the player an attacker at 'position' facing 'forward' would have hit at that view time (0 for nobody):
+	uint8_t find_target(uint8_t attacker, glm::vec3 const &position, glm::vec3 const &forward, uint32_t view_tick, float view_fraction, float attack_degree, float attack_radius) const;
+
+	//an attack to judge at its attacker's view time:
+	struct Attack {
+		uint8_t attacker;
+		AttackCone cone;
+		uint32_t view_tick;
+		float view_fraction;
+	};
+	//judge 'count' attacks at once (e.g. all that arrived this tick), setting targets[i] for attacks[i] as find_target() would:
+	// attacks viewing the same pair of ticks share one bucketing of those ticks' positions.
+	void find_targets(Attack const *attacks, size_t count, uint8_t *targets) const;
+
+	//internals:
+	size_t max_players;
+	uint32_t newest_tick = 0; //zero means nothing recorded
+	std::vector< uint32_t > ticks; //tick stored in each ring slot
+	std::vector< glm::vec3 > positions; //[slot * max_players + (id-1)]
+	std::vector< uint8_t > present; //same indexing; was this player around that tick?
+
+	//slot for 'tick', or -1 if it isn't stored:
+	int32_t slot(uint32_t tick) const;
+
+	//players are bucketed by where they were at the earlier of two ticks; anyone who moved further
+	// than this by the later one (e.g. through a portal) is tested against every attack instead:
+	static constexpr float RewindSlack = 0.5f;
+	//scratch for find_targets():
+	mutable SpatialHash nearby; //players present at both ticks being viewed, by id
+	mutable std::vector< uint32_t > movers; //ids that moved further than RewindSlack
+	mutable std::vector< uint32_t > candidates;
+};
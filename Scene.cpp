@@ -6,6 +6,10 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <limits>
 
 //-------------------------
 
@@ -79,95 +83,472 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //-------------------------
 
+void Scene::update_world() const {
+	WorldCache &cache = world_cache;
+	cache.passes += 1;
+	cache.recomputed = 0;
+
+	//(re)build the parent-before-child order: each transform goes in after its chain of not-yet-placed ancestors:
+	auto rebuild = [this, &cache]() {
+		cache.rebuilds += 1;
+		cache.entries.clear();
+		cache.entries.reserve(transforms.size());
+		for (auto const &t : transforms) t.slot = -1U;
+		std::vector< Transform const * > chain;
+		for (auto const &t : transforms) {
+			for (Transform const *at = &t; at && at->slot == -1U; at = at->parent) chain.emplace_back(at);
+			while (!chain.empty()) {
+				Transform const *at = chain.back();
+				chain.pop_back();
+				at->slot = uint32_t(cache.entries.size());
+				//(the NaN position marks the entry dirty for the first pass)
+				cache.entries.emplace_back(WorldCache::Entry{at, at->parent ? at->parent->slot : -1U, glm::vec3(std::numeric_limits< float >::quiet_NaN()), at->rotation, at->scale, 0});
+			}
+		}
+		cache.local_to_world.resize(cache.entries.size());
+		cache.changed.resize(cache.entries.size());
+	};
+	if (cache.entries.size() != transforms.size()) rebuild();
+
+	//one pass, parents first, recomputing only what moved (or whose parent moved):
+	for (uint32_t i = 0; i < cache.entries.size(); ++i) {
+		WorldCache::Entry &entry = cache.entries[i];
+		Transform const &t = *entry.transform;
+		uint32_t parent = (t.parent ? t.parent->slot : -1U);
+		if (parent != entry.parent || (parent != -1U && cache.entries[parent].transform != t.parent)) {
+			//reparented (or a new transform took an old one's place) -- start over with a fresh order:
+			rebuild();
+			i = -1U;
+			continue;
+		}
+		bool dirty = (parent != -1U && cache.changed[parent])
+			|| t.position != entry.position || t.rotation != entry.rotation || t.scale != entry.scale;
+		cache.changed[i] = dirty;
+		if (!dirty) continue;
+		entry.position = t.position;
+		entry.rotation = t.rotation;
+		entry.scale = t.scale;
+		entry.moved = cache.passes;
+		if (parent == -1U) {
+			cache.local_to_world[i] = t.make_local_to_parent();
+		} else {
+			cache.local_to_world[i] = cache.local_to_world[parent] * glm::mat4(t.make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		cache.recomputed += 1;
+	}
+}
 
-void Scene::draw(Camera const &camera, uint8_t my_id) const {
-	assert(camera.transform);
-	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
-	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
-	draw(my_id, world_to_clip, world_to_light);
+//-------------------------
+
+void Scene::update_bounds() const {
+	update_world();
+
+	BoundsCache &cache = bounds_cache;
+	cache.moved = 0;
+	cache.refitted = 0;
+
+	//world-space box around a drawable's object-space bounds:
+	auto world_box = [this](Drawable const &drawable, glm::vec3 *center, glm::vec3 *extent) {
+		glm::mat4x3 const &object_to_world = cached_local_to_world(*drawable.transform);
+		glm::vec3 local_center = 0.5f * (drawable.min + drawable.max);
+		glm::vec3 local_extent = 0.5f * (drawable.max - drawable.min);
+		*center = object_to_world * glm::vec4(local_center, 1.0f);
+		*extent = glm::abs(object_to_world[0]) * local_extent.x + glm::abs(object_to_world[1]) * local_extent.y + glm::abs(object_to_world[2]) * local_extent.z;
+	};
+
+	if (cache.drawable_count != drawables.size() || cache.world_rebuilds != world_cache.rebuilds) {
+		//new drawables or a new transform order -- gather everything and build a fresh tree:
+		cache.drawables.clear();
+		cache.slots.clear();
+		cache.unbounded.clear();
+		Frustum::Boxes boxes;
+		for (auto const &drawable : drawables) {
+			assert(drawable.transform); //drawables *must* have a transform
+			if (drawable.min.x <= drawable.max.x) {
+				glm::vec3 center, extent;
+				world_box(drawable, &center, &extent);
+				boxes.push(center, extent);
+				cache.drawables.emplace_back(&drawable);
+				cache.slots.emplace_back(drawable.transform->slot);
+			} else {
+				cache.unbounded.emplace_back(&drawable);
+			}
+		}
+		cache.bvh.build(boxes);
+		cache.builds += 1;
+		cache.moved = uint32_t(cache.drawables.size());
+		cache.drawable_count = drawables.size();
+		cache.world_rebuilds = world_cache.rebuilds;
+	} else {
+		//new boxes for drawables whose world matrices changed since the last update, then refit:
+		for (uint32_t i = 0; i < cache.drawables.size(); ++i) {
+			if (world_cache.entries[cache.slots[i]].moved <= cache.pass) continue;
+			glm::vec3 center, extent;
+			world_box(*cache.drawables[i], &center, &extent);
+			cache.bvh.update(i, center, extent);
+			cache.moved += 1;
+		}
+		cache.refitted = cache.bvh.refit();
+		if (cache.bvh.needs_rebuild()) {
+			cache.bvh.rebuild();
+			cache.builds += 1;
+		}
+	}
+	cache.pass = world_cache.passes;
 }
 
-void Scene::draw(uint8_t my_id, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+Scene::Drawable const *Scene::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *t,
+	std::function< bool(Drawable const &) > const &accept) const {
+	update_bounds();
+	BVH::Hit hit;
+	std::function< bool(uint32_t) > accept_item;
+	if (accept) accept_item = [&](uint32_t item) { return accept(*bounds_cache.drawables[item]); };
+	if (!bounds_cache.bvh.raycast(origin, direction, max_t, &hit, accept_item)) return nullptr;
+	if (t) *t = hit.t;
+	return bounds_cache.drawables[hit.item];
+}
 
-	// render to color and depth textures
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	GL_ERRORS();
-	glEnable(GL_DEPTH_TEST);
-	GL_ERRORS();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	GL_ERRORS();
+void Scene::overlap(glm::vec3 const &min, glm::vec3 const &max, std::vector< Drawable const * > *found,
+	std::function< bool(Drawable const &) > const &accept) const {
+	assert(found);
+	update_bounds();
+	std::vector< uint32_t > items;
+	bounds_cache.bvh.overlap(min, max, &items);
+	for (uint32_t item : items) {
+		Drawable const *drawable = bounds_cache.drawables[item];
+		if (!accept || accept(*drawable)) found->emplace_back(drawable);
+	}
+}
+
+//-------------------------
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+Scene::RenderQueue::~RenderQueue() {
+	if (instance_buffer != 0) {
+		glDeleteBuffers(1, &instance_buffer);
+		instance_buffer = 0;
+	}
+}
+
+void Scene::RenderQueue::Stats::add(Stats const &other) {
+	culled += other.culled;
+	draws += other.draws;
+	instanced_draws += other.instanced_draws;
+	instances += other.instances;
+	programs += other.programs;
+	vaos += other.vaos;
+	textures += other.textures;
+	uniforms += other.uniforms;
+	attributes += other.attributes;
+	unsorted += other.unsorted;
+}
+
+void Scene::RenderQueue::build(Scene const &scene, glm::mat4 const &world_to_clip) {
+	//key layout, most significant first:
+	constexpr uint32_t ProgramBits = 8, VaoBits = 10, TextureBits = 14, MeshBits = 14, DepthBits = 18;
+	static_assert(ProgramBits + VaoBits + TextureBits + MeshBits + DepthBits == 64, "sort key fields fill 64 bits");
+
+	auto rank = [](auto &ranks, auto const &value, uint32_t bits) -> uint64_t {
+		auto f = ranks.find(value);
+		if (f == ranks.end()) f = ranks.emplace(value, uint32_t(ranks.size())).first;
+		return std::min(f->second, (1u << bits) - 1u);
+	};
+
+	//(a new frame starts here)
+	frame = Stats();
+
+	//find the drawables with bounds in view (through the BVH, testing its leaves' boxes four at a time):
+	BoundsCache const &bounds = scene.bounds_cache;
+	visible.clear();
+	bounds.bvh.cull(Frustum(world_to_clip), &visible);
+	frame.culled = uint32_t(bounds.drawables.size() - visible.size());
+
+	//key those and the drawables without bounds, if they would draw something:
+	glm::vec4 row_w = glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]);
+	items.clear();
+	auto gather = [&](Drawable const &drawable) {
+		Drawable::Pipeline const &pipeline = drawable.pipeline;
 
 		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		if (pipeline.program == 0) return;
 		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
+		if (pipeline.vao == 0) return;
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		if (pipeline.count == 0) return;
 
 		// skip if specified not to draw
-		if(!drawable.transform->draw) continue;
+		assert(drawable.transform); //drawables *must* have a transform
+		if (!drawable.transform->draw) return;
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+		Item item;
+		item.drawable = &drawable;
+		item.object_to_world = scene.cached_local_to_world(*drawable.transform);
 
+		std::array< GLuint, Drawable::Pipeline::TextureCount > texture_set;
+		for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+			texture_set[t] = pipeline.textures[t].texture;
+		}
+
+		//depth is the clip-space w of the object's origin; non-negative floats sort the same as their bits,
+		// so the top bits of the float make a good-enough fixed-size depth:
+		float w = std::max(0.0f, glm::dot(row_w, glm::vec4(item.object_to_world[3], 1.0f)));
+		uint32_t w_bits;
+		memcpy(&w_bits, &w, sizeof(w_bits));
+
+		item.key =
+			  (rank(program_ranks, pipeline.program, ProgramBits) << (VaoBits + TextureBits + MeshBits + DepthBits))
+			| (rank(vao_ranks, pipeline.vao, VaoBits) << (TextureBits + MeshBits + DepthBits))
+			| (rank(texture_ranks, texture_set, TextureBits) << (MeshBits + DepthBits))
+			| (rank(mesh_ranks, std::array< GLuint, 3 >{ pipeline.type, pipeline.start, pipeline.count }, MeshBits) << DepthBits)
+			| uint64_t(w_bits >> (32 - DepthBits));
+		items.emplace_back(item);
+	};
+	for (uint32_t i : visible) gather(*bounds.drawables[i]);
+	for (Drawable const *drawable : bounds.unbounded) gather(*drawable);
+
+	std::sort(items.begin(), items.end(), [](Item const &a, Item const &b) {
+		return a.key < b.key;
+	});
+}
+
+void Scene::RenderQueue::submit(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) {
+
+	//can 'b' be drawn in the same instanced call as 'a'?
+	auto same_instances = [](Drawable::Pipeline const &a, Drawable::Pipeline const &b) {
+		if (a.program != b.program || a.vao != b.vao) return false;
+		if (a.type != b.type || a.start != b.start || a.count != b.count) return false;
+		if (a.instanced.program != b.instanced.program || a.instanced.vao != b.instanced.vao) return false;
+		if (b.set_uniforms) return false;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (a.textures[i].texture != b.textures[i].texture || a.textures[i].target != b.textures[i].target) return false;
+		}
+		return true;
+	};
+
+	//the matrices a drawable's program needs:
+	auto make_instance = [&world_to_clip, &world_to_light](Item const &item) {
+		Instance instance;
+		instance.object_to_clip = world_to_clip * glm::mat4(item.object_to_world);
+		instance.object_to_light = world_to_light * glm::mat4(item.object_to_world);
+		instance.normal_to_light = glm::inverse(glm::transpose(glm::mat3(instance.object_to_light)));
+		return instance;
+	};
+
+	//split the items into runs, each drawn with one call; gather the matrices of instanced runs:
+	struct Run {
+		uint32_t begin, end;
+		uint32_t first_instance; //-1U if not instanced
+	};
+	std::vector< Run > runs;
+	runs.reserve(items.size());
+	instances.clear();
+	for (uint32_t begin = 0; begin < items.size(); ) {
+		Drawable::Pipeline const &pipeline = items[begin].drawable->pipeline;
+		uint32_t end = begin + 1;
+		if (pipeline.instanced.program != 0 && pipeline.instanced.vao != 0 && !pipeline.set_uniforms) {
+			while (end < items.size() && same_instances(pipeline, items[end].drawable->pipeline)) ++end;
+		}
+		if (end - begin >= MinInstances) {
+			runs.emplace_back(Run{begin, end, uint32_t(instances.size())});
+			for (uint32_t i = begin; i < end; ++i) {
+				instances.emplace_back(make_instance(items[i]));
+			}
+		} else {
+			for (uint32_t i = begin; i < end; ++i) {
+				runs.emplace_back(Run{i, i + 1, -1U});
+			}
+		}
+		begin = end;
+	}
+
+	//upload all the instance matrices at once (the buffer stays bound for the attribute pointers below):
+	if (!instances.empty()) {
+		if (instance_buffer == 0) glGenBuffers(1, &instance_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+		frame.attributes += 2;
+	}
+
+	//state as last set by this function (the program and vertex array start unbound; so do the textures,
+	// since draw() unbinds the screen textures after its quad pass; the active texture unit, though, is
+	// whatever the last caller left, so reset it):
+	GLuint program = 0;
+	GLuint vao = 0;
+	Drawable::Pipeline::TextureInfo bound[Drawable::Pipeline::TextureCount];
+	uint32_t active = 0;
+	glActiveTexture(GL_TEXTURE0);
+	frame.textures += 1;
+
+	auto use = [&](GLuint want_program, GLuint want_vao) {
+		//Set shader program:
+		if (want_program != program) {
+			program = want_program;
+			glUseProgram(program);
+			frame.programs += 1;
+		}
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		if (want_vao != vao) {
+			vao = want_vao;
+			glBindVertexArray(vao);
+			frame.vaos += 1;
+		}
+	};
 
-		//Configure program uniforms:
+	//set up textures (unbinding any left over from earlier drawables on slots this one doesn't use):
+	auto bind_textures = [&](Drawable::Pipeline const &pipeline) {
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			if (want.texture == bound[i].texture && (want.texture == 0 || want.target == bound[i].target)) continue;
+			if (active != i) {
+				active = i;
+				glActiveTexture(GL_TEXTURE0 + i);
+				frame.textures += 1;
+			}
+			if (want.texture != 0) {
+				if (bound[i].texture != 0 && bound[i].target != want.target) {
+					glBindTexture(bound[i].target, 0);
+					frame.textures += 1;
+				}
+				glBindTexture(want.target, want.texture);
+				bound[i] = want;
+			} else {
+				glBindTexture(bound[i].target, 0);
+				bound[i].texture = 0;
+			}
+			frame.textures += 1;
+		}
+	};
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+	//point a matrix attribute (one location per column) at the instance buffer:
+	auto instance_attribute = [&](GLuint location, uint32_t columns, uint32_t rows, size_t offset) {
+		if (location == -1U) return;
+		for (uint32_t c = 0; c < columns; ++c) {
+			glVertexAttribPointer(location + c, rows, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLbyte *)0 + offset + c * rows * sizeof(float));
+		}
+		frame.attributes += columns;
+	};
+
+	for (Run const &run : runs) {
+		Drawable::Pipeline const &pipeline = items[run.begin].drawable->pipeline;
+
+		//(what the unsorted loop made: use, bind, uniforms, activate + bind per texture, draw, activate + unbind per texture, reset the active texture)
+		uint32_t texture_count = 0;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			texture_count += (pipeline.textures[i].texture != 0);
+		}
+		frame.unsorted += (run.end - run.begin) * (2 + uint32_t(pipeline.OBJECT_TO_CLIP_mat4 != -1U) + uint32_t(pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U)
+			+ uint32_t(pipeline.NORMAL_TO_LIGHT_mat3 != -1U) + 2 * texture_count + 1 + 2 * texture_count + 1);
+
+		if (run.first_instance != -1U) {
+			Drawable::Pipeline::Instanced const &instanced = pipeline.instanced;
+			use(instanced.program, instanced.vao);
+
+			//instance attributes are enabled (with a divisor of one) once per vertex array:
+			if (instance_vaos.insert(vao).second) {
+				auto enable = [&](GLuint location, uint32_t columns) {
+					if (location == -1U) return;
+					for (uint32_t c = 0; c < columns; ++c) {
+						glEnableVertexAttribArray(location + c);
+						glVertexAttribDivisor(location + c, 1);
+					}
+					frame.attributes += 2 * columns;
+				};
+				enable(instanced.OBJECT_TO_CLIP_mat4, 4);
+				enable(instanced.OBJECT_TO_LIGHT_mat4x3, 4);
+				enable(instanced.NORMAL_TO_LIGHT_mat3, 3);
+			}
+			//...but the pointers move to this run's matrices:
+			size_t base = run.first_instance * sizeof(Instance);
+			instance_attribute(instanced.OBJECT_TO_CLIP_mat4, 4, 4, base + offsetof(Instance, object_to_clip));
+			instance_attribute(instanced.OBJECT_TO_LIGHT_mat4x3, 4, 3, base + offsetof(Instance, object_to_light));
+			instance_attribute(instanced.NORMAL_TO_LIGHT_mat3, 3, 3, base + offsetof(Instance, normal_to_light));
+
+			bind_textures(pipeline);
+
+			//draw all of the objects:
+			glDrawArraysInstanced(pipeline.type, pipeline.start, pipeline.count, run.end - run.begin);
+			frame.draws += 1;
+			frame.instanced_draws += 1;
+			frame.instances += run.end - run.begin;
+			continue;
+		}
+
+		Item const &item = items[run.begin];
+		use(pipeline.program, pipeline.vao);
+
+		//Configure program uniforms:
+		Instance instance = make_instance(item);
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(instance.object_to_clip));
+			frame.uniforms += 1;
 		}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
-
 		//OBJECT_TO_CLIP takes vertices from object space to light space:
 		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(instance.object_to_light));
+			frame.uniforms += 1;
 		}
 
 		//NORMAL_TO_CLIP takes normals from object space to light space:
 		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(instance.normal_to_light));
+			frame.uniforms += 1;
 		}
 
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
-			}
-		}
+		bind_textures(pipeline);
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		frame.draws += 1;
+	}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (bound[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(bound[i].target, 0);
+			frame.textures += 2;
 		}
-		glActiveTexture(GL_TEXTURE0);
-
 	}
+	glActiveTexture(GL_TEXTURE0);
+	frame.textures += 1;
+	if (!instances.empty()) {
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		frame.attributes += 1;
+	}
+
+	total.add(frame);
+	frames += 1;
+}
+
+//-------------------------
+
+
+void Scene::draw(Camera const &camera, uint8_t my_id) const {
+	assert(camera.transform);
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
+	draw(my_id, world_to_clip, world_to_light);
+}
+
+void Scene::draw(uint8_t my_id, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+
+	// render to color and depth textures
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GL_ERRORS();
+	glEnable(GL_DEPTH_TEST);
+	GL_ERRORS();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GL_ERRORS();
+
+	//Bring world matrices and bounds up to date, sort the drawables in view by the state they need, then send them to OpenGL:
+	update_bounds();
+	render_queue.build(*this, world_to_clip);
+	render_queue.submit(world_to_clip, world_to_light);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -182,7 +563,7 @@ void Scene::draw(uint8_t my_id, glm::mat4 const &world_to_clip, glm::mat4x3 cons
 
 		glUseProgram(skeletal.program);
 		GL_ERRORS();
-		glm::mat4x3 object_to_world = skeletal.transform->make_local_to_world();
+		glm::mat4x3 object_to_world = cached_local_to_world(*skeletal.transform);
 		glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
 
 		unsigned int mvp_loc = glGetUniformLocation(skeletal.program, "MVP");
@@ -224,6 +605,13 @@ void Scene::draw(uint8_t my_id, glm::mat4 const &world_to_clip, glm::mat4x3 cons
 	GL_ERRORS();
 	glBindVertexArray(0);
 	glUseProgram(0);
+
+	// unbind the screen textures and leave texture unit 0 active (RenderQueue::submit expects textures unbound)
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	GL_ERRORS();
 }
 
 
@@ -541,6 +929,8 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 
 	//Copy transforms and store mapping:
 	transforms.clear();
+	world_cache.clear();
+	bounds_cache.clear();
 	for (auto const &t : other.transforms) {
 		transforms.emplace_back();
 		transforms.back().name = t.name;
@@ -11,6 +11,8 @@
  */
 
 #include "GL.hpp"
+#include "Frustum.hpp"
+#include "BVH.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -21,6 +23,10 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <array>
+#include <limits>
 
 #include "Skeletal.hpp"
 
@@ -52,6 +58,9 @@ struct Scene {
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+
+		//index of this transform in its scene's world cache (managed by Scene::update_world):
+		mutable uint32_t slot = -1U;
 	};
 
 	struct Drawable {
@@ -59,6 +68,11 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//object-space bounding box (e.g., the Mesh's min and max), used to skip drawables outside the view;
+		// the default (min > max) means "unknown", and such drawables are always drawn:
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -83,6 +97,17 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//(optional) instanced variant of the program, which reads the three matrices above from per-instance attributes:
+			// draw() uses it to draw drawables with otherwise identical pipelines (and no set_uniforms) in one call
+			struct Instanced {
+				GLuint program = 0; //0 means "never instance"
+				GLuint vao = 0; //vertex array for 'program' with the same vertex attributes as 'vao'
+				//attribute locations (matrix columns take consecutive locations):
+				GLuint OBJECT_TO_CLIP_mat4 = -1U;
+				GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
+				GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+			} instanced;
 		} pipeline;
 	};
 
@@ -149,6 +174,77 @@ struct Scene {
 		void update_nodes(int i);
 	};
 
+	//"RenderQueue" is scratch space for draw(): each frame it sorts the drawables by a key made of
+	// (program, vertex array, textures, mesh, depth), so that drawables sharing state are drawn back-to-back,
+	// and then sets only the GL state that actually changes from one drawable to the next.
+	//Drawables with bounds whose world-space box is outside the view frustum are culled (through the scene's
+	// bounds_cache BVH) before sorting.
+	//Within the same state, nearer drawables come first (so the depth test can reject more fragments).
+	//Runs of at least MinInstances drawables of the same mesh with an instanced program are drawn with one
+	// glDrawArraysInstanced, their matrices streamed through one instance buffer per frame.
+	//n.b. a drawable's set_uniforms callback must not change the program, vertex array, or texture bindings.
+	struct RenderQueue {
+		static constexpr uint32_t MinInstances = 4; //(an instanced run costs about as many calls as three separate draws)
+
+		RenderQueue() = default;
+		RenderQueue(RenderQueue const &) = delete;
+		~RenderQueue();
+
+		//GL calls made by draw() (per frame, or summed over frames):
+		struct Stats {
+			uint32_t culled = 0; //drawables skipped as outside the view frustum (not GL calls)
+			uint32_t draws = 0; //glDrawArrays and glDrawArraysInstanced
+			uint32_t instanced_draws = 0; //(of which instanced)
+			uint32_t instances = 0; //drawables drawn by instanced draws
+			uint32_t programs = 0; //glUseProgram
+			uint32_t vaos = 0; //glBindVertexArray
+			uint32_t textures = 0; //glActiveTexture and glBindTexture
+			uint32_t uniforms = 0; //matrix uniforms (not counting set_uniforms callbacks)
+			uint32_t attributes = 0; //instance buffer binds, uploads, and attribute pointers
+			uint32_t unsorted = 0; //calls that binding everything for every drawable drawn would have made
+			uint32_t calls() const { return draws + programs + vaos + textures + uniforms + attributes; }
+			void add(Stats const &other);
+		};
+
+		struct Item {
+			uint64_t key;
+			Drawable const *drawable;
+			glm::mat4x3 object_to_world;
+		};
+
+		//cull the scene's drawables against the view, key each one in view that would draw something, then sort:
+		// (reads world matrices and boxes from the scene's caches, so call update_bounds() first)
+		void build(Scene const &scene, glm::mat4 const &world_to_clip);
+		//draw the sorted items, setting only the state that changes between them:
+		void submit(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light);
+
+		std::vector< Item > items;
+		std::vector< uint32_t > visible; //(scratch) bounds_cache items in view
+
+		//program, vertex array, texture set, and mesh each get a small number the first time they are seen,
+		// so that they pack into the key (anything past the field's range shares the last number):
+		std::unordered_map< GLuint, uint32_t > program_ranks;
+		std::unordered_map< GLuint, uint32_t > vao_ranks;
+		std::map< std::array< GLuint, Drawable::Pipeline::TextureCount >, uint32_t > texture_ranks;
+		std::map< std::array< GLuint, 3 >, uint32_t > mesh_ranks; //(type, start, count)
+
+		//per-instance matrices, as the instanced programs read them:
+		struct Instance {
+			glm::mat4 object_to_clip;
+			glm::mat4x3 object_to_light;
+			glm::mat3 normal_to_light;
+		};
+		static_assert(sizeof(Instance) == 4 * (16 + 12 + 9), "Instance is packed.");
+		std::vector< Instance > instances;
+		GLuint instance_buffer = 0; //(created on first use)
+		std::unordered_set< GLuint > instance_vaos; //instanced vaos whose instance attributes are already enabled
+
+		Stats frame; //last frame
+		Stats total; //since the last reset
+		uint32_t frames = 0; //frames in 'total'
+		void reset_totals() { total = Stats(); frames = 0; }
+	};
+
 	//Scenes, of course, may have many of the above objects:
 	std::list< Transform > transforms;
 	std::list< Drawable > drawables;
@@ -159,6 +255,82 @@ struct Scene {
 	// Scene now needs to store the framebuffer as well. Ugly  coupling, but eh
 	unsigned int fbo, color_tex, depth_tex, quad_program, quad_vao;
 
+	//"WorldCache" keeps the transforms in a flat array, parents before children, next to a cached
+	// local-to-world matrix for each, so that world matrices are computed in one linear pass per frame
+	// rather than by walking each drawable's parent chain.
+	//Gameplay code still just writes a transform's position, rotation, and scale (Transform pointers stay
+	// the handles), so the cache also keeps a copy of those: a transform is dirty if they differ from the
+	// copy or if its parent's matrix changed this pass, and only dirty transforms are recomputed.
+	//Adding transforms or changing parents is noticed and rebuilds the order.
+	//n.b. removing a transform from 'transforms' must be followed by world_cache.clear().
+	struct WorldCache {
+		struct Entry {
+			Transform const *transform;
+			uint32_t parent; //index of the parent's entry (-1U for none; always less than this entry's index)
+			glm::vec3 position; //local transformation as of the last update
+			glm::quat rotation;
+			glm::vec3 scale;
+			uint32_t moved; //pass in which local_to_world last changed
+		};
+		std::vector< Entry > entries;
+		std::vector< glm::mat4x3 > local_to_world; //(parallel to entries)
+		std::vector< uint8_t > changed; //(scratch) did this entry's matrix change in the current pass?
+
+		uint32_t passes = 0; //update_world() calls (ever)
+		//last update:
+		uint32_t rebuilds = 0; //times the order was rebuilt (ever)
+		uint32_t recomputed = 0; //matrices recomputed
+
+		void clear() { entries.clear(); }
+	};
+
+	//bring world_cache up to date with the transforms (update_bounds(), and so draw(), calls this first):
+	void update_world() const;
+	//local-to-world matrix of 'transform' as of the last update_world():
+	glm::mat4x3 const &cached_local_to_world(Transform const &transform) const {
+		assert(transform.slot < world_cache.local_to_world.size() && world_cache.entries[transform.slot].transform == &transform);
+		return world_cache.local_to_world[transform.slot];
+	}
+
+	//"BoundsCache" keeps the world-space boxes of the drawables that have bounds in a BVH, for culling
+	// and for scene queries. The BVH is built (with the surface area heuristic) when drawables are added
+	// or the world cache's order is rebuilt; otherwise only the boxes of drawables whose world matrices
+	// changed are updated and the tree refit, with a fresh build once refitting has made it much looser.
+	//n.b. changing a drawable's min/max (or removing a drawable) must be followed by bounds_cache.clear().
+	struct BoundsCache {
+		std::vector< Drawable const * > drawables; //BVH items
+		std::vector< uint32_t > slots; //(parallel to drawables) world cache entry of each one's transform
+		std::vector< Drawable const * > unbounded; //drawables without bounds (never culled)
+		BVH bvh;
+		size_t drawable_count = size_t(-1); //scene drawables when gathered
+		uint32_t world_rebuilds = 0; //world_cache.rebuilds when gathered
+		uint32_t pass = 0; //world_cache.passes as of the last update
+
+		//last update:
+		uint32_t builds = 0; //times the BVH was built (ever)
+		uint32_t moved = 0; //boxes updated
+		uint32_t refitted = 0; //BVH nodes refit
+
+		void clear() { drawable_count = size_t(-1); }
+	};
+
+	//bring world_cache and then bounds_cache up to date (draw() calls this first):
+	void update_bounds() const;
+
+	//scene queries against drawable bounds (bringing the caches up to date first);
+	// drawables for which 'accept' returns false are ignored:
+	//nearest drawable whose box is hit by origin + t * direction for 0 <= t <= max_t (nullptr if none):
+	Drawable const *raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *t = nullptr,
+		std::function< bool(Drawable const &) > const &accept = nullptr) const;
+	//drawables whose boxes overlap the box from 'min' to 'max':
+	void overlap(glm::vec3 const &min, glm::vec3 const &max, std::vector< Drawable const * > *drawables,
+		std::function< bool(Drawable const &) > const &accept = nullptr) const;
+
+	//(all rebuilt every frame by draw(), which is const)
+	mutable WorldCache world_cache;
+	mutable BoundsCache bounds_cache;
+	mutable RenderQueue render_queue;
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera, uint8_t my_id) const;
 
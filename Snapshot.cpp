@@ -0,0 +1,224 @@
+#include "Snapshot.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+#include <cmath>
+
+int16_t quantize_position(float v) {
+	v = std::max(-PositionExtent, std::min(PositionExtent, v));
+	return int16_t(std::lround(v / PositionExtent * 32767.0f));
+}
+
+float dequantize_position(int16_t q) {
+	return float(q) / 32767.0f * PositionExtent;
+}
+
+//the three smaller components of a unit quaternion lie in [-1/sqrt(2), 1/sqrt(2)]:
+static constexpr float SmallestThreeRange = 0.70710678f;
+static constexpr uint32_t SmallestThreeMax = (1 << 10) - 1;
+
+uint32_t quantize_rotation(glm::quat q) {
+	q = glm::normalize(q);
+	float c[4] = {q.x, q.y, q.z, q.w};
+
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i) {
+		if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+	}
+	//q and -q are the same rotation, so flip to make the dropped component positive:
+	float sign = (c[largest] < 0.0f ? -1.0f : 1.0f);
+
+	uint32_t bits = largest;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float v = (sign * c[i] / SmallestThreeRange) * 0.5f + 0.5f;
+		long s = std::lround(v * float(SmallestThreeMax));
+		bits = (bits << 10) | uint32_t(std::max(0L, std::min(long(SmallestThreeMax), s)));
+	}
+	return bits;
+}
+
+glm::quat dequantize_rotation(uint32_t bits) {
+	uint32_t largest = bits >> 30;
+	float c[4];
+	float sum = 0.0f;
+	for (int32_t i = 3; i >= 0; --i) {
+		if (uint32_t(i) == largest) continue;
+		float v = float(bits & SmallestThreeMax) / float(SmallestThreeMax);
+		bits >>= 10;
+		c[i] = (v - 0.5f) * 2.0f * SmallestThreeRange;
+		sum += c[i] * c[i];
+	}
+	c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+	return glm::normalize(glm::quat(c[3], c[0], c[1], c[2]));
+}
+
+void Quantized_Pose::set(glm::vec3 const &position_, glm::quat const &rotation_) {
+	for (uint32_t i = 0; i < 3; ++i) {
+		position[i] = quantize_position(position_[i]);
+	}
+	rotation = quantize_rotation(rotation_);
+}
+
+void Quantized_Pose::get(glm::vec3 *position_, glm::quat *rotation_) const {
+	if (position_) {
+		*position_ = glm::vec3(dequantize_position(position[0]), dequantize_position(position[1]), dequantize_position(position[2]));
+	}
+	if (rotation_) {
+		*rotation_ = dequantize_rotation(rotation);
+	}
+}
+
+uint8_t Quantized_Player::dirty_mask(Quantized_Player const *baseline) const {
+	if (!baseline) return AllFields;
+	auto position_differs = [](Quantized_Pose const &a, Quantized_Pose const &b) {
+		return a.position[0] != b.position[0] || a.position[1] != b.position[1] || a.position[2] != b.position[2];
+	};
+	uint8_t mask = 0;
+	if (position_differs(player, baseline->player)) mask |= PlayerPosition;
+	if (player.rotation != baseline->player.rotation) mask |= PlayerRotation;
+	if (position_differs(portal1, baseline->portal1)) mask |= Portal1Position;
+	if (portal1.rotation != baseline->portal1.rotation) mask |= Portal1Rotation;
+	if (position_differs(portal2, baseline->portal2)) mask |= Portal2Position;
+	if (portal2.rotation != baseline->portal2.rotation) mask |= Portal2Rotation;
+	if (got_hit != baseline->got_hit || anim_state != baseline->anim_state) mask |= State;
+	if (cur_frame != baseline->cur_frame) mask |= Frame;
+	return mask;
+}
+
+Quantized_Player const *Snapshot::find(uint8_t id) const {
+	for (auto const &p : players) {
+		if (p.id == id) return &p;
+	}
+	return nullptr;
+}
+
+Snapshot_Index::Snapshot_Index(Snapshot const *snapshot_) : snapshot(snapshot_) {
+	slots.fill(0);
+	if (!snapshot) return;
+	assert(snapshot->players.size() <= 255);
+	for (size_t i = 0; i < snapshot->players.size(); ++i) {
+		slots[snapshot->players[i].id] = uint8_t(i + 1);
+	}
+}
+
+//little-endian writing/reading helpers:
+static void put_u8(std::vector< char > *out, uint8_t v) {
+	out->emplace_back(char(v));
+}
+static void put_u16(std::vector< char > *out, uint16_t v) {
+	out->emplace_back(char(v & 0xff));
+	out->emplace_back(char(v >> 8));
+}
+static void put_u32(std::vector< char > *out, uint32_t v) {
+	put_u16(out, uint16_t(v & 0xffff));
+	put_u16(out, uint16_t(v >> 16));
+}
+
+namespace {
+struct Reader {
+	char const *data;
+	size_t size;
+	size_t at = 0;
+
+	void need(size_t count) {
+		if (at + count > size) throw std::runtime_error("Snapshot delta is truncated.");
+	}
+	uint8_t u8() {
+		need(1);
+		return uint8_t(data[at++]);
+	}
+	uint16_t u16() {
+		uint16_t lo = u8();
+		uint16_t hi = u8();
+		return uint16_t(lo | (hi << 8));
+	}
+	uint32_t u32() {
+		uint32_t lo = u16();
+		uint32_t hi = u16();
+		return lo | (hi << 16);
+	}
+};
+}
+
+void Snapshot::write_delta(Snapshot const *baseline, std::vector< char > *out) const {
+	Snapshot_Index base(baseline);
+	for (auto const &p : players) {
+		uint8_t mask = p.dirty_mask(base.find(p.id));
+		put_u8(out, p.id);
+		put_u8(out, mask);
+
+		auto put_position = [&](Quantized_Pose const &pose) {
+			for (uint32_t i = 0; i < 3; ++i) put_u16(out, uint16_t(pose.position[i]));
+		};
+		if (mask & Quantized_Player::PlayerPosition) put_position(p.player);
+		if (mask & Quantized_Player::PlayerRotation) put_u32(out, p.player.rotation);
+		if (mask & Quantized_Player::Portal1Position) put_position(p.portal1);
+		if (mask & Quantized_Player::Portal1Rotation) put_u32(out, p.portal1.rotation);
+		if (mask & Quantized_Player::Portal2Position) put_position(p.portal2);
+		if (mask & Quantized_Player::Portal2Rotation) put_u32(out, p.portal2.rotation);
+		if (mask & Quantized_Player::State) {
+			put_u8(out, p.got_hit);
+			put_u8(out, p.anim_state);
+		}
+		if (mask & Quantized_Player::Frame) put_u32(out, p.cur_frame);
+	}
+}
+
+void Snapshot::read_delta(Snapshot const *baseline, uint8_t count, char const *data, size_t size) {
+	Reader in{data, size};
+	Snapshot_Index bases(baseline);
+	players.clear();
+	players.reserve(count);
+	for (uint32_t e = 0; e < count; ++e) {
+		Quantized_Player p;
+		p.id = in.u8();
+		uint8_t mask = in.u8();
+
+		//fields not in the mask come from the baseline:
+		Quantized_Player const *base = bases.find(p.id);
+		if (mask != Quantized_Player::AllFields) {
+			if (!base) throw std::runtime_error("Snapshot delta references player " + std::to_string(p.id) + ", who is missing from the baseline.");
+			p = *base;
+		}
+
+		auto get_position = [&](Quantized_Pose *pose) {
+			for (uint32_t i = 0; i < 3; ++i) pose->position[i] = int16_t(in.u16());
+		};
+		if (mask & Quantized_Player::PlayerPosition) get_position(&p.player);
+		if (mask & Quantized_Player::PlayerRotation) p.player.rotation = in.u32();
+		if (mask & Quantized_Player::Portal1Position) get_position(&p.portal1);
+		if (mask & Quantized_Player::Portal1Rotation) p.portal1.rotation = in.u32();
+		if (mask & Quantized_Player::Portal2Position) get_position(&p.portal2);
+		if (mask & Quantized_Player::Portal2Rotation) p.portal2.rotation = in.u32();
+		if (mask & Quantized_Player::State) {
+			p.got_hit = in.u8();
+			p.anim_state = in.u8();
+		}
+		if (mask & Quantized_Player::Frame) p.cur_frame = in.u32();
+		players.emplace_back(p);
+	}
+	if (in.at != size) throw std::runtime_error("Snapshot delta has " + std::to_string(size - in.at) + " trailing bytes.");
+}
+
+void Snapshot_History::push(Snapshot &&snapshot) {
+	snapshots.emplace_back(std::move(snapshot));
+	while (snapshots.size() > Capacity) snapshots.pop_front();
+}
+
+Snapshot const *Snapshot_History::find(uint32_t tick) const {
+	if (tick == 0) return nullptr;
+	for (auto const &s : snapshots) {
+		if (s.tick == tick) return &s;
+	}
+	return nullptr;
+}
+
+void Bandwidth_Counter::end_tick() {
+	total_bytes += tick_bytes;
+	peak_tick_bytes = std::max(peak_tick_bytes, tick_bytes);
+	tick_bytes = 0;
+	ticks += 1;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+/*
+ * Snapshot holds one server tick's worth of quantized player state.
+ *
+ * Rather than sending every player every tick, the server sends each client
+ * the difference between the current snapshot and the last snapshot that
+ * client acknowledged (its "baseline"):
+ *  - positions are 16-bit fixed point over +/- PositionExtent
+ *    (the map extent that CharacterController's collision grid covers)
+ *  - rotations are "smallest three" packed into 32 bits
+ *  - each player entry starts with a dirty mask, so fields that match the
+ *    baseline (e.g., idle portals) cost nothing
+ *
+ * Delta layout, one entry per player in the snapshot:
+ *  uint8 id, uint8 dirty mask, then (in mask bit order) the fields that changed.
+ * All multi-byte values are little-endian.
+ */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <array>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+
+//positions are clamped to [-PositionExtent, PositionExtent] on every axis:
+constexpr float PositionExtent = 20.0f;
+
+int16_t quantize_position(float v);
+float dequantize_position(int16_t q);
+
+//"smallest three": index of the largest component (2 bits) + the other three at 10 bits each:
+uint32_t quantize_rotation(glm::quat q);
+glm::quat dequantize_rotation(uint32_t q);
+
+struct Quantized_Pose {
+	int16_t position[3] = {0, 0, 0};
+	uint32_t rotation = 0;
+
+	void set(glm::vec3 const &position, glm::quat const &rotation);
+	void get(glm::vec3 *position, glm::quat *rotation) const;
+};
+
+struct Quantized_Player {
+	uint8_t id = 0;
+	uint8_t got_hit = 0;
+	uint8_t anim_state = 0;
+	uint32_t cur_frame = 0;
+	Quantized_Pose player;
+	Quantized_Pose portal1;
+	Quantized_Pose portal2;
+
+	//bits of the dirty mask:
+	enum Field : uint8_t {
+		PlayerPosition  = (1 << 0),
+		PlayerRotation  = (1 << 1),
+		Portal1Position = (1 << 2),
+		Portal1Rotation = (1 << 3),
+		Portal2Position = (1 << 4),
+		Portal2Rotation = (1 << 5),
+		State           = (1 << 6), //got_hit + anim_state
+		Frame           = (1 << 7),
+		AllFields       = 0xff
+	};
+	//which fields differ from 'baseline' (all of them if there is no baseline):
+	uint8_t dirty_mask(Quantized_Player const *baseline) const;
+};
+
+struct Snapshot {
+	uint32_t tick = 0; //zero is never used for a real tick; it means "no baseline"
+	std::vector< Quantized_Player > players;
+
+	Quantized_Player const *find(uint8_t id) const; //(a scan -- to look up many players, use a Snapshot_Index)
+
+	//append the delta from 'baseline' (nullptr means: send every field) to 'out':
+	void write_delta(Snapshot const *baseline, std::vector< char > *out) const;
+	//rebuild a snapshot from 'count' entries written by write_delta against 'baseline':
+	// (throws std::runtime_error if the data is malformed or doesn't exactly fill 'size' bytes)
+	void read_delta(Snapshot const *baseline, uint8_t count, char const *data, size_t size);
+};
+
+//a snapshot's players by id, so looking up every player of another snapshot in it is linear rather than quadratic:
+// (ids are a uint8 and a snapshot holds at most 255 players, so one byte per id says where each one is)
+struct Snapshot_Index {
+	explicit Snapshot_Index(Snapshot const *snapshot); //(nullptr: nobody is found)
+	Quantized_Player const *find(uint8_t id) const {
+		return slots[id] ? &snapshot->players[slots[id] - 1] : nullptr;
+	}
+
+	Snapshot const *snapshot;
+	std::array< uint8_t, 256 > slots; //one more than the index of player 'id' in snapshot->players (zero if absent)
+};
+
+//the most recent snapshots, for looking up baselines by tick:
+struct Snapshot_History {
+	static constexpr size_t Capacity = 32;
+
+	void push(Snapshot &&snapshot);
+	Snapshot const *find(uint32_t tick) const; //nullptr if tick is zero or too old
+	uint32_t latest_tick() const { return snapshots.empty() ? 0 : snapshots.back().tick; }
+
+	std::deque< Snapshot > snapshots;
+};
+
+//running totals for measuring replication bandwidth:
+struct Bandwidth_Counter {
+	void add(size_t bytes) { tick_bytes += bytes; }
+	void end_tick();
+	void reset() { *this = Bandwidth_Counter(); }
+	double bytes_per_tick() const { return ticks ? double(total_bytes) / double(ticks) : 0.0; }
+
+	uint64_t tick_bytes = 0; //bytes so far this tick
+	uint64_t total_bytes = 0; //bytes in all finished ticks
+	uint64_t peak_tick_bytes = 0;
+	uint64_t ticks = 0;
+	uint64_t streamed = 0; //(UDP) state messages that didn't fit in a datagram (see Connection::send_state)
+};
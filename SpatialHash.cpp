@@ -0,0 +1,142 @@
+#include "SpatialHash.hpp"
+#include "Combat.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+SpatialHash::SpatialHash(float cell_size_, uint32_t bucket_count) : cell_size(cell_size_) {
+	assert(cell_size > 0.0f);
+	uint32_t count = 1;
+	while (count < bucket_count) count *= 2;
+	buckets.resize(count);
+	bucket_mask = count - 1;
+}
+
+glm::ivec2 SpatialHash::cell(glm::vec3 const &position) const {
+	return glm::ivec2(int32_t(std::floor(position.x / cell_size)), int32_t(std::floor(position.y / cell_size)));
+}
+
+uint32_t SpatialHash::bucket(glm::ivec2 const &cell) const {
+	//(the usual large primes from Teschner et al.'s spatial hashing paper)
+	return ((uint32_t(cell.x) * 73856093U) ^ (uint32_t(cell.y) * 19349663U)) & bucket_mask;
+}
+
+void SpatialHash::update(uint32_t id, glm::vec3 const &position) {
+	if (id >= elements.size()) elements.resize(id + 1);
+	Element &element = elements[id];
+	element.position = position;
+	glm::ivec2 at = cell(position);
+	if (element.bucket != Absent && at == element.cell) return;
+
+	remove(id);
+	element.cell = at;
+	element.bucket = bucket(at);
+	element.slot = uint32_t(buckets[element.bucket].size());
+	buckets[element.bucket].emplace_back(id);
+}
+
+void SpatialHash::remove(uint32_t id) {
+	if (!contains(id)) return;
+	Element &element = elements[id];
+	std::vector< uint32_t > &list = buckets[element.bucket];
+	//swap-remove, fixing up the slot of whoever moved:
+	list[element.slot] = list.back();
+	elements[list.back()].slot = element.slot;
+	list.pop_back();
+	element.bucket = Absent;
+}
+
+template< typename Visit >
+void SpatialHash::for_each_in(glm::vec2 const &min, glm::vec2 const &max, Visit const &visit) const {
+	glm::ivec2 lo = cell(glm::vec3(min, 0.0f));
+	glm::ivec2 hi = cell(glm::vec3(max, 0.0f));
+	auto inside = [&](glm::ivec2 const &c) {
+		return c.x >= lo.x && c.x <= hi.x && c.y >= lo.y && c.y <= hi.y;
+	};
+
+	//a query bigger than the table would visit buckets more than once, so just scan them all:
+	if (uint64_t(hi.x - lo.x + 1) * uint64_t(hi.y - lo.y + 1) > buckets.size()) {
+		for (auto const &list : buckets) {
+			for (uint32_t id : list) {
+				if (inside(elements[id].cell)) visit(id);
+			}
+		}
+		return;
+	}
+
+	for (int32_t y = lo.y; y <= hi.y; ++y) {
+		for (int32_t x = lo.x; x <= hi.x; ++x) {
+			glm::ivec2 at = glm::ivec2(x, y);
+			for (uint32_t id : buckets[bucket(at)]) {
+				//(skips elements of other cells that hash to the same bucket, so nobody is visited twice)
+				if (elements[id].cell == at) visit(id);
+			}
+		}
+	}
+}
+
+void SpatialHash::query_radius(glm::vec3 const &center, float radius, std::vector< uint32_t > *out) const {
+	glm::vec2 c = glm::vec2(center.x, center.y);
+	float radius2 = radius * radius;
+	for_each_in(c - glm::vec2(radius), c + glm::vec2(radius), [&](uint32_t id) {
+		glm::vec3 diff = elements[id].position - center;
+		if (glm::dot(diff, diff) <= radius2) out->emplace_back(id);
+	});
+}
+
+void SpatialHash::query_cone(AttackCone const &cone, std::vector< ConeHit > *out) const {
+	size_t begin = out->size();
+	glm::vec2 c = glm::vec2(cone.position.x, cone.position.y);
+	for_each_in(c - glm::vec2(cone.radius), c + glm::vec2(cone.radius), [&](uint32_t id) {
+		float distance2;
+		if (cone.contains(elements[id].position, &distance2)) out->emplace_back(ConeHit{id, distance2});
+	});
+	sort_hits(out->begin() + begin, out->end());
+}
+
+void SpatialHash::query_cones(std::vector< AttackCone > const &cones, std::vector< ConeHit > *out, std::vector< std::pair< uint32_t, uint32_t > > *ranges) const {
+	//group the cones by the BatchTile x BatchTile block of cells their attacker stands in:
+	std::vector< std::pair< uint64_t, uint32_t > > order; //(block, cone)
+	order.reserve(cones.size());
+	for (uint32_t i = 0; i < cones.size(); ++i) {
+		glm::ivec2 at = cell(cones[i].position);
+		glm::ivec2 block = glm::ivec2(at.x >> BatchShift, at.y >> BatchShift);
+		order.emplace_back((uint64_t(uint32_t(block.y)) << 32) | uint32_t(block.x), i);
+	}
+	std::sort(order.begin(), order.end());
+
+	//each group gathers the elements near any of its cones once, and tests each cone against that list:
+	std::vector< uint32_t > candidates;
+	ranges->assign(cones.size(), std::make_pair(0U, 0U));
+	for (size_t begin = 0; begin < order.size(); ) {
+		size_t end = begin + 1;
+		while (end < order.size() && order[end].first == order[begin].first) ++end;
+
+		glm::vec2 min = glm::vec2(std::numeric_limits< float >::infinity());
+		glm::vec2 max = -min;
+		for (size_t o = begin; o < end; ++o) {
+			AttackCone const &cone = cones[order[o].second];
+			glm::vec2 c = glm::vec2(cone.position.x, cone.position.y);
+			min = glm::min(min, c - glm::vec2(cone.radius));
+			max = glm::max(max, c + glm::vec2(cone.radius));
+		}
+		candidates.clear();
+		for_each_in(min, max, [&](uint32_t id) {
+			candidates.emplace_back(id);
+		});
+
+		for (size_t o = begin; o < end; ++o) {
+			AttackCone const &cone = cones[order[o].second];
+			uint32_t hits_begin = uint32_t(out->size());
+			for (uint32_t id : candidates) {
+				float distance2;
+				if (cone.contains(elements[id].position, &distance2)) out->emplace_back(ConeHit{id, distance2});
+			}
+			sort_hits(out->begin() + hits_begin, out->end());
+			(*ranges)[order[o].second] = std::make_pair(hits_begin, uint32_t(out->size()));
+		}
+		begin = end;
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * SpatialHash is a broadphase for things that move around the XY plane.
+ *
+ * The plane is cut into square cells of cell_size, and each cell hashes to one of a fixed
+ *  number of buckets listing the elements in it (cells that collide share a bucket;
+ *  queries check each element's own cell, so that only costs a little scanning).
+ * Elements are small integer ids; update() only touches the buckets when an element
+ *  moves into a different cell, so refreshing every element every frame is cheap.
+ * Queries visit the cells overlapping the query's bounds and run the exact test on the
+ *  elements there, so they cost O(nearby elements) rather than O(all elements).
+ *
+ * Positions are 3D, but only x and y pick the cell.
+ */
+
+#include "Combat.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct SpatialHash {
+	//'cell_size' should be about the radius of typical queries; 'bucket_count' is rounded up to a power of two:
+	explicit SpatialHash(float cell_size, uint32_t bucket_count = 1024);
+
+	//insert element 'id', or move it if it is already present:
+	void update(uint32_t id, glm::vec3 const &position);
+	void remove(uint32_t id);
+	bool contains(uint32_t id) const { return id < elements.size() && elements[id].bucket != Absent; }
+
+	//append (in no particular order) the ids of elements within 'radius' of 'center':
+	void query_radius(glm::vec3 const &center, float radius, std::vector< uint32_t > *out) const;
+	//append the elements inside 'cone', nearest first (see Combat.hpp):
+	void query_cone(AttackCone const &cone, std::vector< ConeHit > *out) const;
+	//the same for several attacks at once (e.g. everyone who attacked this frame): cone i's hits
+	// are [(*ranges)[i].first, (*ranges)[i].second) of 'out'. Attackers in the same block of
+	// BatchTile x BatchTile cells share one visit to the cells around them.
+	void query_cones(std::vector< AttackCone > const &cones, std::vector< ConeHit > *out, std::vector< std::pair< uint32_t, uint32_t > > *ranges) const;
+
+	//internals:
+	static constexpr uint32_t Absent = ~0U;
+	static constexpr int32_t BatchShift = 1;
+	static constexpr int32_t BatchTile = 1 << BatchShift;
+	struct Element {
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::ivec2 cell = glm::ivec2(0);
+		uint32_t bucket = Absent; //bucket holding this element (Absent if not in the hash)
+		uint32_t slot = 0; //index within that bucket
+	};
+	float cell_size;
+	std::vector< Element > elements; //indexed by id
+	std::vector< std::vector< uint32_t > > buckets;
+	uint32_t bucket_mask;
+
+	glm::ivec2 cell(glm::vec3 const &position) const;
+	uint32_t bucket(glm::ivec2 const &cell) const;
+	//call 'visit(id)' for every element in the cells overlapping [min, max]:
+	template< typename Visit >
+	void for_each_in(glm::vec2 const &min, glm::vec2 const &max, Visit const &visit) const;
+};
@@ -0,0 +1,424 @@
+#include "Connection.hpp"
+#include "NetworkPlayer.hpp"
+#include "Snapshot.hpp"
+#include "Interpolation.hpp"
+#include "Movement.hpp"
+#include "CollisionMap.hpp"
+#include "NavGrid.hpp"
+#include "Pathfinder.hpp"
+#include "Combat.hpp"
+#include "data_path.hpp"
+
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+//Headless bots for load-testing the server.
+//Usage:
+//	./bot <host> <port> [count] [tcp|udp] [seconds] [random|navigate]
+//
+//Each bot is a whole client as far as the server can tell: it connects, predicts its own
+// movement and sends inputs every frame (60 per second, like client.cpp), acknowledges
+// snapshots, places portals and walks through them, and attacks -- claiming targets from
+// interpolated snapshots, as PlayMode does. All the bots share one thread.
+//  random   -- walk in a random direction for a second or two, sometimes stand still (default)
+//  navigate -- walk to random spots on the map along paths from a Pathfinder
+//
+//Every few seconds, and per bot at the end, it reports:
+//  - input latency: from sending an input to the server saying it has simulated it
+//    (so it includes up to a tick of waiting for the server's next snapshot);
+//  - tick jitter: how far snapshot arrival spacing strays from the ticks between them;
+//  - bytes per second down (snapshots) and up (inputs and attacks).
+//Run the server with a player limit to match, e.g. ./server 15466 tcp 255
+
+//deterministic pseudo-random numbers in [0,1), so runs are comparable:
+struct Random {
+	uint32_t seed;
+	explicit Random(uint32_t seed_) : seed(seed_) { }
+	float operator()() {
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) / float(1 << 24);
+	}
+};
+
+enum class Script { Random, Navigate };
+
+struct Bot {
+	Bot(std::string const &host, std::string const &port, Transport transport, uint32_t seed) : client(host, port, transport), random(seed) { }
+
+	Client client;
+	bool open = true;
+	uint8_t id = 0; //(zero until the first snapshot)
+
+	//what a client keeps:
+	Movement_Predictor predictor;
+	uint32_t sent_sequence = 0; //(TCP) newest input already sent
+	Snapshot_History snapshots;
+	Interpolation_Clock clock;
+	bool both_placed = false, place_p1 = true, can_teleport = false;
+	uint8_t next_flags = 0;
+
+	//script:
+	Random random;
+	glm::vec2 direction = glm::vec2(0.0f);
+	double next_turn = 0.0, next_attack = 0.0, next_portal = 0.0;
+	std::vector< glm::vec2 > path; //(navigate) waypoints still to reach
+	uint32_t ticket = 0; //(navigate) path request in flight
+
+	//measurements:
+	std::deque< std::pair< uint32_t, double > > sent_inputs; //(sequence, time sent), not yet acknowledged
+	std::vector< float > latencies; //ms
+	double last_snapshot_time = 0.0;
+	uint32_t last_snapshot_tick = 0;
+	double jitter_total = 0.0;
+	double jitter_max = 0.0;
+	uint32_t jitter_samples = 0;
+	uint32_t skipped_ticks = 0; //(UDP) snapshots that never arrived
+	uint64_t bytes_down = 0, bytes_up = 0; //message bytes (not counting TCP/UDP framing)
+	uint32_t attacks = 0;
+
+	void read_message(char const *message, size_t size, double now, CollisionMap const &map);
+	uint8_t claim_target(glm::vec3 const &position, glm::vec3 const &forward) const;
+};
+
+void Bot::read_message(char const *message, size_t size, double now, CollisionMap const &map) {
+	Server_Message_Header header;
+	if (size < sizeof(header)) throw std::runtime_error("Server sent a truncated message");
+	memcpy(&header, message, sizeof(header));
+	wire_swap(header);
+	if (header.version != NetworkProtocolVersion) {
+		throw std::runtime_error("Server speaks protocol version " + std::to_string(header.version) + ", expected " + std::to_string(NetworkProtocolVersion));
+	}
+	if (header.you >= header.player_count) throw std::runtime_error("Server sent a message without this bot in it");
+	if (header.tick <= snapshots.latest_tick()) return;
+
+	Snapshot const *baseline = nullptr;
+	if (header.baseline_tick != 0) {
+		baseline = snapshots.find(header.baseline_tick);
+		if (!baseline) return; //(UDP: our acks were lost for a while)
+	}
+	Snapshot snapshot;
+	snapshot.tick = header.tick;
+	snapshot.read_delta(baseline, header.player_count, message + sizeof(header), size - sizeof(header));
+	clock.on_snapshot(double(header.tick) * ServerTick);
+	id = snapshot.players[header.you].id;
+
+	if (last_snapshot_tick != 0) {
+		double expected = double(header.tick - last_snapshot_tick) * ServerTick;
+		double jitter = std::abs((now - last_snapshot_time) - expected);
+		jitter_total += jitter;
+		jitter_max = std::max(jitter_max, jitter);
+		jitter_samples += 1;
+		skipped_ticks += header.tick - last_snapshot_tick - 1;
+	}
+	last_snapshot_time = now;
+	last_snapshot_tick = header.tick;
+
+	while (!sent_inputs.empty() && sent_inputs.front().first <= header.last_input) {
+		latencies.emplace_back(float((now - sent_inputs.front().second) * 1000.0));
+		sent_inputs.pop_front();
+	}
+	predictor.reconcile(header.last_input, movement_from_wire(header.movement), &map);
+	snapshots.push(std::move(snapshot));
+}
+
+//the nearest other player in the attack cone, with everyone placed where this bot would draw them:
+uint8_t Bot::claim_target(glm::vec3 const &position, glm::vec3 const &forward) const {
+	double ticks = std::max(0.0, clock.time / ServerTick);
+	Snapshot const *a = snapshots.find(uint32_t(ticks));
+	Snapshot const *b = snapshots.find(uint32_t(ticks) + 1);
+	if (!a) a = (snapshots.snapshots.empty() ? nullptr : &snapshots.snapshots.back());
+	if (!a) return 0;
+	float t = float(ticks - std::floor(ticks));
+
+	AttackCone cone(position, forward, AttackDegree, AttackRadius);
+	float nearest = std::numeric_limits< float >::infinity();
+	uint8_t target = 0;
+	Snapshot_Index later_players(b);
+	for (Quantized_Player const &player : a->players) {
+		if (player.id == id) continue;
+		glm::vec3 at;
+		glm::quat rotation;
+		player.player.get(&at, &rotation);
+		Quantized_Player const *later = later_players.find(player.id);
+		if (later) {
+			glm::vec3 then;
+			later->player.get(&then, &rotation);
+			at = glm::mix(at, then, t);
+		}
+		float distance2;
+		if (cone.contains(at, &distance2) && distance2 < nearest) {
+			nearest = distance2;
+			target = player.id;
+		}
+	}
+	return target;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		std::cerr << "Usage:\n\t./bot <host> <port> [count] [tcp|udp] [seconds] [random|navigate]" << std::endl;
+		return 1;
+	}
+	std::string host = argv[1];
+	std::string port = argv[2];
+	uint32_t count = uint32_t(argc >= 4 ? std::max(1, std::stoi(argv[3])) : 100);
+	Transport transport = Transport::TCP;
+	if (argc >= 5) {
+		if (std::string(argv[4]) == "udp") transport = Transport::UDP;
+		else if (std::string(argv[4]) != "tcp") {
+			std::cerr << "Unknown transport '" << argv[4] << "' (expecting 'tcp' or 'udp')." << std::endl;
+			return 1;
+		}
+	}
+	double duration = (argc >= 6 ? std::stod(argv[5]) : 30.0);
+	Script script = Script::Random;
+	if (argc >= 7) {
+		if (std::string(argv[6]) == "navigate") script = Script::Navigate;
+		else if (std::string(argv[6]) != "random") {
+			std::cerr << "Unknown script '" << argv[6] << "' (expecting 'random' or 'navigate')." << std::endl;
+			return 1;
+		}
+	}
+
+	CollisionMap map(data_path("map/collision.map"));
+	std::unique_ptr< NavGrid > grid;
+	std::unique_ptr< Pathfinder > pathfinder;
+	if (script == Script::Navigate) {
+		grid = std::make_unique< NavGrid >(map, PlayerRadius);
+		pathfinder = std::make_unique< Pathfinder >(*grid);
+	}
+
+	std::vector< std::unique_ptr< Bot > > bots;
+	bots.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		try {
+			bots.emplace_back(std::make_unique< Bot >(host, port, transport, 0x1234567u + i * 7919u));
+		} catch (std::exception &e) {
+			std::cerr << "Bot " << i << " failed to connect: " << e.what() << std::endl;
+			break;
+		}
+	}
+	std::cout << "Running " << bots.size() << " bots for " << duration << "s." << std::endl;
+
+	auto start = std::chrono::steady_clock::now();
+	auto seconds_since_start = [&start]() {
+		return std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+	};
+	constexpr double Frame = MovementStep; //(client.cpp runs at the display rate, typically this)
+	constexpr double ReportInterval = 5.0;
+	double next_report = ReportInterval;
+	std::vector< size_t > latencies_reported(bots.size(), 0); //(per bot, latencies already in a report)
+	uint64_t frames = 0, late_frames = 0;
+
+	//percentile of some latencies (sorts them):
+	auto percentile = [](std::vector< float > &values, float p) {
+		if (values.empty()) return 0.0f;
+		size_t at = std::min(values.size() - 1, size_t(p * float(values.size())));
+		std::nth_element(values.begin(), values.begin() + at, values.end());
+		return values[at];
+	};
+
+	std::unordered_map< uint32_t, Bot * > requests; //(navigate) path tickets in flight
+	std::vector< Pathfinder::Response > responses;
+	uint64_t bytes_down_reported = 0, bytes_up_reported = 0;
+
+	double now = 0.0;
+	uint32_t time_ms = 0;
+	while ((now = seconds_since_start()) < duration) {
+		double frame_start = now;
+		time_ms = uint32_t(now * 1000.0);
+
+		if (pathfinder) {
+			responses.clear();
+			pathfinder->poll(&responses);
+			for (auto &response : responses) {
+				auto f = requests.find(response.ticket);
+				if (f == requests.end()) continue;
+				Bot &bot = *f->second;
+				bot.ticket = 0;
+				bot.path = std::move(response.path);
+				std::reverse(bot.path.begin(), bot.path.end()); //(so the next waypoint is at the back)
+				requests.erase(f);
+			}
+		}
+
+		for (auto &bot_pointer : bots) {
+			Bot &bot = *bot_pointer;
+			if (!bot.open) continue;
+			glm::vec3 position = bot.predictor.state.position;
+
+			// ---- script ----
+			if (bot.id != 0) {
+				if (script == Script::Random) {
+					if (now >= bot.next_turn) {
+						float angle = bot.random() * 6.2831853f;
+						bot.direction = (bot.random() < 0.2f ? glm::vec2(0.0f) : glm::vec2(std::cos(angle), std::sin(angle)));
+						bot.next_turn = now + 1.0 + bot.random();
+					}
+				} else {
+					while (!bot.path.empty() && glm::length(bot.path.back() - glm::vec2(position.x, position.y)) < 0.1f) bot.path.pop_back();
+					if (bot.path.empty()) {
+						bot.direction = glm::vec2(0.0f);
+						if (bot.ticket == 0) {
+							glm::vec2 goal = (glm::vec2(bot.random(), bot.random()) * 2.0f - glm::vec2(1.0f)) * map.extent;
+							bot.ticket = pathfinder->request(glm::vec2(position.x, position.y), goal);
+							requests.emplace(bot.ticket, &bot);
+						}
+					} else {
+						bot.direction = glm::normalize(bot.path.back() - glm::vec2(position.x, position.y));
+					}
+				}
+
+				// portals, placed and walked through as in PlayMode:
+				glm::vec3 portal1 = bot.predictor.state.portal1, portal2 = bot.predictor.state.portal2;
+				if (now >= bot.next_portal) {
+					if (bot.place_p1) {
+						bot.next_flags |= Movement_Input::PlacePortal1;
+					} else {
+						bot.next_flags |= Movement_Input::PlacePortal2;
+						bot.both_placed = true;
+					}
+					bot.can_teleport = false;
+					bot.place_p1 = !bot.place_p1;
+					bot.next_portal = now + 5.0 + 10.0 * bot.random();
+				} else if (bot.both_placed && bot.can_teleport && glm::distance(position, portal1) < 0.5f) {
+					bot.can_teleport = false;
+					bot.next_flags |= Movement_Input::TeleportToPortal2;
+				} else if (bot.both_placed && bot.can_teleport && glm::distance(position, portal2) < 0.5f) {
+					bot.can_teleport = false;
+					bot.next_flags |= Movement_Input::TeleportToPortal1;
+				} else if (glm::distance(position, portal1) > 0.5f && glm::distance(position, portal2) > 0.5f) {
+					bot.can_teleport = true;
+				}
+			}
+
+			// ---- step and send, as PlayMode::update does ----
+			Movement_Input const &input = bot.predictor.step(bot.direction, bot.next_flags, time_ms, &map);
+			bot.next_flags = 0;
+			bot.sent_inputs.emplace_back(input.sequence, now);
+			bot.predictor.update_correction(float(Frame));
+
+			Client_Player myself(
+				bot.predictor.state.position, bot.predictor.state.rotation(), bot.predictor.state.portal1, bot.predictor.state.rotation(),
+				bot.predictor.state.portal2, bot.predictor.state.rotation(), 0, IDLE, 0
+			);
+			if (bot.id != 0 && now >= bot.next_attack) {
+				glm::vec3 forward = bot.predictor.state.rotation() * glm::vec3(0.0f, 1.0f, 0.0f);
+				myself.hit_id = bot.claim_target(bot.predictor.state.position, forward);
+				myself.attacking = true;
+				bot.attacks += 1;
+				bot.next_attack = now + 1.0 + 2.0 * bot.random();
+			}
+			myself.viewTime = bot.clock.time;
+			myself.ackTick = bot.snapshots.latest_tick();
+			Connection &connection = bot.client.connections.back();
+			for (Movement_Input const &pending : bot.predictor.pending) {
+				if (connection.transport == Transport::TCP && pending.sequence <= bot.sent_sequence) continue;
+				myself.inputs.emplace_back(pending);
+			}
+			if (!bot.predictor.pending.empty()) bot.sent_sequence = bot.predictor.pending.back().sequence;
+			size_t inputs = (connection.transport == Transport::UDP ? std::min(myself.inputs.size(), Client_Player::MaxInputsPerMessage) : myself.inputs.size());
+			size_t messages = std::max< size_t >(1, (inputs + Client_Player::MaxInputsPerMessage - 1) / Client_Player::MaxInputsPerMessage);
+			bot.bytes_up += messages * (1 + sizeof(Client_Player_Wire)) + inputs * sizeof(Input_Wire) + (myself.attacking ? 1 + sizeof(Attack_Wire) : 0);
+			myself.send_message(connection);
+
+			// ---- receive ----
+			bot.client.poll([&](Connection *c, Connection::Event event) {
+				if (event == Connection::OnClose) {
+					std::cout << "Bot " << int(bot.id) << " was disconnected." << std::endl;
+					bot.open = false;
+					return;
+				}
+				if (event != Connection::OnRecv) return;
+				size_t descriptor_size = 1 + sizeof(uint32_t);
+				if (!c->recv_state.empty()) {
+					uint32_t size = 0;
+					if (c->recv_state.size() >= descriptor_size) {
+						memcpy(&size, c->recv_state.data() + 1, sizeof(uint32_t));
+						wire_swap(size);
+					}
+					if (c->recv_state[0] != 'm' || c->recv_state.size() != descriptor_size + size) {
+						throw std::runtime_error("Server sent a malformed state message");
+					}
+					bot.bytes_down += c->recv_state.size();
+					bot.read_message(c->recv_state.data() + descriptor_size, size, seconds_since_start(), map);
+					c->recv_state.clear();
+				}
+				while (c->recv_buffer.size() >= descriptor_size) {
+					if (c->recv_buffer[0] != 'm') throw std::runtime_error("Server sent unknown message type '" + std::to_string(c->recv_buffer[0]) + "'");
+					uint32_t size;
+					c->recv_buffer.copy_out(1, &size, sizeof(uint32_t));
+					wire_swap(size);
+					if (c->recv_buffer.size() < descriptor_size + size) break;
+					bot.bytes_down += descriptor_size + size;
+					bot.read_message(c->recv_buffer.contiguous(descriptor_size + size) + descriptor_size, size, seconds_since_start(), map);
+					c->recv_buffer.consume(descriptor_size + size);
+				}
+			}, 0.0);
+			bot.clock.advance(Frame);
+		}
+
+		// ---- report ----
+		if (now >= next_report) {
+			std::vector< float > window;
+			double jitter_total = 0.0, jitter_max = 0.0;
+			uint32_t jitter_samples = 0, skipped = 0, connected = 0;
+			uint64_t bytes_down = 0, bytes_up = 0;
+			for (size_t i = 0; i < bots.size(); ++i) {
+				Bot &bot = *bots[i];
+				connected += bot.open;
+				window.insert(window.end(), bot.latencies.begin() + latencies_reported[i], bot.latencies.end());
+				latencies_reported[i] = bot.latencies.size();
+				jitter_total += bot.jitter_total;
+				jitter_max = std::max(jitter_max, bot.jitter_max);
+				jitter_samples += bot.jitter_samples;
+				skipped += bot.skipped_ticks;
+				bytes_down += bot.bytes_down;
+				bytes_up += bot.bytes_up;
+			}
+			double elapsed = now - (next_report - ReportInterval);
+			std::cout << std::fixed << std::setprecision(1)
+			          << "[" << next_report << "s] " << connected << "/" << bots.size() << " connected; input latency p50 " << percentile(window, 0.5f)
+			          << " p99 " << percentile(window, 0.99f) << " max " << percentile(window, 1.0f) << " ms; tick jitter avg "
+			          << (jitter_samples ? jitter_total / jitter_samples * 1000.0 : 0.0) << " max " << jitter_max * 1000.0 << " ms; "
+			          << skipped << " ticks skipped; per bot " << double(bytes_down - bytes_down_reported) / elapsed / std::max(1U, connected) << " B/s down "
+			          << double(bytes_up - bytes_up_reported) / elapsed / std::max(1U, connected) << " B/s up; "
+			          << 100.0 * double(late_frames) / double(std::max< uint64_t >(1, frames)) << "% bot frames late" << std::endl;
+			std::cout.unsetf(std::ios::fixed);
+			bytes_down_reported = bytes_down;
+			bytes_up_reported = bytes_up;
+			frames = late_frames = 0;
+			next_report += ReportInterval;
+		}
+
+		// ---- wait for the next frame ----
+		frames += 1;
+		double spent = seconds_since_start() - frame_start;
+		if (spent > Frame) late_frames += 1; //(then the bots, not the server, are the bottleneck)
+		else std::this_thread::sleep_for(std::chrono::duration< double >(Frame - spent));
+	}
+
+	// ---- per bot summary ----
+	std::cout << "bot  id  latency p50/p99/max (ms)  jitter avg/max (ms)  skipped  down B/s  up B/s  attacks" << std::endl;
+	for (size_t i = 0; i < bots.size(); ++i) {
+		Bot &bot = *bots[i];
+		std::vector< float > latencies = bot.latencies;
+		std::cout << std::fixed << std::setprecision(1)
+		          << std::setw(3) << i << " " << std::setw(3) << int(bot.id) << "  "
+		          << std::setw(6) << percentile(latencies, 0.5f) << " " << std::setw(6) << percentile(latencies, 0.99f) << " " << std::setw(6) << percentile(latencies, 1.0f) << "      "
+		          << std::setw(6) << (bot.jitter_samples ? bot.jitter_total / bot.jitter_samples * 1000.0 : 0.0) << " " << std::setw(6) << bot.jitter_max * 1000.0 << "  "
+		          << std::setw(7) << bot.skipped_ticks << "  " << std::setw(8) << double(bot.bytes_down) / now << "  " << std::setw(6) << double(bot.bytes_up) / now << "  "
+		          << std::setw(7) << bot.attacks << (bot.open ? "" : " (disconnected)") << std::endl;
+	}
+	return 0;
+}
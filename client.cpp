@@ -14,6 +14,8 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <string>
+#include <cstdlib>
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -35,13 +37,30 @@ int main(int argc, char **argv) {
 	try {
 #endif
 	//------------ command line arguments ------------
-	if (argc != 3) {
-		std::cerr << "Usage:\n\t./client <host> <port>" << std::endl;
+	if (argc < 3 || argc > 5) {
+		std::cerr << "Usage:\n\t./client <host> <port> [tcp|udp] [interpolation delay in ms]" << std::endl;
 		return 1;
 	}
+	Transport transport = Transport::TCP;
+	if (argc >= 4) {
+		if (std::string(argv[3]) == "udp") transport = Transport::UDP;
+		else if (std::string(argv[3]) != "tcp") {
+			std::cerr << "Unknown transport '" << argv[3] << "' (expecting 'tcp' or 'udp')." << std::endl;
+			return 1;
+		}
+	}
+	//how far behind the server other players are drawn (see Interpolation.hpp):
+	double interpolation_delay = -1.0;
+	if (argc == 5) {
+		interpolation_delay = std::atof(argv[4]) / 1000.0;
+		if (!(interpolation_delay >= 0.0)) {
+			std::cerr << "Interpolation delay '" << argv[4] << "' should be a number of milliseconds." << std::endl;
+			return 1;
+		}
+	}
 
 	//------------ connect to server --------------
-	Client client(argv[1], argv[2]);
+	Client client(argv[1], argv[2], transport);
 
 	//------------  initialization ------------
 
@@ -110,7 +129,11 @@ int main(int argc, char **argv) {
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >(client));
+	{
+		auto play = std::make_shared< PlayMode >(client);
+		if (interpolation_delay >= 0.0) play->interpolation.delay = interpolation_delay;
+		Mode::set_current(play);
+	}
 
 	//------------ main loop ------------
 
@@ -0,0 +1,605 @@
+#include "CollisionMap.hpp"
+#include "Movement.hpp"
+#include "SpatialHash.hpp"
+#include "CollisionWorld.hpp"
+#include "HeightMap.hpp"
+#include "NavGrid.hpp"
+#include "Pathfinder.hpp"
+#include "Combat.hpp"
+#include "data_path.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <memory>
+
+//Micro-benchmarks for collision and movement queries.
+//Usage:
+//	./collision-bench sweep [map]      -- point samples vs. segment sweeps against the collision map
+//	./collision-bench distance [map]   -- baked distance field load vs. build time, accuracy, and sampling speed
+//	./collision-bench broadphase       -- SpatialHash vs. scanning every collidable, at 16/256/4096 collidables
+//	./collision-bench resolve          -- CollisionWorld vs. one-at-a-time overlap fixing, at 16/256/4096 bodies
+//	./collision-bench height [map]     -- HeightMap load time, lookup speed, and slope accuracy
+//	./collision-bench path [map]       -- NavGrid build time, and paths/second over random start/goal pairs (one thread, then a Pathfinder)
+//	./collision-bench cone             -- acos vs. precomputed AttackCone tests, one at a time and batched, at 16/256/4096 attackers
+
+//deterministic pseudo-random numbers in [0,1), so runs are comparable:
+struct Random {
+	uint32_t seed = 0x1234567;
+	float operator()() {
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) / float(1 << 24);
+	}
+};
+
+//random segments of 'length' starting at random open cells:
+static std::vector< std::pair< glm::vec2, glm::vec2 > > random_segments(CollisionMap const &map, float length, size_t count) {
+	Random random;
+	std::vector< std::pair< glm::vec2, glm::vec2 > > segments;
+	segments.reserve(count);
+	while (segments.size() < count) {
+		glm::vec2 from = glm::vec2(random(), random()) * (2.0f * map.extent) - glm::vec2(map.extent);
+		if (map.blocked(from)) continue;
+		float angle = random() * 6.2831853f;
+		segments.emplace_back(from, from + length * glm::vec2(std::cos(angle), std::sin(angle)));
+	}
+	return segments;
+}
+
+template< typename F >
+static double queries_per_second(size_t count, F const &query) {
+	auto before = std::chrono::steady_clock::now();
+	query();
+	double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+	return double(count) / seconds;
+}
+
+static void bench_sweep(CollisionMap const &map) {
+	constexpr size_t Count = 1000000;
+	std::cout << "  map " << map.size << "x" << map.size << " cells of " << 2.0f * map.extent / float(map.size) << " units" << std::endl;
+	for (float length : {2.0f * MovementStep, 0.5f, 4.0f}) {
+		auto segments = random_segments(map, length, Count);
+
+		size_t point_blocked = 0;
+		double point_rate = queries_per_second(Count, [&]() {
+			for (auto const &s : segments) point_blocked += map.blocked(s.second);
+		});
+
+		size_t swept_blocked = 0;
+		double sweep_rate = queries_per_second(Count, [&]() {
+			CollisionMap::Hit hit;
+			for (auto const &s : segments) swept_blocked += map.sweep(s.first, s.second, &hit);
+		});
+
+		std::cout << "  length " << length << ": "
+		          << "point " << point_rate / 1e6 << "M/s (" << point_blocked << " blocked), "
+		          << "sweep " << sweep_rate / 1e6 << "M/s (" << swept_blocked << " blocked; "
+		          << swept_blocked - std::min(swept_blocked, point_blocked) << " more segments than the end point alone catches)" << std::endl;
+	}
+
+	//sliding: walk players straight at random directions for a second and see how far they get:
+	auto segments = random_segments(map, 1.0f, 10000);
+	Random random;
+	double distance = 0.0;
+	size_t steps = 0;
+	size_t inside = 0;
+	size_t touching = 0;
+	double rate = queries_per_second(segments.size() * 60, [&]() {
+		for (auto const &s : segments) {
+			Movement_State state;
+			state.position = glm::vec3(s.first, 0.0f);
+			glm::vec2 direction = glm::normalize(s.second - s.first);
+			for (uint32_t i = 0; i < 60; ++i) {
+				step_movement(&state, direction, MovementStep, &map);
+				steps += 1;
+			}
+			distance += glm::length(glm::vec2(state.position.x, state.position.y) - s.first);
+			if (map.blocked(glm::vec2(state.position.x, state.position.y))) inside += 1;
+			else if (!map.clear(glm::vec2(state.position.x, state.position.y), 0.5f * PlayerRadius)) touching += 1;
+		}
+	});
+	std::cout << "  step_movement: " << rate / 1e6 << "M steps/s, players walked " << distance / double(segments.size()) << " units/s on average, "
+	          << inside << "/" << segments.size() << " ended up inside a wall, "
+	          << touching << " closer than half their radius to one" << std::endl;
+}
+
+static void bench_distance(std::string const &filename) {
+	//load time (the distance field is baked into the file, so this is just mapping it):
+	auto before = std::chrono::steady_clock::now();
+	CollisionMap map(filename);
+	double load = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+	std::cout << "  load: " << load * 1e3 << " ms for " << map.size << "x" << map.size << " cells" << std::endl;
+
+	//what building the field at load would cost instead, and whether the baked one matches it:
+	constexpr uint32_t Builds = 5;
+	std::vector< int16_t > built;
+	double best = std::numeric_limits< double >::infinity();
+	for (uint32_t i = 0; i < Builds; ++i) {
+		auto before = std::chrono::steady_clock::now();
+		map.build_distance_field(&built);
+		best = std::min(best, std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count());
+	}
+	int32_t differ = 0, most = 0;
+	for (size_t i = 0; i < built.size(); ++i) {
+		int32_t delta = std::abs(int32_t(built[i]) - int32_t(map.distances[i]));
+		differ += (delta != 0);
+		most = std::max(most, delta);
+	}
+	std::cout << "  build at load would take " << best * 1e3 << " ms on " << std::thread::hardware_concurrency() << " hardware threads; "
+	          << "baked field differs in " << differ << " cells, by at most " << float(most) / CollisionMap::DistanceScale << " cells" << std::endl;
+
+	//accuracy: compare cell centers to a brute force search of the surrounding cells:
+	float cell_size = 2.0f * map.extent / float(map.size);
+	constexpr int32_t Window = 64;
+	Random random;
+	float worst = 0.0f;
+	size_t checked = 0;
+	while (checked < 2000) {
+		glm::ivec2 at = glm::ivec2(int32_t(random() * float(map.size)), int32_t(random() * float(map.size)));
+		bool inside = map.blocked_cell(at);
+		float nearest = std::numeric_limits< float >::infinity();
+		for (int32_t dy = -Window; dy <= Window; ++dy) {
+			for (int32_t dx = -Window; dx <= Window; ++dx) {
+				glm::ivec2 other = at + glm::ivec2(dx, dy);
+				if (other.x < 0 || other.y < 0 || other.x >= int32_t(map.size) || other.y >= int32_t(map.size)) continue;
+				if (map.blocked_cell(other) != inside) nearest = std::min(nearest, std::sqrt(float(dx * dx + dy * dy)));
+			}
+		}
+		if (nearest > float(Window)) continue; //(the answer might be outside the window)
+		float expected = (inside ? -1.0f : 1.0f) * (nearest - 0.5f) * cell_size;
+		glm::vec2 center = (glm::vec2(at) + glm::vec2(0.5f)) * cell_size - glm::vec2(map.extent);
+		worst = std::max(worst, std::abs(map.distance(center) - expected));
+		checked += 1;
+	}
+	std::cout << "  accuracy: worst error " << worst / cell_size << " cells over " << checked << " cell centers" << std::endl;
+
+	//sampling speed, against the single-bit lookup:
+	constexpr size_t Count = 1000000;
+	auto segments = random_segments(map, 0.0f, Count);
+	size_t blocked = 0;
+	double point_rate = queries_per_second(Count, [&]() {
+		for (auto const &s : segments) blocked += map.blocked(s.first);
+	});
+	double sum = 0.0;
+	double distance_rate = queries_per_second(Count, [&]() {
+		glm::vec2 normal;
+		for (auto const &s : segments) sum += map.distance(s.first, &normal) + normal.x;
+	});
+	std::cout << "  point " << point_rate / 1e6 << "M/s, distance + normal " << distance_rate / 1e6 << "M/s (checksum " << blocked + sum << ")" << std::endl;
+
+	//how much of the open floor a body of a given radius can stand on:
+	size_t open = 0;
+	size_t clear = 0;
+	for (uint32_t y = 0; y < map.size; ++y) {
+		for (uint32_t x = 0; x < map.size; ++x) {
+			if (map.blocked_cell(glm::ivec2(x, y))) continue;
+			open += 1;
+			glm::vec2 center = (glm::vec2(x, y) + glm::vec2(0.5f)) * cell_size - glm::vec2(map.extent);
+			clear += map.clear(center, PlayerRadius);
+		}
+	}
+	std::cout << "  " << 100.0 * double(clear) / double(std::max< size_t >(open, 1)) << "% of open cells are clear for a body of radius " << PlayerRadius << std::endl;
+}
+
+//each frame every collidable moves a little, then runs an overlap query and an attack cone query,
+// the way CollisionSystem does for the local player:
+static void bench_broadphase() {
+	constexpr uint32_t Frames = 20;
+	constexpr float Extent = 20.0f;
+	constexpr float Speed = 2.0f * MovementStep;
+	constexpr float Reach = 2.0f * PlayerRadius;
+
+	for (uint32_t count : {16U, 256U, 4096U}) {
+		//play the same frames either scanning everyone or through a SpatialHash, counting overlaps and cone hits:
+		auto run = [&](bool use_hash, size_t *found) {
+			Random random;
+			std::vector< glm::vec3 > positions(count), forwards(count);
+			for (auto &position : positions) {
+				position = glm::vec3(glm::vec2(random(), random()) * (2.0f * Extent) - glm::vec2(Extent), 0.0f);
+			}
+			SpatialHash hash(1.0f); //(CollisionSystem::CellSize)
+			std::vector< uint32_t > nearby;
+			std::vector< ConeHit > hits;
+
+			auto before = std::chrono::steady_clock::now();
+			for (uint32_t frame = 0; frame < Frames; ++frame) {
+				for (uint32_t i = 0; i < count; ++i) {
+					float angle = random() * 6.2831853f;
+					forwards[i] = glm::vec3(std::cos(angle), std::sin(angle), 0.0f);
+					positions[i] += forwards[i] * Speed;
+				}
+				if (use_hash) {
+					for (uint32_t i = 0; i < count; ++i) hash.update(i, positions[i]);
+				}
+				for (uint32_t i = 0; i < count; ++i) {
+					if (use_hash) {
+						nearby.clear();
+						hash.query_radius(positions[i], Reach, &nearby);
+						for (uint32_t j : nearby) *found += (j != i && glm::length(positions[i] - positions[j]) < Reach);
+						hits.clear();
+						hash.query_cone(AttackCone(positions[i], forwards[i], AttackDegree, AttackRadius), &hits);
+						for (auto const &hit : hits) *found += (hit.id != i);
+					} else {
+						for (uint32_t j = 0; j < count; ++j) {
+							if (j == i) continue;
+							*found += (glm::length(positions[i] - positions[j]) < Reach);
+							float distance;
+							*found += in_attack_cone(positions[i], forwards[i], positions[j], AttackDegree, AttackRadius, &distance);
+						}
+					}
+				}
+			}
+			return std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count() / Frames;
+		};
+
+		size_t scan_found = 0, hash_found = 0;
+		double scan_time = run(false, &scan_found);
+		double hash_time = run(true, &hash_found);
+		std::cout << "  " << count << " collidables: scan " << scan_time * 1e6 << " us/frame, hash " << hash_time * 1e6 << " us/frame"
+		          << " (" << scan_time / hash_time << "x; " << scan_found << " vs. " << hash_found << " hits)" << std::endl;
+	}
+}
+
+//crowds packed tightly enough that about a third of the bodies start out overlapping someone:
+static void bench_resolve() {
+	constexpr uint32_t Runs = 10;
+	for (uint32_t count : {16U, 256U, 4096U}) {
+		float side = std::sqrt(float(count)) * 4.0f * PlayerRadius;
+		auto crowd = [&](CollisionWorld *world) {
+			Random random;
+			world->clear();
+			for (uint32_t i = 0; i < count; ++i) world->add(glm::vec2(random(), random()) * side, PlayerRadius);
+		};
+		auto overlapping = [&](CollisionWorld const &world) {
+			uint32_t pairs = 0;
+			for (uint32_t i = 0; i < count; ++i) {
+				for (uint32_t j = i + 1; j < count; ++j) {
+					//(with the same slack resolve() allows, since pushes only just separate bodies)
+					pairs += glm::length(world.position(i) - world.position(j)) < world.radius[i] + world.radius[j] - CollisionWorld::Slop;
+				}
+			}
+			return pairs;
+		};
+
+		//what CollisionSystem::FixOverLap used to do, applied to every body in turn:
+		CollisionWorld world;
+		double one_at_a_time = 0.0;
+		for (uint32_t run = 0; run < Runs; ++run) {
+			crowd(&world);
+			auto before = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < count; ++i) {
+				for (uint32_t j = 0; j < count; ++j) {
+					if (i == j) continue;
+					glm::vec2 diff = world.position(i) - world.position(j);
+					float distance = glm::length(diff) - world.radius[i] - world.radius[j];
+					if (distance < 0.0f) {
+						glm::vec2 push = -distance * glm::normalize(diff);
+						world.x[i] += push.x;
+						world.y[i] += push.y;
+					}
+				}
+			}
+			one_at_a_time += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		}
+		uint32_t one_at_a_time_left = overlapping(world);
+
+		double batched = 0.0;
+		uint32_t found = 0;
+		for (uint32_t run = 0; run < Runs; ++run) {
+			crowd(&world);
+			auto before = std::chrono::steady_clock::now();
+			found = world.resolve();
+			batched += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		}
+		uint32_t batched_left = overlapping(world);
+
+		std::cout << "  " << count << " bodies, " << found << " overlapping pairs: "
+		          << "one at a time " << one_at_a_time / Runs * 1e6 << " us (" << one_at_a_time_left << " pairs left), "
+		          << "CollisionWorld " << batched / Runs * 1e6 << " us (" << batched_left << " pairs left after " << world.iterations_used << " of up to " << CollisionWorld::DefaultIterations << " iterations)"
+		          << (batched_left > one_at_a_time_left ? " (MORE LEFT THAN ONE AT A TIME)" : "") << std::endl;
+	}
+}
+
+static void bench_height(std::string const &filename) {
+	auto before = std::chrono::steady_clock::now();
+	HeightMap ground(filename);
+	double load = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+	std::cout << "  load: " << load * 1e3 << " ms for " << ground.size << "x" << ground.size << " samples, heights " << ground.low << " to " << ground.high << std::endl;
+
+	constexpr size_t Count = 1000000;
+	Random random;
+	std::vector< glm::vec2 > positions(Count);
+	for (auto &position : positions) {
+		position = glm::vec2(random(), random()) * (2.0f * ground.extent) - glm::vec2(ground.extent);
+	}
+
+	//(one untimed pass first, so the timings are of lookups rather than of faulting in the mapping)
+	double sum = 0.0;
+	for (auto const &position : positions) sum += ground.height(position);
+	double height_rate = queries_per_second(Count, [&]() {
+		for (auto const &position : positions) sum += ground.height(position);
+	});
+	double slope_rate = queries_per_second(Count, [&]() {
+		glm::vec2 slope;
+		for (auto const &position : positions) sum += ground.height(position, &slope) + slope.x;
+	});
+	//players walk, so successive lookups are near each other; what the server does every tick:
+	std::vector< glm::vec2 > walk(Count);
+	for (size_t i = 0; i < Count; ++i) {
+		walk[i] = positions[i / 64] + float(i % 64) * (2.0f * MovementStep) * glm::vec2(0.6f, 0.8f);
+	}
+	double walk_rate = queries_per_second(Count, [&]() {
+		for (auto const &position : walk) sum += ground.height(position);
+	});
+	std::cout << "  height " << height_rate / 1e6 << "M/s, height + slope " << slope_rate / 1e6 << "M/s, along walks " << walk_rate / 1e6 << "M/s"
+	          << " (4096 players: " << 4096.0 / slope_rate * 1e6 << " us per tick; checksum " << sum << ")" << std::endl;
+
+	//slope against central differences, halfway between samples and a quarter sample either side (so on one bilinear patch):
+	float spacing = 2.0f * ground.extent / float(ground.size);
+	float step = 0.25f * spacing;
+	float worst = 0.0f, steepest = 0.0f;
+	for (size_t i = 0; i < 10000; ++i) {
+		glm::vec2 sample = glm::floor((positions[i] * 0.99f + glm::vec2(ground.extent)) / spacing);
+		glm::vec2 at = (sample + glm::vec2(1.0f)) * spacing - glm::vec2(ground.extent);
+		glm::vec2 slope;
+		ground.height(at, &slope);
+		glm::vec2 expected = glm::vec2(
+			ground.height(at + glm::vec2(step, 0.0f)) - ground.height(at - glm::vec2(step, 0.0f)),
+			ground.height(at + glm::vec2(0.0f, step)) - ground.height(at - glm::vec2(0.0f, step))
+		) / (2.0f * step);
+		worst = std::max(worst, glm::length(slope - expected));
+		steepest = std::max(steepest, glm::length(slope));
+	}
+	std::cout << "  slope: steepest " << steepest << ", worst difference from finite differences " << worst << std::endl;
+}
+
+static void bench_path(CollisionMap const &map) {
+	constexpr uint32_t Builds = 5;
+	double best = std::numeric_limits< double >::infinity();
+	std::unique_ptr< NavGrid > grid;
+	for (uint32_t i = 0; i < Builds; ++i) {
+		auto before = std::chrono::steady_clock::now();
+		grid = std::make_unique< NavGrid >(map, PlayerRadius);
+		best = std::min(best, std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count());
+	}
+	std::vector< uint32_t > region_size(grid->region_count + 1, 0);
+	for (uint32_t region : grid->regions) region_size[region] += 1;
+	uint32_t largest = uint32_t(std::max_element(region_size.begin() + 1, region_size.end()) - region_size.begin());
+	uint32_t walkable = uint32_t(grid->regions.size()) - region_size[0];
+	std::cout << "  build: " << best * 1e3 << " ms for " << grid->size << "x" << grid->size << " nodes (" << grid->node_size << " units each); "
+	          << 100.0 * walkable / double(grid->regions.size()) << "% walkable, " << grid->region_count << " regions, largest holds "
+	          << 100.0 * region_size[largest] / double(walkable) << "%" << std::endl;
+
+	//random spots a player could stand in the largest region:
+	Random random;
+	auto spot = [&]() {
+		while (true) {
+			glm::vec2 at = (glm::vec2(random(), random()) * 2.0f - glm::vec2(1.0f)) * map.extent;
+			glm::ivec2 node;
+			if (map.clear(at, PlayerRadius) && grid->nearest_walkable(at, &node) && grid->region(node) == largest) return at;
+		}
+	};
+	constexpr uint32_t Pairs = 2000;
+	std::vector< std::pair< glm::vec2, glm::vec2 > > pairs(Pairs);
+	for (auto &pair : pairs) pair = std::make_pair(spot(), spot());
+
+	//one thread, no cache:
+	{
+		NavGrid::Search search;
+		std::vector< glm::vec2 > path;
+		uint32_t found = 0, blocked = 0;
+		uint64_t expanded = 0, waypoints = 0;
+		double length = 0.0;
+		auto before = std::chrono::steady_clock::now();
+		for (auto const &[start, goal] : pairs) {
+			if (!grid->find_path(start, goal, &search, &path)) continue;
+			found += 1;
+			expanded += search.expanded;
+			waypoints += path.size();
+		}
+		double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		//(check the paths afterward, so the checks aren't timed)
+		for (auto const &[start, goal] : pairs) {
+			if (!grid->find_path(start, goal, &search, &path)) continue;
+			glm::vec2 at = start;
+			for (auto const &next : path) {
+				length += glm::length(next - at);
+				at = next;
+			}
+			for (size_t i = 0; i + 1 < path.size(); ++i) blocked += !grid->clear_line(path[i], path[i + 1]);
+		}
+		std::cout << "  find_path: " << Pairs / seconds << " paths/s (" << seconds / Pairs * 1e6 << " us each), "
+		          << found << "/" << Pairs << " found, " << double(expanded) / found << " nodes expanded, "
+		          << double(waypoints) / found << " waypoints, " << length / found << " units long, " << blocked << " blocked legs" << std::endl;
+	}
+
+	//through a Pathfinder, polling like a game loop would:
+	auto run = [&](char const *label, std::vector< std::pair< glm::vec2, glm::vec2 > > const &queries) {
+		Pathfinder pathfinder(*grid);
+		std::vector< Pathfinder::Response > done;
+		auto before = std::chrono::steady_clock::now();
+		for (auto const &[start, goal] : queries) pathfinder.request(start, goal);
+		while (pathfinder.pending()) {
+			pathfinder.poll(&done);
+			std::this_thread::yield();
+		}
+		double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		size_t found = std::count_if(done.begin(), done.end(), [](Pathfinder::Response const &r) { return r.found; });
+		std::cout << "  Pathfinder (" << pathfinder.workers.size() << " workers), " << label << ": " << queries.size() / seconds << " paths/s, "
+		          << found << "/" << queries.size() << " found, " << pathfinder.cache_hits() << " cache hits" << std::endl;
+	};
+	run("distinct pairs", pairs);
+
+	//bots heading between a handful of points from a few hundred places:
+	std::vector< glm::vec2 > starts(200), goals(8);
+	for (auto &at : starts) at = spot();
+	for (auto &at : goals) at = spot();
+	std::vector< std::pair< glm::vec2, glm::vec2 > > repeated(Pairs);
+	for (auto &pair : repeated) {
+		pair = std::make_pair(starts[uint32_t(random() * starts.size())], goals[uint32_t(random() * goals.size())]);
+	}
+	run("200 starts x 8 goals", repeated);
+}
+
+//everyone attacks at once in a crowd (as on a busy server tick), picking their nearest target:
+static void bench_cone() {
+	constexpr uint32_t Runs = 20;
+
+	//the test CollisionSystem::CheckOverLap used before AttackCone:
+	auto acos_in_cone = [](glm::vec3 const &position, glm::vec3 const &forward, glm::vec3 const &target, float *distance) {
+		glm::vec3 diff_vec = target - position;
+		*distance = glm::length(diff_vec);
+		if (*distance > AttackRadius) return false;
+		diff_vec = glm::normalize(diff_vec);
+		float angle = glm::degrees(glm::acos(glm::dot(diff_vec, forward)));
+		if (angle > AttackDegree * 0.5f) return false;
+		return true;
+	};
+
+	for (uint32_t count : {16U, 256U, 4096U}) {
+		//about one attacker per square unit, so each cone holds a few targets:
+		float extent = 0.5f * std::sqrt(float(count));
+		Random random;
+		std::vector< glm::vec3 > positions(count), forwards(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			positions[i] = glm::vec3(glm::vec2(random(), random()) * (2.0f * extent) - glm::vec2(extent), 0.0f);
+			float angle = random() * 6.2831853f;
+			forwards[i] = glm::vec3(std::cos(angle), std::sin(angle), 0.0f);
+		}
+		SpatialHash hash(1.0f); //(CollisionSystem::CellSize)
+		for (uint32_t i = 0; i < count; ++i) hash.update(i, positions[i]);
+
+		std::vector< uint32_t > old_target(count), new_target(count), batch_target(count);
+		std::vector< uint32_t > nearby;
+		std::vector< ConeHit > hits;
+		std::vector< std::pair< uint32_t, uint32_t > > ranges;
+		std::vector< AttackCone > cones;
+		size_t in_cone = 0;
+
+		auto time = [&](auto const &fn) {
+			fn(); //(warm up)
+			auto before = std::chrono::steady_clock::now();
+			for (uint32_t run = 0; run < Runs; ++run) fn();
+			return std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count() / Runs;
+		};
+
+		//broadphase candidates, acos test, keep the nearest:
+		double old_time = time([&]() {
+			for (uint32_t i = 0; i < count; ++i) {
+				nearby.clear();
+				hash.query_radius(positions[i], AttackRadius, &nearby);
+				std::sort(nearby.begin(), nearby.end());
+				float min_distance = AttackRadius;
+				old_target[i] = 0;
+				for (uint32_t j : nearby) {
+					float distance;
+					if (j == i || !acos_in_cone(positions[i], forwards[i], positions[j], &distance)) continue;
+					if (distance < min_distance) {
+						min_distance = distance;
+						old_target[i] = j + 1;
+					}
+				}
+			}
+		});
+
+		//one query_cone per attacker (all hits, sorted):
+		double new_time = time([&]() {
+			in_cone = 0;
+			for (uint32_t i = 0; i < count; ++i) {
+				hits.clear();
+				hash.query_cone(AttackCone(positions[i], forwards[i], AttackDegree, AttackRadius), &hits);
+				new_target[i] = 0;
+				for (auto const &hit : hits) {
+					if (hit.id == i) continue;
+					in_cone += 1;
+					if (!new_target[i]) new_target[i] = hit.id + 1;
+				}
+			}
+		});
+
+		//everyone through query_cones at once:
+		double batch_time = time([&]() {
+			cones.clear();
+			for (uint32_t i = 0; i < count; ++i) cones.emplace_back(positions[i], forwards[i], AttackDegree, AttackRadius);
+			hits.clear();
+			hash.query_cones(cones, &hits, &ranges);
+			for (uint32_t i = 0; i < count; ++i) {
+				batch_target[i] = 0;
+				for (uint32_t h = ranges[i].first; h < ranges[i].second; ++h) {
+					if (hits[h].id == i) continue;
+					batch_target[i] = hits[h].id + 1;
+					break;
+				}
+			}
+		});
+
+		uint32_t differ = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			differ += (old_target[i] != new_target[i]) + (new_target[i] != batch_target[i]);
+		}
+
+		//just the per-candidate test, over everyone:
+		float sink = 0.0f;
+		double acos_test = time([&]() {
+			for (uint32_t j = 0; j < count; ++j) {
+				float distance;
+				sink += acos_in_cone(positions[0], forwards[0], positions[j], &distance) ? distance : 0.0f;
+			}
+		}) / count;
+		AttackCone cone(positions[0], forwards[0], AttackDegree, AttackRadius);
+		double cone_test = time([&]() {
+			for (uint32_t j = 0; j < count; ++j) {
+				float distance2;
+				sink += cone.contains(positions[j], &distance2) ? distance2 : 0.0f;
+			}
+		}) / count;
+
+		std::cout << "  " << count << " attackers: acos " << old_time * 1e6 << " us, cone " << new_time * 1e6 << " us ("
+		          << old_time / new_time << "x), batched " << batch_time * 1e6 << " us (" << old_time / batch_time << "x); "
+		          << double(in_cone) / count << " targets/cone, " << differ << " targets differ; per test "
+		          << acos_test * 1e9 << " vs. " << cone_test * 1e9 << " ns" << (sink < 0.0f ? "!" : "") << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cerr << "Usage:\n\t./collision-bench sweep [map]\n\t./collision-bench distance [map]\n\t./collision-bench broadphase\n\t./collision-bench resolve\n\t./collision-bench height [map]\n\t./collision-bench path [map]\n\t./collision-bench cone" << std::endl;
+		return 1;
+	}
+	std::string mode = argv[1];
+	std::string map_file = (argc >= 3 ? argv[2] : data_path("map/collision.map"));
+
+	if (mode == "sweep") {
+		CollisionMap map(map_file);
+		std::cout << "Collision queries:" << std::endl;
+		bench_sweep(map);
+	} else if (mode == "distance") {
+		std::cout << "Distance field:" << std::endl;
+		bench_distance(map_file);
+	} else if (mode == "broadphase") {
+		std::cout << "Broadphase:" << std::endl;
+		bench_broadphase();
+	} else if (mode == "resolve") {
+		std::cout << "Overlap resolution:" << std::endl;
+		bench_resolve();
+	} else if (mode == "height") {
+		std::cout << "Height map:" << std::endl;
+		bench_height(argc >= 3 ? argv[2] : data_path("map/heightmap.map"));
+	} else if (mode == "path") {
+		CollisionMap map(map_file);
+		std::cout << "Pathfinding:" << std::endl;
+		bench_path(map);
+	} else if (mode == "cone") {
+		std::cout << "Melee target selection:" << std::endl;
+		bench_cone();
+	} else {
+		std::cerr << "Unknown benchmark '" << mode << "'." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,154 @@
+# Convert a collision image (or a collision.txt written by tobuffer.py) into the
+# binary collision map that CollisionMap.cpp memory-maps at startup.
+#
+# usage: python3 tocollision.py collision.png    (writes collision.map)
+#
+# The output is three chunks in the read_chunk format (read_write_chunk.hpp):
+#  'cmh1': one header { uint32 size; float32 extent; uint32 tile_size; uint32 distance_scale; }
+#  'cmt0': (size/tile_size)^2 tiles, row by row, each a little-endian uint64 of
+#          tile_size x tile_size occupancy bits (bit y*tile_size + x set for a wall)
+#  'cmd0': size^2 little-endian int16, row by row: the signed distance from each cell center
+#          to the nearest wall edge, in 1/distance_scale cells (positive in the open, negative
+#          inside walls, clamped to what fits), as CollisionMap::build_distance_field computes it
+# Cell (x, y) covers world [-extent + x * cell, -extent + (x+1) * cell) on x (cell = 2*extent/size),
+#  and likewise on y.
+
+import sys
+import struct
+
+WALKABLE_THRESHOLD = 0.95 # normalized values below this are walls
+EXTENT = 20.0 # the map covers [-EXTENT, EXTENT] in x and y
+TILE_SIZE = 8 # one uint64 per tile
+DISTANCE_SCALE = 16 # distance field units per cell (CollisionMap::DistanceScale)
+
+def load_values(filename):
+    if filename.endswith(".txt"):
+        with open(filename) as handle:
+            values = [float(v) for v in handle.read().split()]
+        size = int(round(len(values) ** 0.5))
+        return size, values
+
+    from PIL import Image
+    with Image.open(filename) as im:
+        pixels = im.load()
+        width, height = im.size
+        assert width == height, "collision image should be square"
+        lt = []
+        for i in range(width):
+            for j in range(height):
+                lt.append(pixels[i, j][0])
+    # normalize to [0,1], as tobuffer.py does:
+    smallest = min(lt)
+    largest = max(lt)
+    factor = 1.0 / (largest - smallest)
+    return width, [(v - smallest) * factor for v in lt]
+
+# exact Euclidean distance transform (Felzenszwalb & Huttenlocher), as in CollisionMap.cpp:
+# squared distance along each row, then the lower envelope of parabolas down each column.
+# (plain Python, so a 2048x2048 map takes a quarter of a minute -- which is why it is baked here, not at startup)
+INF = float("inf")
+
+def squared_distance_1d(f):
+    n = len(f)
+    v = [0] * n
+    z = [0.0] * (n + 1)
+    k = -1
+    for q in range(n):
+        fq = f[q]
+        if fq == INF:
+            continue
+        fq += q * q
+        s = 0.0
+        while k >= 0:
+            p = v[k]
+            s = (fq - (f[p] + p * p)) / (2.0 * (q - p))
+            if s > z[k]:
+                break
+            k -= 1
+        k += 1
+        v[k] = q
+        z[k] = -INF if k == 0 else s
+        z[k + 1] = INF
+    if k < 0:
+        return [INF] * n
+    d = [0.0] * n
+    k = 0
+    for q in range(n):
+        while z[k + 1] < q:
+            k += 1
+        delta = q - v[k]
+        d[q] = delta * delta + f[v[k]]
+    return d
+
+def row_squared_distances(row, target):
+    # squared distance along the row to the nearest cell equal to 'target':
+    n = len(row)
+    out = [INF] * n
+    run = INF
+    for x in range(n):
+        run = 0.0 if row[x] == target else run + 1.0
+        out[x] = run
+    run = INF
+    for x in range(n - 1, -1, -1):
+        run = 0.0 if row[x] == target else run + 1.0
+        if run < out[x]:
+            out[x] = run
+        out[x] = out[x] * out[x]
+    return out
+
+def distance_field(size, walls):
+    # walls[y][x] is 1 for a wall cell; returns row-major int16 values
+    limit = 32767.0 / DISTANCE_SCALE
+    to_wall_rows = [row_squared_distances(walls[y], 1) for y in range(size)]
+    to_open_rows = [row_squared_distances(walls[y], 0) for y in range(size)]
+    field = [0] * (size * size)
+    for x in range(size):
+        to_wall = squared_distance_1d([to_wall_rows[y][x] for y in range(size)])
+        to_open = squared_distance_1d([to_open_rows[y][x] for y in range(size)])
+        for y in range(size):
+            if to_wall[y] == 0.0:
+                d = 0.5 - to_open[y] ** 0.5
+            else:
+                d = to_wall[y] ** 0.5 - 0.5
+            d = max(-limit, min(limit, d)) * DISTANCE_SCALE
+            # (rounded half away from zero, like std::lround)
+            field[y * size + x] = int(d + 0.5) if d >= 0.0 else -int(-d + 0.5)
+    return field
+
+def write_chunk(handle, magic, data):
+    assert len(magic) == 4
+    handle.write(magic.encode("ascii"))
+    handle.write(struct.pack("<I", len(data)))
+    handle.write(data)
+
+size, values = load_values(sys.argv[1])
+assert len(values) == size * size, "expected %d values, got %d" % (size * size, len(values))
+
+# values are in tobuffer.py's order: column by column, top to bottom;
+# the game has always looked up world cell (x, y) at value x * size + (size - y):
+def wall(x, y):
+    i = x * size + (size - y)
+    return i < size * size and values[i] < WALKABLE_THRESHOLD
+
+assert size % TILE_SIZE == 0, "map size should be a multiple of %d" % TILE_SIZE
+tiles_per_row = size // TILE_SIZE
+tiles = [0] * (tiles_per_row * tiles_per_row)
+cells = [[0] * size for y in range(size)]
+walls = 0
+for y in range(size):
+    for x in range(size):
+        if wall(x, y):
+            tile = (y // TILE_SIZE) * tiles_per_row + (x // TILE_SIZE)
+            tiles[tile] |= 1 << ((y % TILE_SIZE) * TILE_SIZE + (x % TILE_SIZE))
+            cells[y][x] = 1
+            walls += 1
+
+field = distance_field(size, cells)
+
+output = sys.argv[1].rsplit(".", 1)[0] + ".map"
+with open(output, "wb") as handle:
+    write_chunk(handle, "cmh1", struct.pack("<IfII", size, EXTENT, TILE_SIZE, DISTANCE_SCALE))
+    write_chunk(handle, "cmt0", struct.pack("<%dQ" % len(tiles), *tiles))
+    write_chunk(handle, "cmd0", struct.pack("<%dh" % len(field), *field))
+
+print("%dx%d cells, %d walls -> %s" % (size, size, walls, output))
@@ -0,0 +1,144 @@
+# Convert a height image (or a heightmap.txt written by tobuffer.py) into the
+# binary height map that HeightMap.cpp memory-maps at startup.
+#
+# usage: python3 toheight.py heightmap.png field.pnct field.scene [ground]    (writes heightmap.map)
+#    or: python3 toheight.py heightmap.png low high
+#
+# Darkest pixels are at height 'low' and brightest at 'high'. These are normally read off the
+# ground mesh: the lowest and highest world-space z of the mesh drawn by the transform named
+# 'ground' (default Plane.001) in the scene, so players stand on the terrain as drawn.
+# Giving 'low high' directly is for maps whose meshes aren't at hand.
+#
+# The output is two chunks in the read_chunk format (read_write_chunk.hpp):
+#  'hmh1': one header { uint32 size; float32 extent; uint32 tile_size; uint32 reserved; float32 low; float32 high; }
+#  'hmt0': (size/tile_size)^2 tiles, row by row, each tile_size x tile_size little-endian
+#          uint16 samples, row by row (0 is 'low', 65535 is 'high')
+# Sample (x, y) is the height at the center of collision map cell (x, y) (see tocollision.py).
+
+import sys
+import struct
+
+EXTENT = 20.0 # the map covers [-EXTENT, EXTENT] in x and y, like the collision map
+TILE_SIZE = 8 # 8x8 uint16 samples = 128 bytes per tile
+
+def load_values(filename):
+    if filename.endswith(".txt"):
+        with open(filename) as handle:
+            values = [float(v) for v in handle.read().split()]
+        size = int(round(len(values) ** 0.5))
+        return size, values
+
+    from PIL import Image
+    with Image.open(filename) as im:
+        pixels = im.load()
+        width, height = im.size
+        assert width == height, "height image should be square"
+        lt = []
+        for i in range(width):
+            for j in range(height):
+                lt.append(pixels[i, j][0])
+    # normalize to [0,1], as tobuffer.py does:
+    smallest = min(lt)
+    largest = max(lt)
+    factor = 1.0 / (largest - smallest)
+    return width, [(v - smallest) * factor for v in lt]
+
+def write_chunk(handle, magic, data):
+    assert len(magic) == 4
+    handle.write(magic.encode("ascii"))
+    handle.write(struct.pack("<I", len(data)))
+    handle.write(data)
+
+def read_chunks(filename):
+    with open(filename, "rb") as handle:
+        data = handle.read()
+    chunks = {}
+    at = 0
+    while at < len(data):
+        magic = data[at:at+4].decode("ascii")
+        length, = struct.unpack("<I", data[at+4:at+8])
+        chunks[magic] = data[at+8:at+8+length]
+        at += 8 + length
+    return chunks
+
+def rotate(q, v):
+    # quaternion (x, y, z, w) applied to v: v + 2w (q x v) + 2 q x (q x v)
+    x, y, z, w = q
+    cx, cy, cz = y*v[2] - z*v[1], z*v[0] - x*v[2], x*v[1] - y*v[0]
+    ccx, ccy, ccz = y*cz - z*cy, z*cx - x*cz, x*cy - y*cx
+    return (v[0] + 2.0*(w*cx + ccx), v[1] + 2.0*(w*cy + ccy), v[2] + 2.0*(w*cz + ccz))
+
+def ground_range(pnct_filename, scene_filename, ground):
+    # transforms and mesh attachments, as Scene::load reads them:
+    scene = read_chunks(scene_filename)
+    names = scene["str0"]
+    transforms = []
+    XFH_SIZE = 4 + 4 + 4 + 12 + 16 + 12
+    for i in range(0, len(scene["xfh0"]), XFH_SIZE):
+        parent, name_begin, name_end = struct.unpack("<iII", scene["xfh0"][i:i+12])
+        position = struct.unpack("<3f", scene["xfh0"][i+12:i+24])
+        rotation = struct.unpack("<4f", scene["xfh0"][i+24:i+40])
+        scale = struct.unpack("<3f", scene["xfh0"][i+40:i+52])
+        transforms.append((parent, names[name_begin:name_end].decode("utf8"), position, rotation, scale))
+    meshes = {}
+    for i in range(0, len(scene["msh0"]), 12):
+        transform, name_begin, name_end = struct.unpack("<iII", scene["msh0"][i:i+12])
+        meshes[transform] = names[name_begin:name_end].decode("utf8")
+    found = [i for i, t in enumerate(transforms) if t[1] == ground]
+    assert found, "no transform named '%s' in %s" % (ground, scene_filename)
+    assert found[0] in meshes, "transform '%s' has no mesh" % ground
+    mesh = meshes[found[0]]
+
+    # that mesh's vertices, as MeshBuffer reads them (36-byte vertices, position first):
+    buffer = read_chunks(pnct_filename)
+    strings = buffer["str0"]
+    entry = None
+    for i in range(0, len(buffer["idx0"]), 16):
+        name_begin, name_end, vertex_begin, vertex_end = struct.unpack("<4I", buffer["idx0"][i:i+16])
+        if strings[name_begin:name_end].decode("utf8") == mesh:
+            entry = (vertex_begin, vertex_end)
+    assert entry, "no mesh named '%s' in %s" % (mesh, pnct_filename)
+
+    low, high = float("inf"), -float("inf")
+    for v in range(entry[0], entry[1]):
+        point = struct.unpack("<3f", buffer["pnct"][v*36:v*36+12])
+        t = found[0]
+        while t != -1:
+            parent, name, position, rotation, scale = transforms[t]
+            point = rotate(rotation, (point[0] * scale[0], point[1] * scale[1], point[2] * scale[2]))
+            point = (point[0] + position[0], point[1] + position[1], point[2] + position[2])
+            t = parent
+        low, high = min(low, point[2]), max(high, point[2])
+    print("ground '%s' (mesh '%s') spans z %g to %g" % (ground, mesh, low, high))
+    return low, high
+
+if len(sys.argv) not in (4, 5):
+    sys.exit("usage: python3 toheight.py heightmap.png field.pnct field.scene [ground]\n"
+             "   or: python3 toheight.py heightmap.png low high")
+size, values = load_values(sys.argv[1])
+assert len(values) == size * size, "expected %d values, got %d" % (size * size, len(values))
+try:
+    low, high = float(sys.argv[2]), float(sys.argv[3])
+except ValueError:
+    low, high = ground_range(sys.argv[2], sys.argv[3], sys.argv[4] if len(sys.argv) > 4 else "Plane.001")
+
+# values are in tobuffer.py's order, and looked up the same way as the collision map's
+# so that heights line up with walls (the last index is clamped, since that lookup runs one past the end):
+def sample(x, y):
+    i = min(x * size + (size - y), size * size - 1)
+    return max(0, min(65535, int(round(values[i] * 65535.0))))
+
+assert size % TILE_SIZE == 0, "map size should be a multiple of %d" % TILE_SIZE
+tiles_per_row = size // TILE_SIZE
+samples = [0] * (size * size)
+for y in range(size):
+    for x in range(size):
+        tile = (y // TILE_SIZE) * tiles_per_row + (x // TILE_SIZE)
+        samples[tile * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + (x % TILE_SIZE)] = sample(x, y)
+
+output = sys.argv[1].rsplit(".", 1)[0] + ".map"
+with open(output, "wb") as handle:
+    write_chunk(handle, "hmh1", struct.pack("<IfIIff", size, EXTENT, TILE_SIZE, 0, low, high))
+    write_chunk(handle, "hmt0", struct.pack("<%dH" % len(samples), *samples))
+
+print("%dx%d samples from %g to %g -> %s" % (size, size, low, high, output))
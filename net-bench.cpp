@@ -0,0 +1,586 @@
+#include "Connection.hpp"
+#include "NetworkPlayer.hpp"
+#include "Snapshot.hpp"
+#include "Interpolation.hpp"
+#include "PoseHistory.hpp"
+#include "Combat.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <tuple>
+#include <deque>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+//Micro-benchmarks for the networking code.
+//Usage:
+//	./net-bench poll [port]   -- cost of Server::poll() as the number of open connections grows
+//	./net-bench serialize     -- cost of building every client's per-tick state message
+//	./net-bench delta         -- bytes per tick per client with quantized delta updates
+//	./net-bench udp [port]    -- state and event delivery over the UDP transport with simulated loss/latency
+//	./net-bench predict       -- client-side prediction of scripted movement against a simulated delayed server
+//	./net-bench interpolate   -- remote player interpolation with network jitter and loss, at several frame rates
+//	./net-bench rewind        -- cost of judging attacks against rewound player positions
+
+#ifndef _WIN32
+//open a plain (blocking) TCP socket to localhost:port:
+static int connect_loopback(uint16_t port) {
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s < 0) return -1;
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(s, reinterpret_cast< struct sockaddr * >(&addr), sizeof(addr)) != 0) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+//time Server::poll() with 'count' idle connections and one connection that is sending every iteration:
+static void bench_poll(uint16_t port, size_t count) {
+	Server server(std::to_string(port));
+
+	std::vector< int > clients;
+	clients.reserve(count);
+	while (clients.size() < count) {
+		int s = connect_loopback(port);
+		if (s < 0) {
+			std::cerr << "  (could only open " << clients.size() << " connections)" << std::endl;
+			break;
+		}
+		clients.emplace_back(s);
+		//accept as we go so the listen backlog never fills:
+		server.poll(nullptr, 0.0);
+	}
+	while (server.connections.size() < clients.size()) {
+		server.poll(nullptr, 0.01);
+	}
+
+	size_t received = 0;
+	auto on_event = [&](Connection *c, Connection::Event evt) {
+		if (evt == Connection::OnRecv) {
+			received += c->recv_buffer.size();
+			c->recv_buffer.clear();
+			c->send('!'); //exercise the write path as well
+		}
+	};
+
+	constexpr uint32_t Iterations = 2000;
+	char ping = 'p';
+	char pong[64];
+	double total = 0.0;
+	for (uint32_t i = 0; i < Iterations; ++i) {
+		if (send(clients[i % clients.size()], &ping, 1, 0) != 1) break;
+		auto before = std::chrono::high_resolution_clock::now();
+		while (received <= i) server.poll(on_event, 0.001);
+		auto after = std::chrono::high_resolution_clock::now();
+		total += std::chrono::duration< double >(after - before).count();
+		server.poll(on_event, 0.0); //flush the reply
+		if (recv(clients[i % clients.size()], pong, sizeof(pong), 0) <= 0) break;
+	}
+
+	std::cout << "  " << server.connections.size() << " connections: "
+	          << (total / Iterations) * 1e6 << " us per poll (one active connection)" << std::endl;
+
+	for (int s : clients) close(s);
+	server.poll(nullptr, 0.01);
+}
+#endif
+
+//the pre-wire-struct serializer (byte-at-a-time through unions), kept for comparison:
+static void legacy_convert_to_message(Server_Player const &player, std::vector<unsigned char> &server_message) {
+	union { glm::vec3 v; unsigned char b[sizeof(glm::vec3)]; } vec3_bytes;
+	union { glm::quat q; unsigned char b[sizeof(glm::quat)]; } quat_bytes;
+	union { unsigned int u; unsigned char b[sizeof(unsigned int)]; } uint_bytes;
+
+	server_message.emplace_back((unsigned char)player.id);
+	for (auto const &[position, rotation] : {
+		std::make_pair(player.position, player.rotation),
+		std::make_pair(player.portal1_position, player.portal1_rotation),
+		std::make_pair(player.portal2_position, player.portal2_rotation) }) {
+		vec3_bytes.v = position;
+		for (size_t i = 0; i < sizeof(glm::vec3); ++i) server_message.emplace_back(vec3_bytes.b[i]);
+		quat_bytes.q = rotation;
+		for (size_t i = 0; i < sizeof(glm::quat); ++i) server_message.emplace_back(quat_bytes.b[i]);
+	}
+	server_message.emplace_back((unsigned char)player.gotHit);
+	server_message.emplace_back((unsigned char)player.animState);
+	uint_bytes.u = player.curFrame;
+	for (size_t i = 0; i < sizeof(unsigned int); ++i) server_message.emplace_back(uint_bytes.b[i]);
+}
+
+//write one state message the way server.cpp does:
+static void queue_state_message(Connection &c, uint8_t player_count, uint8_t you, uint32_t tick, uint32_t baseline_tick, std::shared_ptr< std::vector< char > const > const &delta) {
+	c.send('m');
+	c.send(uint32_t(sizeof(Server_Message_Header) + delta->size()));
+	Server_Message_Header header;
+	header.version = NetworkProtocolVersion;
+	header.ping = 0;
+	header.player_count = player_count;
+	header.you = you;
+	header.tick = tick;
+	header.baseline_tick = baseline_tick;
+	header.last_input = 0;
+	header.movement = movement_to_wire(Movement_State());
+	c.send(header);
+	c.send_shared(delta);
+}
+
+//time one server tick's worth of state messages (every client gets every player) for 'count' players:
+static void bench_serialize(size_t count) {
+	std::vector< Server_Player > players(count, Server_Player()); //(copies, so only one id is taken from the pool)
+	std::vector< Connection > connections(count);
+	for (size_t i = 0; i < count; ++i) {
+		players[i].id = uint8_t(i + 1);
+		players[i].curFrame = uint32_t(i);
+	}
+
+	auto time_ticks = [&](auto &&tick) {
+		constexpr uint32_t Ticks = 20;
+		size_t bytes = 0;
+		double total = 0.0;
+		for (uint32_t t = 0; t < Ticks; ++t) {
+			auto before = std::chrono::high_resolution_clock::now();
+			tick();
+			auto after = std::chrono::high_resolution_clock::now();
+			total += std::chrono::duration< double >(after - before).count();
+			for (auto &c : connections) {
+				bytes += c.send_pending_bytes();
+				c.send_buffer.clear();
+				c.send_shared_queue.clear();
+			}
+		}
+		std::cout << (total / Ticks) * 1e6 << " us/tick (" << bytes / Ticks << " bytes/tick)";
+	};
+
+	std::cout << "  " << count << " players: legacy ";
+	time_ticks([&](){
+		for (size_t r = 0; r < count; ++r) {
+			std::vector< unsigned char > server_message;
+			server_message.emplace_back((unsigned char)0);
+			legacy_convert_to_message(players[r], server_message);
+			for (size_t o = 0; o < count; ++o) {
+				if (o != r) legacy_convert_to_message(players[o], server_message);
+			}
+			connections[r].send('m');
+			connections[r].send(server_message.size());
+			connections[r].send_raw(server_message.data(), server_message.size());
+		}
+	});
+	std::cout << ", shared snapshot ";
+	time_ticks([&](){
+		Snapshot snapshot;
+		snapshot.tick = 1;
+		for (auto const &p : players) snapshot.players.emplace_back(p.quantize());
+		auto encoded = std::make_shared< std::vector< char > >();
+		snapshot.write_delta(nullptr, encoded.get());
+		std::shared_ptr< std::vector< char > const > delta = encoded;
+		for (size_t r = 0; r < count; ++r) {
+			queue_state_message(connections[r], uint8_t(count), uint8_t(r), snapshot.tick, 0, delta);
+		}
+	});
+	std::cout << std::endl;
+}
+
+//bytes per tick sent to one client with full float state vs. quantized deltas, when 'moving' of 'count' players are moving:
+// (portals stay put, as they do most of the time in play)
+static void bench_delta(size_t count, size_t moving) {
+	std::vector< Server_Player > players(count, Server_Player()); //(copies, so only one id is taken from the pool)
+	for (size_t i = 0; i < count; ++i) {
+		players[i].id = uint8_t(i + 1);
+		players[i].position = glm::vec3(-15.0f + 30.0f * float(i) / float(count), 0.0f, 0.0f);
+		players[i].portal1_position = glm::vec3(-7.0f, -1.0f, -3.0f);
+		players[i].portal2_position = glm::vec3(7.0f, 1.0f, -3.0f);
+	}
+
+	Snapshot_History history;
+	Bandwidth_Counter legacy, full, delta;
+	uint32_t acked = 0;
+	float max_position_error = 0.0f;
+	float min_rotation_dot = 1.0f;
+	double code_seconds = 0.0; //encoding and decoding the delta
+	for (uint32_t tick = 1; tick <= 200; ++tick) {
+		for (size_t i = 0; i < moving; ++i) {
+			float t = float(tick) * 0.05f + float(i);
+			players[i].position += glm::vec3(std::cos(t), std::sin(t), 0.0f) * 0.1f;
+			players[i].rotation = glm::angleAxis(t, glm::vec3(0.0f, 0.0f, 1.0f));
+			players[i].animState = RUN;
+			players[i].curFrame = tick;
+		}
+
+		Snapshot snapshot;
+		snapshot.tick = tick;
+		for (auto const &p : players) snapshot.players.emplace_back(p.quantize());
+
+		std::vector< char > encoded;
+		snapshot.write_delta(nullptr, &encoded);
+		full.add(1 + sizeof(uint32_t) + sizeof(Server_Message_Header) + encoded.size());
+
+		encoded.clear();
+		Snapshot const *baseline = history.find(acked);
+		auto before = std::chrono::steady_clock::now();
+		snapshot.write_delta(baseline, &encoded);
+		code_seconds += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		delta.add(1 + sizeof(uint32_t) + sizeof(Server_Message_Header) + encoded.size());
+
+		//the original format: 'm' + size_t + ping + ~90 bytes of floats per player:
+		std::vector< unsigned char > server_message;
+		for (auto const &p : players) legacy_convert_to_message(p, server_message);
+		legacy.add(1 + sizeof(size_t) + 1 + server_message.size());
+
+		//check what the client would decode:
+		Snapshot decoded;
+		before = std::chrono::steady_clock::now();
+		decoded.read_delta(baseline, uint8_t(count), encoded.data(), encoded.size());
+		code_seconds += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		for (size_t i = 0; i < count; ++i) {
+			glm::vec3 position;
+			glm::quat rotation;
+			decoded.players[i].player.get(&position, &rotation);
+			max_position_error = std::max(max_position_error, glm::length(position - players[i].position));
+			min_rotation_dot = std::min(min_rotation_dot, std::abs(glm::dot(rotation, players[i].rotation)));
+		}
+
+		history.push(std::move(snapshot));
+		acked = tick - 1; //the client acks with about a tick of latency
+		legacy.end_tick();
+		full.end_tick();
+		delta.end_tick();
+	}
+
+	std::cout << "  " << count << " players, " << moving << " moving: "
+	          << legacy.bytes_per_tick() << " bytes/tick (floats), "
+	          << full.bytes_per_tick() << " (quantized), "
+	          << delta.bytes_per_tick() << " (quantized delta); "
+	          << "max position error " << max_position_error << ", min rotation dot " << min_rotation_dot << "; "
+	          << "encode + decode " << code_seconds / 200.0 * 1e6 << "us" << std::endl;
+}
+
+//UDP transport over loopback with simulated loss/latency:
+// the server sends one state message and one reliable event each tick to one client
+static void bench_udp(uint16_t port, Network_Simulation const &simulation) {
+	Server server(std::to_string(port), Transport::UDP);
+	server.simulation = simulation;
+	Client client("localhost", std::to_string(port), Transport::UDP);
+	client.simulation = simulation;
+
+	auto now = [](){ return std::chrono::duration< double >(std::chrono::steady_clock::now().time_since_epoch()).count(); };
+
+	struct Event {
+		uint32_t index;
+		double time;
+	};
+	constexpr uint32_t Ticks = 300;
+	constexpr double Tick = 0.01;
+
+	uint32_t states_received = 0, states_out_of_order = 0, newest_state = 0;
+	uint32_t events_sent = 0, events_received = 0, events_out_of_order = 0;
+	uint32_t next_event = 0;
+	double event_latency = 0.0, event_latency_max = 0.0;
+
+	auto on_client_event = [&](Connection *c, Connection::Event evt) {
+		if (evt != Connection::OnRecv) return;
+		if (!c->recv_state.empty()) {
+			uint32_t tick;
+			memcpy(&tick, c->recv_state.data(), sizeof(tick));
+			c->recv_state.clear();
+			states_received += 1;
+			if (tick <= newest_state) states_out_of_order += 1;
+			newest_state = std::max(newest_state, tick);
+		}
+		while (c->recv_buffer.size() >= sizeof(Event)) {
+			Event event;
+			c->recv_buffer.copy_out(0, &event, sizeof(event));
+			c->recv_buffer.consume(sizeof(event));
+			if (events_received != 0 && event.index != next_event) events_out_of_order += 1;
+			next_event = event.index + 1;
+			events_received += 1;
+			double latency = now() - event.time;
+			event_latency += latency;
+			event_latency_max = std::max(event_latency_max, latency);
+		}
+	};
+
+	double next_tick = now();
+	uint32_t tick = 0;
+	while ((tick < Ticks || events_received < events_sent) && now() < next_tick + 10.0) {
+		if (tick < Ticks && now() >= next_tick) {
+			next_tick += Tick;
+			tick += 1;
+			for (auto &c : server.connections) {
+				c.send_state(&tick, sizeof(tick));
+				c.send(Event{events_sent, now()});
+				events_sent += 1;
+			}
+			client.connection.send_state(&tick, sizeof(tick)); //(keeps the client "alive")
+		}
+		server.poll(nullptr, 0.0);
+		client.poll(on_client_event, 0.001);
+	}
+
+	Datagram_Channel const &channel = *client.connection.datagram;
+	std::cout << "  loss " << simulation.loss * 100.0f << "%, latency " << simulation.latency * 1000.0 << "ms (+" << simulation.jitter * 1000.0 << "ms jitter): "
+	          << "state " << states_received << "/" << tick << " (" << states_out_of_order << " stale), "
+	          << "events " << events_received << "/" << events_sent << " (" << events_out_of_order << " out of order), "
+	          << "event latency " << (events_received ? event_latency / events_received : 0.0) * 1000.0 << "ms avg " << event_latency_max * 1000.0 << "ms max, "
+	          << "rtt " << channel.rtt * 1000.0 << "ms" << std::endl;
+}
+
+//client-side prediction against a server 'latency' seconds away (each way), running one input per client frame;
+// with 'disturb', the server now and then moves the player in a way the client can't predict (like being pushed):
+static void bench_predict(float latency, bool disturb) {
+	constexpr uint32_t StepsPerTick = 3; //(server.cpp's 1/20s tick)
+	constexpr uint32_t Frames = 1200;
+	uint32_t delay = uint32_t(std::lround(latency / MovementStep));
+
+	Server_Player server_player;
+	Movement_Predictor predictor;
+	predictor.state = server_player.movement;
+
+	struct Update {
+		uint32_t frame; //when it arrives
+		uint32_t last_input;
+		Movement_State state;
+	};
+	std::deque< std::pair< uint32_t, Movement_Input > > to_server;
+	std::deque< Update > to_client;
+
+	uint32_t updates = 0, mispredicted = 0, max_pending = 0;
+	float max_error = 0.0f, max_drawn_step = 0.0f;
+	glm::vec3 drawn = predictor.displayed_position();
+	for (uint32_t frame = 0; frame < Frames; ++frame) {
+		//scripted input: walk in a slowly turning circle, with pauses:
+		glm::vec2 direction = glm::vec2(0.0f);
+		if ((frame / 90) % 3 != 2) {
+			float t = float(frame) * MovementStep;
+			direction = glm::vec2(std::cos(t), std::sin(t));
+		}
+		Movement_Input const &input = predictor.step(direction, 0, frame * 16, nullptr);
+		to_server.emplace_back(frame + delay, input);
+		max_pending = std::max(max_pending, uint32_t(predictor.pending.size()));
+
+		//server: buffer inputs as they arrive, simulate every tick, send state back:
+		while (!to_server.empty() && to_server.front().first <= frame) {
+			server_player.inputs.emplace_back(to_server.front().second);
+			to_server.pop_front();
+		}
+		if (frame % StepsPerTick == 0) {
+			server_player.simulate(StepsPerTick, nullptr);
+			if (disturb && frame % 120 == 0) server_player.movement.position.x += 0.3f;
+			to_client.emplace_back(Update{frame + delay, server_player.lastInput, server_player.movement});
+		}
+
+		//client: reconcile with whatever has arrived:
+		while (!to_client.empty() && to_client.front().frame <= frame) {
+			Update const &update = to_client.front();
+			float error = predictor.reconcile(update.last_input, update.state, nullptr);
+			updates += 1;
+			if (error > 1e-4f) mispredicted += 1;
+			max_error = std::max(max_error, error);
+			to_client.pop_front();
+		}
+
+		predictor.update_correction(MovementStep);
+		glm::vec3 next_drawn = predictor.displayed_position();
+		max_drawn_step = std::max(max_drawn_step, glm::length(next_drawn - drawn));
+		drawn = next_drawn;
+	}
+	Server_Player::id_used[server_player.id - 1] = false;
+
+	std::cout << "  " << latency * 1000.0f << "ms each way" << (disturb ? ", with server-side pushes" : "") << ": "
+	          << updates << " updates, " << mispredicted << " mispredicted (max error " << max_error << "), "
+	          << "up to " << max_pending << " inputs replayed, "
+	          << "max drawn step per frame " << max_drawn_step << " (walking moves at most " << 2.0f * MovementStep << ")" << std::endl;
+}
+
+//a remote player walking a circle, sent every ServerTick with 'jitter' seconds of random delay and 'loss' chance of being lost,
+// drawn at 'fps' with 'delay' of interpolation; reports how far the drawn position is from where the player was at that time:
+static void bench_interpolate(double fps, double jitter, float loss, double delay) {
+	constexpr double Duration = 30.0;
+	constexpr double Latency = 0.05;
+	auto truth = [](double t) {
+		//(walking speed, like Movement's)
+		return glm::vec3(2.0f * std::cos(float(t)), 2.0f * std::sin(float(t)), 0.0f);
+	};
+
+	uint32_t seed = 0x1234567;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return double(seed >> 8) / double(1 << 24);
+	};
+
+	//schedule every snapshot's arrival:
+	std::vector< std::pair< double, uint32_t > > arrivals; //(time, tick)
+	for (uint32_t tick = 1; double(tick) * ServerTick < Duration; ++tick) {
+		if (random() < loss) continue;
+		arrivals.emplace_back(double(tick) * ServerTick + Latency + random() * jitter, tick);
+	}
+	std::sort(arrivals.begin(), arrivals.end());
+
+	Interpolation_Clock clock;
+	clock.delay = delay;
+	Pose_Buffer buffer;
+	Interpolation_Stats stats;
+	double total_error = 0.0, max_error = 0.0;
+	size_t next = 0;
+	double frame = 1.0 / fps;
+	for (double now = 0.0; now < Duration; now += frame) {
+		while (next < arrivals.size() && arrivals[next].first <= now) {
+			double snapshot_time = double(arrivals[next].second) * ServerTick;
+			clock.on_snapshot(snapshot_time);
+			buffer.push(snapshot_time, truth(snapshot_time), glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+			next += 1;
+		}
+		clock.advance(frame);
+		glm::vec3 position;
+		glm::quat rotation;
+		Pose_Buffer::Result result = buffer.sample(clock.time, &position, &rotation);
+		if (result == Pose_Buffer::Empty || now < 1.0) continue; //(let the clock settle)
+		stats.add(result);
+		double error = glm::length(position - truth(clock.time));
+		total_error += error;
+		max_error = std::max(max_error, error);
+	}
+
+	std::cout << "  " << fps << "fps, " << jitter * 1000.0 << "ms jitter, " << loss * 100.0f << "% loss, " << delay * 1000.0 << "ms delay: "
+	          << "error " << (stats.samples ? total_error / stats.samples : 0.0) << " avg " << max_error << " max, "
+	          << stats.underruns() << "/" << stats.samples << " underruns (" << stats.held << " held)" << std::endl;
+}
+
+//cost of one server tick of lag-compensated attack checks, when every one of 'count' players attacks:
+static void bench_rewind(size_t count) {
+	PoseHistory poses(count);
+	std::vector< glm::vec3 > position(count);
+	std::vector< glm::vec3 > forward(count);
+	uint32_t tick = 0;
+	auto record_tick = [&]() {
+		tick += 1;
+		poses.begin_tick(tick);
+		for (size_t i = 0; i < count; ++i) {
+			//players mill about in a 10x10 area, so most attacks have someone in range:
+			float t = float(tick) * 0.05f + float(i) * 0.7f;
+			position[i] = glm::vec3(5.0f * std::cos(t * 0.3f + float(i)), 5.0f * std::sin(t * 0.2f + float(i) * 1.3f), 0.0f);
+			forward[i] = glm::vec3(std::cos(t), std::sin(t), 0.0f);
+			poses.record(uint8_t(i + 1), position[i]);
+		}
+	};
+	for (uint32_t i = 0; i < PoseHistory::Capacity; ++i) record_tick();
+
+	constexpr uint32_t Ticks = 200;
+	size_t queries = 0, hits = 0, differ = 0;
+	double seconds = 0.0, batch_seconds = 0.0;
+	std::vector< uint8_t > targets(count);
+	std::vector< PoseHistory::Attack > attacks;
+	std::vector< uint8_t > batch_targets(count);
+	for (uint32_t t = 0; t < Ticks; ++t) {
+		record_tick();
+		//attackers see the world 2-7 ticks in the past (interpolation delay + latency):
+		auto view_tick = [&](size_t i) { return tick - 2 - uint32_t(i % 6); };
+
+		auto before = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; ++i) {
+			targets[i] = poses.find_target(uint8_t(i + 1), position[i], forward[i], view_tick(i), 0.37f, AttackDegree, AttackRadius);
+			if (targets[i]) hits += 1;
+		}
+		seconds += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+
+		//the same attacks judged together, as the server does:
+		before = std::chrono::steady_clock::now();
+		attacks.clear();
+		for (size_t i = 0; i < count; ++i) {
+			attacks.emplace_back(PoseHistory::Attack{uint8_t(i + 1), AttackCone(position[i], forward[i], AttackDegree, AttackRadius), view_tick(i), 0.37f});
+		}
+		poses.find_targets(attacks.data(), attacks.size(), batch_targets.data());
+		batch_seconds += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+
+		for (size_t i = 0; i < count; ++i) differ += (targets[i] != batch_targets[i]);
+		queries += count;
+	}
+
+	std::cout << "  " << count << " players: " << (seconds / queries) * 1e9 << " ns/attack, "
+	          << (seconds / Ticks) * 1e6 << " us/tick with everyone attacking (" << 100.0 * double(hits) / double(queries) << "% hit); "
+	          << (batch_seconds / Ticks) * 1e6 << " us/tick judged together (" << seconds / batch_seconds << "x, " << differ << " differ)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cerr << "Usage:\n\t./net-bench poll [port]\n\t./net-bench serialize\n\t./net-bench delta\n\t./net-bench udp [port]\n\t./net-bench predict\n\t./net-bench interpolate\n\t./net-bench rewind" << std::endl;
+		return 1;
+	}
+	std::string mode = argv[1];
+	uint16_t port = uint16_t(argc >= 3 ? std::stoi(argv[2]) : 15466);
+
+	if (mode == "poll") {
+		#ifdef _WIN32
+		std::cerr << "The poll benchmark is not supported on windows." << std::endl;
+		#else
+		#if defined(__linux__) && !defined(CONNECTION_USE_SELECT)
+		std::cout << "Server::poll (epoll):" << std::endl;
+		#else
+		std::cout << "Server::poll (select):" << std::endl;
+		#endif
+		for (size_t count : {16, 64, 256, 1000, 4000}) {
+			#if !(defined(__linux__) && !defined(CONNECTION_USE_SELECT))
+			if (count + 8 >= FD_SETSIZE) break; //select() can't watch this many sockets
+			#endif
+			bench_poll(uint16_t(port + (count % 97)), count);
+		}
+		#endif
+	} else if (mode == "serialize") {
+		std::cout << "Per-tick state messages:" << std::endl;
+		for (size_t count : {16, 64, 255}) {
+			bench_serialize(count);
+		}
+	} else if (mode == "delta") {
+		std::cout << "State bytes per tick, per client:" << std::endl;
+		for (auto [count, moving] : { std::make_pair(4, 0), std::make_pair(4, 1), std::make_pair(16, 4), std::make_pair(16, 16), std::make_pair(255, 64), std::make_pair(255, 255) }) {
+			bench_delta(size_t(count), size_t(moving));
+		}
+	} else if (mode == "udp") {
+		std::cout << "UDP transport (one client, one state message + one reliable event per 10ms tick):" << std::endl;
+		for (auto [loss, latency, jitter] : { std::make_tuple(0.0f, 0.0, 0.0), std::make_tuple(0.1f, 0.025, 0.01), std::make_tuple(0.3f, 0.05, 0.02) }) {
+			Network_Simulation simulation;
+			simulation.loss = loss;
+			simulation.latency = latency;
+			simulation.jitter = jitter;
+			bench_udp(port, simulation);
+		}
+	} else if (mode == "predict") {
+		std::cout << "Client-side prediction (one input per 1/60s frame, server ticks every 1/20s):" << std::endl;
+		for (float latency : {0.0f, 0.05f, 0.15f}) {
+			bench_predict(latency, false);
+			bench_predict(latency, true);
+		}
+	} else if (mode == "interpolate") {
+		std::cout << "Remote player interpolation (error is in world units; the player walks at 2 units/s):" << std::endl;
+		for (double fps : {30.0, 60.0, 144.0}) {
+			bench_interpolate(fps, 0.0, 0.0f, 0.1);
+		}
+		for (auto [jitter, loss, delay] : { std::make_tuple(0.03, 0.05f, 0.05), std::make_tuple(0.03, 0.05f, 0.1), std::make_tuple(0.08, 0.1f, 0.1), std::make_tuple(0.08, 0.1f, 0.15) }) {
+			bench_interpolate(60.0, jitter, loss, delay);
+		}
+	} else if (mode == "rewind") {
+		std::cout << "Lag-compensated attack checks (" << PoseHistory::Capacity << " ticks of history):" << std::endl;
+		for (size_t count : {16, 64, 255}) {
+			bench_rewind(count);
+		}
+	} else {
+		std::cerr << "Unknown benchmark '" << mode << "'." << std::endl;
+		return 1;
+	}
+	return 0;
+}
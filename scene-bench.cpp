@@ -0,0 +1,326 @@
+#include "Scene.hpp"
+#include "Frustum.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <limits>
+
+//Micro-benchmarks for the CPU side of scene drawing (no GL context needed).
+//Usage:
+//	./scene-bench transforms       -- per-drawable parent-chain walks vs. Scene::update_world, at 1k/4k/16k transforms
+//	./scene-bench cull             -- frustum tests one box at a time vs. four at a time, and render queue build with and without culling
+//	./scene-bench bvh              -- bounds BVH build and refit, and frustum/ray/box queries through it vs. testing every box
+
+//deterministic pseudo-random numbers in [0,1), so runs are comparable:
+struct Random {
+	uint32_t seed = 0x1234567;
+	float operator()() {
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) / float(1 << 24);
+	}
+};
+
+//'count' transforms scattered around, a quarter of them roots and the rest parented to a random earlier
+// transform (so hierarchies are a few levels deep, like props on buildings on blocks):
+static void make_transforms(Scene *scene, size_t count) {
+	Random random;
+	std::vector< Scene::Transform * > made;
+	made.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		scene->transforms.emplace_back();
+		Scene::Transform &t = scene->transforms.back();
+		t.name = "T" + std::to_string(i);
+		t.position = glm::vec3(random(), random(), random()) * 10.0f;
+		t.rotation = glm::angleAxis(random() * 6.2831853f, glm::vec3(0.0f, 0.0f, 1.0f));
+		if (!made.empty() && random() < 0.75f) {
+			t.parent = made[size_t(random() * float(made.size()))];
+		}
+		made.emplace_back(&t);
+	}
+}
+
+template< typename F >
+static double seconds_per_call(uint32_t calls, F const &call) {
+	auto before = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < calls; ++i) call();
+	return std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count() / double(calls);
+}
+
+static void bench_transforms() {
+	for (size_t count : {1024, 4096, 16384}) {
+		Scene scene;
+		make_transforms(&scene, count);
+		uint32_t depth = 0;
+		for (auto const &t : scene.transforms) {
+			uint32_t d = 0;
+			for (Scene::Transform const *at = t.parent; at; at = at->parent) ++d;
+			depth = std::max(depth, d);
+		}
+		uint32_t const Calls = uint32_t(std::max< size_t >(10, 2000000 / count));
+		float sum = 0.0f; //(so nothing is optimized away)
+
+		//what Scene::draw used to do: one recursive make_local_to_world per drawable (say, one per transform):
+		double walk = seconds_per_call(Calls, [&]() {
+			for (auto const &t : scene.transforms) sum += t.make_local_to_world()[3].x;
+		});
+
+		//first update builds the order and computes everything:
+		double build = seconds_per_call(1, [&]() { scene.update_world(); });
+
+		//nothing moved:
+		double still = seconds_per_call(Calls, [&]() {
+			scene.update_world();
+			sum += scene.world_cache.local_to_world.back()[3].x;
+		});
+
+		//some transforms move every frame (players, portals, doors); 'fraction' of them, picked anew each frame:
+		Random random;
+		std::vector< Scene::Transform * > all;
+		for (auto &t : scene.transforms) all.emplace_back(&t);
+		auto moving = [&](float fraction) {
+			uint32_t recomputed = 0;
+			double seconds = seconds_per_call(Calls, [&]() {
+				size_t moves = size_t(fraction * float(all.size()));
+				for (size_t m = 0; m < moves; ++m) all[size_t(random() * float(all.size()))]->position.z += 0.01f;
+				scene.update_world();
+				recomputed += scene.world_cache.recomputed;
+				sum += scene.world_cache.local_to_world.back()[3].x;
+			});
+			return std::make_pair(seconds, recomputed / Calls);
+		};
+		auto few = moving(0.01f);
+		auto many = moving(0.1f);
+
+		//check the cache against the recursive walk:
+		float worst = 0.0f;
+		for (auto const &t : scene.transforms) {
+			glm::mat4x3 a = t.make_local_to_world();
+			glm::mat4x3 const &b = scene.cached_local_to_world(t);
+			for (uint32_t c = 0; c < 4; ++c) worst = std::max(worst, glm::length(a[c] - b[c]));
+		}
+
+		std::cout << "  " << count << " transforms (deepest chain " << depth << "): "
+		          << "parent walks " << walk * 1e6 << "us/frame; update_world first " << build * 1e6 << "us, "
+		          << "unchanged " << still * 1e6 << "us, 1% moved " << few.first * 1e6 << "us (" << few.second << " recomputed), "
+		          << "10% moved " << many.first * 1e6 << "us (" << many.second << " recomputed); "
+		          << "max error " << worst << " (checksum " << sum << ")" << std::endl;
+	}
+}
+
+//a city-ish layout: 'count' unit-ish boxes on a grid 4 units apart; returns the view of a Scene::Camera in the middle:
+static glm::mat4 make_city(Scene *scene, size_t count) {
+	uint32_t side = uint32_t(std::ceil(std::sqrt(float(count))));
+	Random random;
+	for (size_t i = 0; i < count; ++i) {
+		scene->transforms.emplace_back();
+		Scene::Transform &t = scene->transforms.back();
+		t.position = glm::vec3(float(i % side) * 4.0f, float(i / side) * 4.0f, 0.0f);
+		t.rotation = glm::angleAxis(random() * 6.2831853f, glm::vec3(0.0f, 0.0f, 1.0f));
+		scene->drawables.emplace_back(&t);
+		Scene::Drawable &drawable = scene->drawables.back();
+		drawable.pipeline.program = 1 + uint32_t(i % 3); //(never used for GL: just gives the queue something to sort)
+		drawable.pipeline.vao = 1;
+		drawable.pipeline.start = uint32_t(i % 7) * 36;
+		drawable.pipeline.count = 36;
+		drawable.min = glm::vec3(-1.0f, -1.0f, 0.0f);
+		drawable.max = glm::vec3(1.0f, 1.0f, 1.0f + 4.0f * random());
+	}
+	scene->transforms.emplace_back();
+	Scene::Camera camera(&scene->transforms.back());
+	camera.transform->position = glm::vec3(float(side) * 2.0f, float(side) * 2.0f, 3.0f);
+	//(tip the camera's -z axis up to +y and a little below the horizon, then turn it to face into the grid)
+	camera.transform->rotation = glm::angleAxis(glm::radians(17.0f - 90.0f), glm::vec3(0.0f, 0.0f, 1.0f))
+	                           * glm::angleAxis(glm::radians(85.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	camera.aspect = 16.0f / 9.0f;
+	return camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+}
+
+static void bench_cull() {
+	for (size_t count : {1024, 16384, 65536}) {
+		Scene scene;
+		glm::mat4 world_to_clip = make_city(&scene, count);
+		scene.update_bounds();
+
+		Frustum frustum(world_to_clip);
+		Frustum::Boxes boxes;
+		for (auto const &drawable : scene.drawables) {
+			boxes.push(scene.cached_local_to_world(*drawable.transform), drawable.min, drawable.max);
+		}
+		std::vector< uint8_t > visible(boxes.size());
+		uint32_t const Calls = uint32_t(std::max< size_t >(10, 4000000 / count));
+
+		size_t one_visible = 0;
+		double one = seconds_per_call(Calls, [&]() {
+			one_visible = 0;
+			for (size_t i = 0; i < boxes.size(); ++i) {
+				one_visible += frustum.intersects(
+					glm::vec3(boxes.center_x[i], boxes.center_y[i], boxes.center_z[i]),
+					glm::vec3(boxes.extent_x[i], boxes.extent_y[i], boxes.extent_z[i])
+				);
+			}
+		});
+		size_t four_visible = 0;
+		double four = seconds_per_call(Calls, [&]() {
+			four_visible = frustum.cull(boxes, visible.data());
+		});
+
+		//the whole CPU side of a frame's queue (cull, key, sort), with bounds and then without:
+		uint32_t const Frames = uint32_t(std::max< size_t >(5, 200000 / count));
+		double culled = seconds_per_call(Frames, [&]() { scene.render_queue.build(scene, world_to_clip); });
+		size_t kept = scene.render_queue.items.size();
+		for (auto &drawable : scene.drawables) drawable.max = glm::vec3(-std::numeric_limits< float >::infinity());
+		scene.bounds_cache.clear();
+		scene.update_bounds();
+		double unculled = seconds_per_call(Frames, [&]() { scene.render_queue.build(scene, world_to_clip); });
+
+		std::cout << "  " << count << " boxes, " << four_visible << " visible" << (one_visible == four_visible ? "" : " (MISMATCH)") << ": "
+		          << "one at a time " << one * 1e6 << "us (" << double(boxes.size()) / one / 1e6 << "M boxes/s), "
+		          << "four at a time " << four * 1e6 << "us (" << double(boxes.size()) / four / 1e6 << "M boxes/s); "
+		          << "queue build " << culled * 1e6 << "us culled to " << kept << " vs. " << unculled * 1e6 << "us unculled" << std::endl;
+	}
+}
+
+//nearest hit of a ray on a box (as BVH::raycast computes it), or infinity:
+static float ray_box(glm::vec3 const &origin, glm::vec3 const &inv_direction, float max_t, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+	float t_in = std::max(std::max(std::max(0.0f, near.x), near.y), near.z);
+	float t_out = std::min(std::min(std::min(max_t, far.x), far.y), far.z);
+	return (t_in <= t_out ? t_in : std::numeric_limits< float >::infinity());
+}
+
+static void bench_bvh() {
+	for (size_t count : {1024, 16384, 65536}) {
+		Scene scene;
+		glm::mat4 world_to_clip = make_city(&scene, count);
+		scene.update_bounds();
+		BVH &bvh = scene.bounds_cache.bvh;
+		Frustum::Boxes const &boxes = bvh.boxes;
+		uint32_t const Calls = uint32_t(std::max< size_t >(10, 2000000 / count));
+		size_t sum = 0; //(so nothing is optimized away)
+
+		//fresh SAH build (from boxes already gathered):
+		double build = seconds_per_call(std::max< uint32_t >(3, Calls / 50), [&]() { bvh.rebuild(); });
+		float built_cost = bvh.built_cost;
+
+		//the view: hierarchical cull vs. every box four at a time:
+		Frustum frustum(world_to_clip);
+		std::vector< uint32_t > visible;
+		double tree_cull = seconds_per_call(Calls, [&]() {
+			visible.clear();
+			bvh.cull(frustum, &visible);
+		});
+		std::vector< uint8_t > flags(boxes.size());
+		size_t flat_visible = 0;
+		double flat_cull = seconds_per_call(Calls, [&]() { flat_visible = frustum.cull(boxes, flags.data()); });
+
+		//rays from above the grid, heading down and across it (like line of sight checks between players):
+		Random random;
+		float size = std::ceil(std::sqrt(float(count))) * 4.0f;
+		uint32_t const Rays = 1000;
+		std::vector< glm::vec3 > origins, directions;
+		for (uint32_t r = 0; r < Rays; ++r) {
+			origins.emplace_back(random() * size, random() * size, 2.0f + 4.0f * random());
+			float angle = random() * 6.2831853f;
+			directions.emplace_back(glm::normalize(glm::vec3(std::cos(angle), std::sin(angle), -0.1f * random())));
+		}
+		float const MaxT = 40.0f;
+		std::vector< float > tree_t(Rays), flat_t(Rays);
+		double tree_rays = seconds_per_call(std::max< uint32_t >(1, Calls / 10), [&]() {
+			for (uint32_t r = 0; r < Rays; ++r) {
+				BVH::Hit hit;
+				tree_t[r] = (bvh.raycast(origins[r], directions[r], MaxT, &hit) ? hit.t : std::numeric_limits< float >::infinity());
+			}
+		}) / double(Rays);
+		double flat_rays = seconds_per_call(std::max< uint32_t >(1, Calls / 100), [&]() {
+			for (uint32_t r = 0; r < Rays; ++r) {
+				glm::vec3 inv_direction = glm::vec3(1.0f) / directions[r];
+				float best = std::numeric_limits< float >::infinity();
+				for (uint32_t i = 0; i < boxes.size(); ++i) {
+					glm::vec3 center(boxes.center_x[i], boxes.center_y[i], boxes.center_z[i]);
+					glm::vec3 extent(boxes.extent_x[i], boxes.extent_y[i], boxes.extent_z[i]);
+					best = std::min(best, ray_box(origins[r], inv_direction, MaxT, center - extent, center + extent));
+				}
+				flat_t[r] = best;
+			}
+		}) / double(Rays);
+		uint32_t ray_mismatches = 0;
+		for (uint32_t r = 0; r < Rays; ++r) ray_mismatches += (tree_t[r] != flat_t[r]);
+
+		//boxes around random spots (like "what is near this portal?"):
+		std::vector< glm::vec3 > spots;
+		for (uint32_t r = 0; r < Rays; ++r) spots.emplace_back(random() * size, random() * size, 1.0f);
+		glm::vec3 const Reach = glm::vec3(6.0f, 6.0f, 2.0f);
+		size_t tree_found = 0, flat_found = 0;
+		std::vector< uint32_t > found;
+		double tree_overlap = seconds_per_call(std::max< uint32_t >(1, Calls / 10), [&]() {
+			tree_found = 0;
+			for (glm::vec3 const &spot : spots) {
+				found.clear();
+				bvh.overlap(spot - Reach, spot + Reach, &found);
+				tree_found += found.size();
+			}
+		}) / double(Rays);
+		double flat_overlap = seconds_per_call(std::max< uint32_t >(1, Calls / 100), [&]() {
+			flat_found = 0;
+			for (glm::vec3 const &spot : spots) {
+				for (uint32_t i = 0; i < boxes.size(); ++i) {
+					flat_found += std::abs(boxes.center_x[i] - spot.x) <= boxes.extent_x[i] + Reach.x
+					           && std::abs(boxes.center_y[i] - spot.y) <= boxes.extent_y[i] + Reach.y
+					           && std::abs(boxes.center_z[i] - spot.z) <= boxes.extent_z[i] + Reach.z;
+				}
+			}
+		}) / double(Rays);
+
+		//a few things wander around every frame; update_bounds() (with update_world()) refits for them:
+		std::vector< Scene::Transform * > movers;
+		for (auto &drawable : scene.drawables) {
+			if (random() < 0.01f) movers.emplace_back(drawable.transform);
+		}
+		double still = seconds_per_call(Calls, [&]() { scene.update_bounds(); sum += scene.bounds_cache.refitted; });
+		uint32_t builds_before = scene.bounds_cache.builds;
+		uint32_t refitted = 0;
+		uint32_t const Frames = 600;
+		double moving = seconds_per_call(Frames, [&]() {
+			for (Scene::Transform *t : movers) t->position += glm::vec3(random() - 0.5f, random() - 0.5f, 0.0f);
+			scene.update_bounds();
+			refitted += scene.bounds_cache.refitted;
+		});
+		sum += visible.size() + found.size();
+
+		std::cout << "  " << count << " boxes: build " << build * 1e3 << "ms (cost " << built_cost << "); "
+		          << "update unchanged " << still * 1e6 << "us, " << movers.size() << " moving " << moving * 1e6 << "us "
+		          << "(" << refitted / Frames << " nodes refit, " << scene.bounds_cache.builds - builds_before << " rebuilds in " << Frames << " frames, cost now " << bvh.current_cost << (std::abs(bvh.current_cost - bvh.cost()) <= 1e-3f * bvh.cost() ? "" : " DRIFTED FROM cost()") << ")" << std::endl;
+		std::cout << "    cull " << tree_cull * 1e6 << "us vs. " << flat_cull * 1e6 << "us flat (" << visible.size() << " visible" << (visible.size() == flat_visible ? "" : " MISMATCH") << "); "
+		          << "ray " << tree_rays * 1e6 << "us vs. " << flat_rays * 1e6 << "us flat (" << ray_mismatches << " mismatches); "
+		          << "overlap " << tree_overlap * 1e6 << "us vs. " << flat_overlap * 1e6 << "us flat (" << tree_found << (tree_found == flat_found ? "" : " MISMATCH") << " found)"
+		          << " (checksum " << sum << ")" << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cerr << "Usage:\n\t./scene-bench transforms\n\t./scene-bench cull\n\t./scene-bench bvh" << std::endl;
+		return 1;
+	}
+	std::string mode = argv[1];
+
+	if (mode == "transforms") {
+		std::cout << "World matrices:" << std::endl;
+		bench_transforms();
+	} else if (mode == "cull") {
+		std::cout << "Frustum culling:" << std::endl;
+		bench_cull();
+	} else if (mode == "bvh") {
+		std::cout << "Bounds BVH:" << std::endl;
+		bench_bvh();
+	} else {
+		std::cerr << "Unknown benchmark '" << mode << "'." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -5,8 +5,19 @@
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
+#include <memory>
+#include <cstring>
 #include <unordered_map>
+#include <algorithm>
+#include <cstdlib>
 #include "NetworkPlayer.hpp"
+#include "Snapshot.hpp"
+#include "CollisionMap.hpp"
+#include "CollisionWorld.hpp"
+#include "HeightMap.hpp"
+#include "PoseHistory.hpp"
+#include "Combat.hpp"
+#include "data_path.hpp"
 #include <unordered_set>
 
 #ifdef _WIN32
@@ -30,25 +41,53 @@ int main(int argc, char **argv) {
 
 	//------------ argument parsing ------------
 
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	if (argc < 2 || argc > 4) {
+		std::cerr << "Usage:\n\t./server <port> [tcp|udp] [max players]" << std::endl;
 		return 1;
 	}
+	Transport transport = Transport::TCP;
+	if (argc >= 3) {
+		if (std::string(argv[2]) == "udp") transport = Transport::UDP;
+		else if (std::string(argv[2]) != "tcp") {
+			std::cerr << "Unknown transport '" << argv[2] << "' (expecting 'tcp' or 'udp')." << std::endl;
+			return 1;
+		}
+	}
+	//(game clients can only show PLAYER_NUM players; more are for load testing with ./bot)
+	size_t max_players = PLAYER_NUM;
+	if (argc >= 4) {
+		max_players = size_t(std::max(1, std::min(int(MaxPlayerIds), std::atoi(argv[3]))));
+	}
 
 	//------------ initialization ------------
 
-	Server server(argv[1]); 
+	Server server(argv[1], transport); 
+
+	//players walk into the same walls as on the client:
+	CollisionMap collision(data_path("map/collision.map"));
+	//...and stand on the same terrain:
+	HeightMap ground(data_path("map/heightmap.map"));
 
 
 	//------------ main loop ------------
-	constexpr float ServerTick = 1.0f / 20.0f; // set a server tick that makes sense for your game
+	//(ServerTick is in NetworkPlayer.hpp, since clients time snapshots with it)
+	//players' movement is simulated in fixed steps, this many per tick:
+	constexpr uint32_t StepsPerTick = uint32_t(ServerTick / MovementStep + 0.5f);
 
 	//server state:
 	bool ping = false;
+	uint32_t tick = 0;
+	Snapshot_History history; //recent snapshots, used as delta baselines
+	PoseHistory poses(max_players); //recent player positions, for judging attacks where the attacker saw them
+	CollisionWorld world; //players as circles, for pushing apart the ones that overlap
+
+	//replication bandwidth, reported every few seconds:
+	Bandwidth_Counter bandwidth;
+	constexpr uint32_t BandwidthReportTicks = 100;
 
 	// clients' state:
 	std::unordered_map< Connection *,  Server_Player> players;
-	players.reserve(PLAYER_NUM); 
+	players.reserve(max_players);
 
 	while (true) {
 
@@ -67,7 +106,8 @@ int main(int argc, char **argv) {
 
 		static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration< double >(ServerTick);
 
-		//hit list
+		//attacks reported this tick, and the players they hit
+		std::vector< std::pair< Connection *, Server_Player::Attack > > attacks;
 		std::unordered_set<int> hit_list;
 
 		//process incoming data from clients until a tick has elapsed:
@@ -82,7 +122,7 @@ int main(int argc, char **argv) {
 				if (evt == Connection::OnOpen) {
 					//client connected:
 					// refuse connection if over size
-					if(players.size() >= PLAYER_NUM){
+					if(players.size() >= max_players){
 						std::cout << "Over Limit\n";
 						//shut down client connection:
 						c->close();
@@ -92,14 +132,17 @@ int main(int argc, char **argv) {
 					players.emplace(c, Server_Player());
 				} 
 				else if (evt == Connection::OnClose) {
-					//client disconnected:
-					std::cout << "Closing\n";
-					//remove them from the players list:
+					//client disconnected (or was closed for sending something bad):
+					// (the connection is freed right after this, so nothing may keep pointing at it)
 					auto f = players.find(c);
-					assert(f != players.end());
-					players.erase(f);
+					if (f == players.end()) return; //(refused when it opened)
+					std::cout << "Closing\n";
 					// make its id available
 					Server_Player::id_used[f->second.id-1] = false;
+					//remove them from the players list:
+					players.erase(f);
+					//...and drop their attacks from this tick:
+					attacks.erase(std::remove_if(attacks.begin(), attacks.end(), [c](auto const &attack) { return attack.first == c; }), attacks.end());
 				} 
 				else { assert(evt == Connection::OnRecv);
 					//got data from client:
@@ -111,49 +154,145 @@ int main(int argc, char **argv) {
 					Server_Player &player = f->second;
 
 					// ----------- handle messages from client ---------- //
-					uint8_t hit_id;
-					player.read_from_message(c, hit_id);
-					hit_list.insert(hit_id);
+					std::vector< Server_Player::Attack > player_attacks;
+					player.read_from_message(c, player_attacks);
+					for (auto const &attack : player_attacks) {
+						attacks.emplace_back(c, attack);
+					}
 				}
 			}, remain);
 		}
 
-		// ----------- send updated game state to all clients -------------- //
+		// ----------- simulate this tick from the buffered inputs -------------- //
+		tick += 1;
+		poses.begin_tick(tick);
+		for (auto &[c, player] : players) {
+			player.simulate(StepsPerTick, &collision);
+		}
+		//players can't stand inside each other, so push apart everyone who overlaps (keeping them out of walls):
+		world.clear();
 		for (auto &[c, player] : players) {
-			(void)player; //work around "unused variable" warning on whatever g++ github actions uses
-			// construct a status message
-			std::vector<unsigned char> server_message;
+			world.add(glm::vec2(player.movement.position.x, player.movement.position.y), PlayerRadius);
+		}
+		world.resolve(CollisionWorld::DefaultIterations, &collision);
+		{
+			uint32_t i = 0;
+			for (auto &[c, player] : players) {
+				player.movement.position.x = world.x[i];
+				player.movement.position.y = world.y[i];
+				player.position = player.movement.position;
+				player.position.z = ground.height(glm::vec2(player.position.x, player.position.y));
+				//(placed portals stand on the terrain too)
+				if (player.movement.portals_placed & Movement_Input::PlacePortal1) {
+					player.portal1_position.z = ground.height(glm::vec2(player.portal1_position.x, player.portal1_position.y));
+				}
+				if (player.movement.portals_placed & Movement_Input::PlacePortal2) {
+					player.portal2_position.z = ground.height(glm::vec2(player.portal2_position.x, player.portal2_position.y));
+				}
+				poses.record(player.id, player.position);
+				i += 1;
+			}
+		}
 
-			// ------- first put public message (same for all player) ------- //
-			server_message.emplace_back((unsigned char)ping);
+		// ----------- judge attacks against where their targets were when the attacker saw them -------------- //
+		//(all at once, so attacks viewing the same ticks share the rewind)
+		std::vector< PoseHistory::Attack > judging;
+		std::vector< std::pair< Server_Player const *, uint8_t > > claims; //(attacker, claimed target) for each of judging
+		for (auto const &[c, attack] : attacks) {
+			auto f = players.find(c);
+			if (f == players.end()) continue; //(attacker left)
+			Server_Player const &attacker = f->second;
+			glm::vec3 forward = attacker.rotation * glm::vec3(0.0f, 1.0f, 0.0f);
+			if (attack.viewTick + PoseHistory::MaxRewindTicks < tick) {
+				//(judged as if seen MaxRewindTicks ago -- either a very slow connection or a client reaching back)
+				std::cout << "[attack] player " << int(attacker.id) << " attacked with a view " << int(tick) - int(attack.viewTick)
+				          << " ticks old; rewinding only " << PoseHistory::MaxRewindTicks << std::endl;
+			}
+			judging.emplace_back(PoseHistory::Attack{attacker.id, AttackCone(attacker.position, forward, AttackDegree, AttackRadius), attack.viewTick, attack.viewFraction});
+			claims.emplace_back(&attacker, attack.claimedTarget);
+		}
+		std::vector< uint8_t > targets(judging.size());
+		poses.find_targets(judging.data(), judging.size(), targets.data());
+		for (size_t i = 0; i < judging.size(); ++i) {
+			Server_Player const &attacker = *claims[i].first;
+			uint8_t target = targets[i];
+			if (target != claims[i].second) {
+				std::cout << "[attack] player " << int(attacker.id) << " claimed to hit " << int(claims[i].second)
+				          << ", hit " << int(target) << " (rewound " << std::min(int(tick) - int(judging[i].view_tick), int(PoseHistory::MaxRewindTicks)) << " ticks)" << std::endl;
+			}
+			if (target != 0) hit_list.insert(target);
+		}
 
-			// ------- put all players' infos -------- //
-			// put the info of client itself at first
+		// ----------- send updated game state to all clients -------------- //
+		// build this tick's snapshot once:
+		Snapshot snapshot;
+		snapshot.tick = tick;
+		snapshot.players.reserve(players.size());
+		std::unordered_map< Connection *, uint8_t > slots;
+		for (auto &[c, player] : players) {
 			if (hit_list.find(player.id) != hit_list.end()) {
 				player.gotHit = true;
 			}
 			else {
 				player.gotHit = false;
 			}
-			player.convert_to_message(server_message);
-			// put the info of other players 
-			for (auto &[c_other, player_other] : players){
-				if (c != c_other){
-					player_other.convert_to_message(server_message);
-				}
-			}
-			//send an update starting with 'm'
-			c->send('m');
-			// send size
-			sizet_as_byte sizet_bytes;
-			sizet_bytes.sizet_value = server_message.size();
-			for (size_t i =0; i < sizeof(size_t); i++){
-				c->send(sizet_bytes.bytes_value[i]);
+			slots[c] = (uint8_t)snapshot.players.size();
+			snapshot.players.emplace_back(player.quantize());
+		}
+
+		// delta-encode against each client's acknowledged snapshot;
+		// clients with the same baseline get a reference to the same buffer:
+		std::unordered_map< uint32_t, std::shared_ptr< std::vector< char > const > > deltas;
+		for (auto &[c, player] : players) {
+			Snapshot const *baseline = history.find(player.ackTick);
+			uint32_t baseline_tick = (baseline ? baseline->tick : 0);
+			auto &delta = deltas[baseline_tick];
+			if (!delta) {
+				auto encoded = std::make_shared< std::vector< char > >();
+				snapshot.write_delta(baseline, encoded.get());
+				delta = encoded;
 			}
-			// send message
-			c->send_buffer.insert(c->send_buffer.end(), server_message.begin(), server_message.end());
+
+			//send an update starting with 'm':
+			char message[1 + sizeof(uint32_t) + sizeof(Server_Message_Header)];
+			message[0] = 'm';
+			// size
+			uint32_t size = uint32_t(sizeof(Server_Message_Header) + delta->size());
+			wire_swap(size);
+			memcpy(message + 1, &size, sizeof(size));
+
+			// ------- per-recipient header: public info + which slot is "you" ------- //
+			Server_Message_Header header;
+			header.version = NetworkProtocolVersion;
+			header.ping = (uint8_t)ping;
+			header.player_count = (uint8_t)players.size();
+			header.you = slots[c];
+			header.tick = tick;
+			header.baseline_tick = baseline_tick;
+			header.last_input = player.lastInput;
+			header.movement = movement_to_wire(player.movement);
+			wire_swap(header);
+			memcpy(message + 1 + sizeof(uint32_t), &header, sizeof(header));
+
+			// ------- players' infos (shared, not copied) -------- //
+			// (state: over UDP, a newer update replaces this one if it hasn't gone out yet)
+			if (!c->send_state(message, sizeof(message), delta)) bandwidth.streamed += 1;
+
+			bandwidth.add(sizeof(message) + delta->size());
 		}
+		history.push(std::move(snapshot));
 
+		bandwidth.end_tick();
+		if (bandwidth.ticks == BandwidthReportTicks) {
+			if (!players.empty()) {
+				std::cout << "[bandwidth] " << bandwidth.bytes_per_tick() << " bytes/tick (peak " << bandwidth.peak_tick_bytes << ") to " << players.size() << " clients";
+				if (bandwidth.streamed) {
+					std::cout << "; " << bandwidth.streamed << " states too big for a datagram went on the reliable stream";
+				}
+				std::cout << std::endl;
+			}
+			bandwidth.reset();
+		}
 	}
 
 	return 0;